@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include <bit>
 
@@ -29,7 +30,38 @@ std::string generate_construction_cpp(const std::vector<InstantiatedFormat> &for
 	}
     };
 
-    auto print_construct_lower = [&](uint32_t level) {
+    // The bottom level reads its voxels out of voxel_block, which is filled
+    // by Voxelizer::at_block. If the level is a power of two cube, the block is
+    // one brick of the Morton order at a time, otherwise the whole level.
+    auto bottom_level_brick_edge = [&]() -> uint32_t {
+	auto [w, h, d] = calculate_bounds(format, format.size() - 1);
+	if (w != h || h != d || !std::has_single_bit(w)) {
+	    return 0;
+	}
+	return std::min(w, 8U);
+    };
+
+    auto print_fetch_voxel_block = [&](uint32_t level, std::string_view coord_prefix) {
+	uint32_t brick_edge = bottom_level_brick_edge();
+	if (level + 1 < format.size() || !brick_edge) {
+	    return;
+	}
+	ss << R"(        if (morton % )" << brick_edge * brick_edge * brick_edge << R"( == 0) {
+            voxelizer.at_block(lower_x + )" << coord_prefix << R"(x, lower_y + )" << coord_prefix << R"(y, lower_z + )" << coord_prefix << R"(z, )" << brick_edge << R"(, )" << brick_edge << R"(, )" << brick_edge << R"(, voxel_block);
+        }
+)";
+    };
+
+    auto print_construct_lower = [&](uint32_t level, std::string_view coord_prefix) {
+	if (level + 1 == format.size()) {
+	    uint32_t brick_edge = bottom_level_brick_edge();
+	    if (brick_edge) {
+		ss << R"(fetch_voxel(voxel_block, ()" << coord_prefix << R"(x % )" << brick_edge << R"() + ()" << coord_prefix << R"(y % )" << brick_edge << R"() * )" << brick_edge << R"( + ()" << coord_prefix << R"(z % )" << brick_edge << R"() * )" << brick_edge * brick_edge << R"(, sub_is_empty))";
+	    } else {
+		ss << R"(fetch_voxel(voxel_block, linear_idx, sub_is_empty))";
+	    }
+	    return;
+	}
 	print_format_identifier(level + 1);
 	if (opt.whole_level_dedup_ && level + 1 < format.size() && format.at(level + 1).format_ == Format::SVDAG) {
 	    ss << R"(_construct_node(voxelizer, buffer, sub_lower_x, sub_lower_y, sub_lower_z, sub_is_empty, deduplication_map))";
@@ -38,6 +70,101 @@ std::string generate_construction_cpp(const std::vector<InstantiatedFormat> &for
 	}
     };
 
+    // SVO and SVDAG levels skip over whole subtrees with no voxels in them,
+    // such as the padding between the model and the next power of two. All
+    // the leaves of an empty subtree collapse into one empty node at its root,
+    // so it's pushed straight into that level's queue. A bottom level reading
+    // its voxels a brick at a time only skips whole bricks, so the next one
+    // starts at the start of a brick. Only nodes starting a subtree at least
+    // that tall are checked, so most nodes don't call into the voxelizer.
+    auto print_skip_empty_subtree = [&](uint32_t level, std::string_view empty_node,
+					uint32_t sub_w, uint32_t sub_h, uint32_t sub_d) {
+	uint32_t brick_edge = level + 1 == format.size() ? bottom_level_brick_edge() : 0;
+	uint32_t min_height = brick_edge ? std::countr_zero(brick_edge) : 1;
+	ss << R"(        uint32_t d = power_of_two;
+        )" << empty_node << R"(;
+        if (uint32_t height = morton % )" << (1U << (3 * min_height)) << R"( ? 0 : voxelizer.empty_subtree_height(morton, )" << min_height << R"(, power_of_two, lower_x, lower_y, lower_z, )" << sub_w << R"(, )" << sub_h << R"(, )" << sub_d << R"()) {
+            d -= height;
+            morton += (static_cast<uint64_t>(1) << (3 * height)) - 1;
+        } else {
+)";
+    };
+
+    // Runs print, indenting everything it prints by four more spaces.
+    auto print_indented = [&](auto &&print) {
+	std::stringstream outer;
+	outer.swap(ss);
+	print();
+	std::string body = ss.str();
+	ss.swap(outer);
+	std::stringstream lines(body);
+	std::string line;
+	while (std::getline(lines, line)) {
+	    ss << (line.empty() ? "" : "    ") << line << "\n";
+	}
+    };
+
+    // Only the root level is checkpointed, between iterations of its loop,
+    // when nothing but its own variables is live. These are them.
+    auto checkpoint_state = [&]() {
+	std::string state = "is_empty, ";
+	switch (format[0].format_) {
+	case Format::Raw:
+	    state += "raw_chunk";
+	    break;
+	case Format::DF:
+	    state += "df_chunk";
+	    break;
+	case Format::SVO:
+	case Format::SVDAG:
+	    state += "queues";
+	    break;
+	}
+	if (format[0].format_ == Format::SVDAG ||
+	    (opt.whole_level_dedup_ && format.size() > 1 && format[1].format_ == Format::SVDAG)) {
+	    state += ", deduplication_map";
+	}
+	return state;
+    };
+
+    auto print_checkpoint_parameter = [&](uint32_t level) {
+	if (level == 0) {
+	    ss << R"(, ConstructionCheckpoint &checkpoint)";
+	}
+    };
+
+    // The root level's loop starts wherever a checkpoint left off.
+    auto print_morton_loop = [&](uint32_t level) {
+	if (level == 0) {
+	    ss << R"(    uint64_t first_morton = 0;
+    checkpoint.restore(buffer, first_morton, )" << checkpoint_state() << R"();
+    for (uint64_t morton = first_morton; morton < num_voxels; ++morton) {
+)";
+	} else {
+	    ss << R"(    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
+)";
+	}
+    };
+
+    // A root level that reads voxels a brick at a time is only saved at the
+    // end of a brick, so it resumes at the start of one.
+    auto print_save_checkpoint = [&](uint32_t level) {
+	if (level != 0) {
+	    return;
+	}
+	uint32_t brick_edge = format.size() == 1 ? bottom_level_brick_edge() : 0;
+	if (brick_edge) {
+	    ss << R"(        if ((morton + 1) % )" << brick_edge * brick_edge * brick_edge << R"( == 0 && checkpoint.due()) {
+)";
+	} else {
+	    ss << R"(        if (checkpoint.due()) {
+)";
+	}
+	ss << R"(            checkpoint.save(voxelizer, buffer, morton + 1, )" << checkpoint_state() << R"();
+        }
+)";
+    };
+
     uint32_t df_bits_available = 0;
     if (opt.df_packing_) {
 	auto [total_w, total_h, total_d] = calculate_bounds(format);
@@ -54,6 +181,8 @@ std::string generate_construction_cpp(const std::vector<InstantiatedFormat> &for
 
 #include <external/libmorton/include/libmorton/morton.h>
 
+#include "Checkpoint.h"
+#include "DistanceTransform.h"
 #include "Voxelize.h"
 
 template<class T> 
@@ -72,6 +201,12 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
     return node;
 }
 
+static uint32_t fetch_voxel(const std::vector<uint32_t> &voxel_block, uint64_t index, bool &is_empty) {
+    uint32_t voxel = voxel_block[index];
+    is_empty = voxel == 0;
+    return voxel;
+}
+
 static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffer, const std::vector<uint32_t> &node) {
     uint32_t offset = buffer.second;
     buffer.first.write(reinterpret_cast<const char *>(node.data()), node.size() * sizeof(uint32_t));
@@ -88,27 +223,27 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
 
 )";
 
-    for (uint32_t i = 0; i < format.size() + 1; ++i) {
+    for (uint32_t i = 0; i < format.size(); ++i) {
 	ss << R"(static )";
 	print_level_node_type(i);
 	ss << R"( )";
 	print_format_identifier(i);
 	if (opt.whole_level_dedup_ && i < format.size() && format.at(i).format_ == Format::SVDAG) {
-	    ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map);
-
-)";
+	    ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map)";
 	} else {
-	    ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
+	    ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty)";
+	}
+	print_checkpoint_parameter(i);
+	ss << R"();
 
 )";
-	}
     }
     
     ss << R"(void )";
     
     print_format_identifier();
 
-    ss << R"(_construct(Voxelizer &voxelizer, std::ofstream &buffer) {
+    ss << R"(_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint) {
     bool is_empty;
     uint32_t size = 0;
     buffer.write(reinterpret_cast<const char *>(&size), sizeof(uint32_t));
@@ -118,11 +253,11 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
 	ss << R"(    std::unordered_map<std::vector<uint32_t>, uint32_t> deduplication_map;
     auto root_node = )";
 	print_format_identifier();
-	ss << R"(_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty, deduplication_map);)";
+	ss << R"(_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty, deduplication_map, checkpoint);)";
     } else {
 	ss << R"(    auto root_node = )";
 	print_format_identifier();
-	ss << R"(_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty);)";
+	ss << R"(_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty, checkpoint);)";
     }
 
     ss << R"(
@@ -140,12 +275,13 @@ static )";
     ss << R"( )";
     print_format_identifier(i);
     if (opt.whole_level_dedup_ && format.at(i).format_ == Format::SVDAG) {
-	ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map) {
-)";
+	ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map)";
     } else {
-	ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
-)";
+	ss << R"(_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty)";
     }
+    print_checkpoint_parameter(i);
+    ss << R"() {
+)";
     auto [sub_w, sub_h, sub_d] = calculate_bounds(format, i + 1);
     auto [inc_w, inc_h, inc_d] = calculate_bounds(format, i);
     auto this_w = inc_w / sub_w, this_h = inc_h / sub_h, this_d = inc_d / sub_d;
@@ -155,28 +291,58 @@ static )";
 
 )";
     }
+
+    // Parents ignore the nodes of empty children, so a child that's empty can
+    // return right away. The root's node is always used, so it can't.
+    if (i > 0) {
+	ss << R"(    if (voxelizer.is_empty(lower_x, lower_y, lower_z, )" << inc_w << R"(, )" << inc_h << R"(, )" << inc_d << R"()) {
+        is_empty = true;
+        return {};
+    }
+
+)";
+    }
+
+    if (i + 1 == format.size()) {
+	uint32_t brick_edge = bottom_level_brick_edge();
+	if (brick_edge) {
+	    ss << R"(    std::vector<uint32_t> voxel_block()" << brick_edge * brick_edge * brick_edge << R"();
+
+)";
+	} else {
+	    ss << R"(    std::vector<uint32_t> voxel_block()" << ((uint64_t) inc_w * (uint64_t) inc_h * (uint64_t) inc_d) << R"();
+    voxelizer.at_block(lower_x, lower_y, lower_z, )" << inc_w << R"(, )" << inc_h << R"(, )" << inc_d << R"(, voxel_block);
+
+)";
+	}
+    }
     
     switch (format[i].format_) {
     case Format::Raw:
         ss << R"(    is_empty = true;
     uint64_t num_voxels = )" << ((uint64_t) this_w * (uint64_t) this_h * (uint64_t) this_d) << R"(;
     std::vector<uint32_t> raw_chunk(num_voxels);
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
+)";
+        print_morton_loop(i);
+        ss << R"(        uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
         libmorton::morton3D_64_decode(morton, g_x, g_y, g_z);
-        uint64_t linear_idx = g_x + g_y * )" << this_w << R"( + g_z * )" << this_w << R"( * )" << this_h << R"(;
+)";
+        print_fetch_voxel_block(i, "g_");
+        ss << R"(        uint64_t linear_idx = g_x + g_y * )" << this_w << R"( + g_z * )" << this_w << R"( * )" << this_h << R"(;
         uint32_t sub_lower_x = lower_x + g_x * )" << sub_w << R"(;
         uint32_t sub_lower_y = lower_y + g_y * )" << sub_h << R"(;
         uint32_t sub_lower_z = lower_z + g_z * )" << sub_d << R"(;
         bool sub_is_empty;
         auto sub_chunk = )";
-        print_construct_lower(i);
+        print_construct_lower(i, "g_");
         ss << R"(;
         if (!sub_is_empty) {
             raw_chunk.at(linear_idx) = push_node_to_buffer(buffer, sub_chunk);
         }
         is_empty = is_empty && sub_is_empty;
-    }
+)";
+        print_save_checkpoint(i);
+        ss << R"(    }
     return raw_chunk;
 )";
         break;
@@ -185,16 +351,19 @@ static )";
         ss << R"(    is_empty = true;
     uint64_t num_voxels = )" << ((uint64_t) this_w * (uint64_t) this_h * (uint64_t) this_d) << R"(;
     std::vector<uint32_t> df_chunk(num_voxels * )" << (do_df_compression ? 1 : 2) << R"();
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
+)";
+        print_morton_loop(i);
+        ss << R"(        uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
         libmorton::morton3D_64_decode(morton, g_x, g_y, g_z);
-        uint64_t linear_idx = g_x + g_y * )" << this_w << R"( + g_z * )" << this_w << R"( * )" << this_h << R"(;
+)";
+        print_fetch_voxel_block(i, "g_");
+        ss << R"(        uint64_t linear_idx = g_x + g_y * )" << this_w << R"( + g_z * )" << this_w << R"( * )" << this_h << R"(;
         uint32_t sub_lower_x = lower_x + g_x * )" << sub_w << R"(;
         uint32_t sub_lower_y = lower_y + g_y * )" << sub_h << R"(;
         uint32_t sub_lower_z = lower_z + g_z * )" << sub_d << R"(;
         bool sub_is_empty;
         auto sub_chunk = )";
-        print_construct_lower(i);
+        print_construct_lower(i, "g_");
 	ss << R"(;
         if (!sub_is_empty) {
             df_chunk.at(linear_idx * )" << (do_df_compression ? 1 : 2) << R"() = push_node_to_buffer(buffer, sub_chunk);
@@ -205,47 +374,31 @@ static )";
 )";
 	}
 	ss << R"(        is_empty = is_empty && sub_is_empty;
-    }
-    uint32_t k = )" << format[i].parameters_[3] << R"(;
-    for (uint32_t g_z = 0; g_z < )" << this_d << R"(; ++g_z) {
-        for (uint32_t g_y = 0; g_y < )" << this_h << R"(; ++g_y) {
-            for (uint32_t g_x = 0; g_x < )" << this_w << R"(; ++g_x) {
-                uint32_t g_voxel_offset = (g_x + g_y * )" << this_w << R"( + g_z * )" << this_w << R"( * )" << this_h << R"();
-                uint32_t min_dist = k;
-                for (uint32_t kz = g_z > k ? g_z - k : 0; kz <= g_z + k && kz < )" << this_d << R"(; ++kz) {
-                    for (uint32_t ky = g_y > k ? g_y - k : 0; ky <= g_y + k && ky < )" << this_h << R"(; ++ky) {
-                        for (uint32_t kx = g_x > k ? g_x - k : 0; kx <= g_x + k && kx < )" << this_w << R"(; ++kx) {
-                            size_t k_voxel_offset = kx + ky * )" << this_w << R"( + kz * )" << this_w << R"( * )" << this_h << R"(;
+)";
+	print_save_checkpoint(i);
+	ss << R"(    }
+    std::vector<bool> occupied(num_voxels);
+    for (uint64_t index = 0; index < num_voxels; ++index) {
 )";
 	if (do_df_compression) {
-	    ss << R"(                            if (df_chunk[k_voxel_offset] & )" << (static_cast<uint32_t>(0xFFFFFFFF) >> df_bits_available) << R"() {
+	    ss << R"(        occupied[index] = (df_chunk[index] & )" << (static_cast<uint32_t>(0xFFFFFFFF) >> df_bits_available) << R"() != 0;
 )";
 	} else {
-	    ss << R"(                            if (df_chunk[k_voxel_offset * 2] != 0) {
+	    ss << R"(        occupied[index] = df_chunk[index * 2] != 0;
 )";
 	}
-	ss << R"(                                uint32_t dist =
-                                (g_z > kz ? g_z - kz : kz - g_z) +
-                                (g_y > ky ? g_y - ky : ky - g_y) +
-                                (g_x > kx ? g_x - kx : kx - g_x);
-                                if (dist < min_dist && dist) {
-                                    min_dist = dist;
-                                }
-                            }
-                        }
-                    }
-                }
+	ss << R"(    }
+    std::vector<uint32_t> distances = distance_transform(occupied, )" << this_w << R"(, )" << this_h << R"(, )" << this_d << R"(, )" << format[i].parameters_[3] << R"(, DistanceMetric::Manhattan, true);
+    for (uint64_t index = 0; index < num_voxels; ++index) {
 )";
 	if (do_df_compression) {
-	    ss << R"(                df_chunk[g_voxel_offset] |= (min_dist - 1) << (32 - )" << df_bits_available << R"();
+	    ss << R"(        df_chunk[index] |= (distances[index] - 1) << (32 - )" << df_bits_available << R"();
 )";
 	} else {
-	ss << R"(                df_chunk[g_voxel_offset * 2 + 1] = (min_dist - 1);
+	    ss << R"(        df_chunk[index * 2 + 1] = distances[index] - 1;
 )";
 	}
-	ss << R"(            }
-        }
-    }
+	ss << R"(    }
     return df_chunk;
 )";
         break;
@@ -270,24 +423,30 @@ static )";
 
     is_empty = true;
 
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t x = 0, y = 0, z = 0;
+)";
+	print_morton_loop(i);
+	ss << R"(        uint_fast32_t x = 0, y = 0, z = 0;
         libmorton::morton3D_64_decode(morton, x, y, z);
-
-        std::array<uint32_t, 2> node = {0, 0};
-        uint32_t sub_lower_x = x * )" << sub_w << R"( + lower_x, sub_lower_y = y * )" << sub_h << R"( + lower_y, sub_lower_z = z * )" << sub_d << R"( + lower_z;
+)";
+	print_skip_empty_subtree(i, "std::array<uint32_t, 2> node = {0, 0}", sub_w, sub_h, sub_d);
+	print_indented([&] {
+	    print_fetch_voxel_block(i, "");
+	    ss << R"(        uint32_t sub_lower_x = x * )" << sub_w << R"( + lower_x, sub_lower_y = y * )" << sub_h << R"( + lower_y, sub_lower_z = z * )" << sub_d << R"( + lower_z;
         bool sub_is_empty;
         auto sub_chunk = )";
-        print_construct_lower(i);
-        ss << R"(;
+	    print_construct_lower(i, "");
+	    ss << R"(;
         if (!sub_is_empty) {
             node[0] = push_node_to_buffer(buffer, sub_chunk);
             is_empty = false;
         }
+)";
+	});
+	ss << R"(        }
 
-        queues.at(power_of_two).emplace_back(node);
-        uint32_t d = power_of_two;
-        while (d > 0 && queues.at(d).size() == 8) {
+        queues.at(d).emplace_back(node);
+)";
+	ss << R"(        while (d > 0 && queues.at(d).size() == 8) {
             std::array<uint32_t, 2> node = {0, 0};
 
             bool identical = true;
@@ -317,7 +476,9 @@ static )";
             queues.at(d).clear();
             --d;
         }
-    }
+)";
+	print_save_checkpoint(i);
+	ss << R"(    }
 
     return queues.at(0).at(0);
 )";
@@ -349,24 +510,30 @@ static )";
 	ss << R"(
     is_empty = true;
 
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t x = 0, y = 0, z = 0;
+)";
+	print_morton_loop(i);
+	ss << R"(        uint_fast32_t x = 0, y = 0, z = 0;
         libmorton::morton3D_64_decode(morton, x, y, z);
-
-        std::vector<uint32_t> node = {0};
-        uint32_t sub_lower_x = x * )" << sub_w << R"( + lower_x, sub_lower_y = y * )" << sub_h << R"( + lower_y, sub_lower_z = z * )" << sub_d << R"( + lower_z;
+)";
+	print_skip_empty_subtree(i, "std::vector<uint32_t> node = {0}", sub_w, sub_h, sub_d);
+	print_indented([&] {
+	    print_fetch_voxel_block(i, "");
+	    ss << R"(        uint32_t sub_lower_x = x * )" << sub_w << R"( + lower_x, sub_lower_y = y * )" << sub_h << R"( + lower_y, sub_lower_z = z * )" << sub_d << R"( + lower_z;
         bool sub_is_empty;
         auto sub_chunk = )";
-        print_construct_lower(i);
-        ss << R"(;
+	    print_construct_lower(i, "");
+	    ss << R"(;
         if (!sub_is_empty) {
             node[0] = push_node_to_buffer(buffer, sub_chunk);
             is_empty = false;
         }
+)";
+	});
+	ss << R"(        }
 
-        queues.at(power_of_two).emplace_back(node);
-        uint32_t d = power_of_two;
-        while (d > 0 && queues.at(d).size() == 8) {
+        queues.at(d).emplace_back(node);
+)";
+	ss << R"(        while (d > 0 && queues.at(d).size() == 8) {
             std::vector<uint32_t> node = {0};
 
             bool identical = true;
@@ -400,7 +567,9 @@ static )";
             queues.at(d).clear();
             --d;
         }
-    }
+)";
+	print_save_checkpoint(i);
+	ss << R"(    }
 
     return queues.at(0).at(0);
 )";
@@ -413,13 +582,5 @@ static )";
 )";
     }
 
-    ss << R"(
-static uint32_t _construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
-    uint32_t voxel = voxelizer.at(lower_x, lower_y, lower_z);
-    is_empty = voxel == 0;
-    return voxel;
-}
-)";
-    
     return ss.str();
 }
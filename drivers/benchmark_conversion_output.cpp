@@ -0,0 +1,57 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <utils/Assert.h>
+#include <voxels/Conversion.h>
+#include <voxels/VoxelChunkGeneration.h>
+
+// A field of /proc/self/status, in KiB.
+static uint64_t read_status_kib(std::string_view field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with(field)) {
+            std::istringstream value(line.substr(field.size()));
+            uint64_t kib = 0;
+            value >> kib;
+            return kib;
+        }
+    }
+    ASSERT(false, "Failed to read the resident set size.");
+    return 0;
+}
+
+// Converts with convert, and reports how long it took and how far the
+// resident set grew past what it was before, which is what building the
+// output cost. Writing 5 to clear_refs resets the peak resident set size to
+// the current one.
+template <typename F> static void benchmark(std::string_view name, F &&convert) {
+    std::ofstream("/proc/self/clear_refs") << "5";
+    const uint64_t rss_before = read_status_kib("VmRSS:");
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<std::byte> output = convert();
+    const auto end = std::chrono::steady_clock::now();
+    const uint64_t peak_rss = read_status_kib("VmHWM:");
+    std::cout << name << ": " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms, " << output.size() << " bytes, peak resident set "
+              << static_cast<double>(peak_rss - rss_before) / 1024.0
+              << " MiB above where it started.\n";
+}
+
+// Converts a procedurally generated chunk (512^3 by default) into SVO and
+// SVDAG chunks, to measure what building their outputs costs.
+int main(int argc, char *argv[]) {
+    uint32_t size = argc > 1 ? std::stoul(std::string(argv[1])) : 512;
+    MortonBrickStream bricks;
+    {
+        auto raw = generate_basic_procedural_chunk(size, size, size);
+        bricks = make_brick_stream(raw, size, size, size, 4);
+    }
+    std::cout << "Procedural " << size << "^3: " << bricks.size() << " bricks.\n";
+
+    benchmark("SVO", [&] { return convert_raw_to_svo(bricks); });
+    benchmark("SVDAG", [&] { return convert_raw_to_svdag(bricks); });
+}
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <utils/Assert.h>
+#include <voxels/ObjParser.h>
+
+// Parses an OBJ with tinyobjloader and with ObjParser (on one thread and on
+// every core), checks that they produce the same triangles, and times each.
+int main(int argc, char *argv[]) {
+    ASSERT(argc > 1, "Must provide a .obj model to parse.");
+    std::string model_path(argv[1]);
+    uint32_t num_threads = argc > 2 ? std::stoul(std::string(argv[2]))
+                                    : std::max(std::thread::hardware_concurrency(), 1U);
+
+    // Triangles as their corners' positions and texture coordinates (zero if
+    // they have none) plus their material, which is everything Model reads.
+    struct FlatTriangle {
+        float values[15];
+        int material_id;
+
+        bool operator==(const FlatTriangle &other) const = default;
+    };
+    auto flatten = [](const tinyobj::attrib_t &attrib,
+                      const std::vector<tinyobj::shape_t> &shapes) {
+        std::vector<FlatTriangle> triangles;
+        for (const auto &shape : shapes) {
+            for (uint64_t i = 0; i < shape.mesh.indices.size(); i += 3) {
+                FlatTriangle triangle = {};
+                for (uint32_t corner = 0; corner < 3; ++corner) {
+                    const tinyobj::index_t &index = shape.mesh.indices[i + corner];
+                    for (uint32_t axis = 0; axis < 3; ++axis) {
+                        triangle.values[corner * 3 + axis] =
+                            attrib.vertices.at(3 * index.vertex_index + axis);
+                    }
+                    if (index.texcoord_index >= 0) {
+                        triangle.values[9 + corner * 2] = attrib.texcoords.at(2 * index.texcoord_index);
+                        triangle.values[10 + corner * 2] = attrib.texcoords.at(2 * index.texcoord_index + 1);
+                    }
+                }
+                triangle.material_id = shape.mesh.material_ids[i / 3];
+                triangles.push_back(triangle);
+            }
+        }
+        return triangles;
+    };
+
+    auto time = [&](std::string_view name, auto &&run) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << name << ": " << seconds * 1000.0 << " ms\n";
+    };
+
+    tinyobj::ObjReader reader;
+    time("tinyobj::ObjReader", [&] {
+        ASSERT(reader.ParseFromFile(model_path), reader.Error());
+    });
+    ObjParser serial_parser;
+    time("ObjParser (1 thread)", [&] {
+        ASSERT(serial_parser.parse(model_path, 1), serial_parser.get_error());
+    });
+    ObjParser parallel_parser;
+    time("ObjParser (" + std::to_string(num_threads) + " threads)", [&] {
+        ASSERT(parallel_parser.parse(model_path, num_threads), parallel_parser.get_error());
+    });
+
+    auto expected = flatten(reader.GetAttrib(), reader.GetShapes());
+    auto serial = flatten(serial_parser.get_attrib(), serial_parser.get_shapes());
+    auto parallel = flatten(parallel_parser.get_attrib(), parallel_parser.get_shapes());
+    ASSERT(serial == parallel, "ObjParser depends on the number of threads.");
+    ASSERT(reader.GetAttrib().vertices == parallel_parser.get_attrib().vertices,
+           "ObjParser and tinyobjloader read different vertices.");
+    uint64_t num_mismatches = 0;
+    for (uint64_t i = 0; i < std::min(expected.size(), parallel.size()); ++i) {
+        num_mismatches += !(expected[i] == parallel[i]);
+    }
+    std::cout << "INFO: tinyobjloader produced " << expected.size()
+              << " triangles and ObjParser " << parallel.size() << ", "
+              << num_mismatches << " of which differ.\n";
+    ASSERT(expected.size() == parallel.size() && !num_mismatches,
+           "ObjParser and tinyobjloader produced different triangles.");
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#include <utils/Assert.h>
+#include <voxels/Conversion.h>
+#include <voxels/SVDAGNodeTable.h>
+#include <voxels/VoxelChunkGeneration.h>
+#include <voxels/Voxelize.h>
+
+// Every allocation goes through these, so the bytes each table allocates can
+// be tracked, including while it's rehashing. Allocations are prefixed with
+// their size, padded out to their alignment.
+static uint64_t allocated_bytes = 0, peak_allocated_bytes = 0;
+
+static void *allocate(std::size_t size, std::size_t alignment) {
+    const std::size_t prefix = std::max(alignment, 2 * sizeof(std::size_t));
+    std::byte *block = static_cast<std::byte *>(std::malloc(size + 2 * prefix));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    std::byte *ptr = block + prefix;
+    ptr += (alignment - reinterpret_cast<uintptr_t>(ptr) % alignment) % alignment;
+    std::size_t header[2] = {size, static_cast<std::size_t>(ptr - block)};
+    memcpy(ptr - sizeof(header), header, sizeof(header));
+    allocated_bytes += size;
+    peak_allocated_bytes = std::max(peak_allocated_bytes, allocated_bytes);
+    return ptr;
+}
+
+static void deallocate(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    std::size_t header[2];
+    memcpy(header, static_cast<std::byte *>(ptr) - sizeof(header), sizeof(header));
+    allocated_bytes -= header[0];
+    std::free(static_cast<std::byte *>(ptr) - header[1]);
+}
+
+void *operator new(std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void *ptr) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { deallocate(ptr); }
+
+// The hash convert_raw_to_svdag deduplicated nodes with before SVDAGNodeTable.
+struct LegacyHashSVDAGNode {
+    size_t operator()(const SVDAGNode &node) const {
+        return node.child_offsets_[0] ^ (node.child_offsets_[1] << 4) ^
+               (node.child_offsets_[2] << 8) ^ (node.child_offsets_[3] << 12) ^
+               (node.child_offsets_[4] << 16) ^ (node.child_offsets_[5] << 20) ^
+               (node.child_offsets_[6] << 24) ^ (node.child_offsets_[7] << 28);
+    }
+};
+
+// The nodes an SVDAG's builder looked up while building it, in the same
+// order: the children of every node of the tree it was built from, each
+// node's looked up once all of their own children were, the same way the
+// builder merges them bottom up. Subtrees whose eight children were identical
+// were folded into one child by the builder, and are only replayed once.
+static std::vector<SVDAGNode> replay_svdag(const std::vector<std::byte> &svdag) {
+    uint32_t header[4];
+    memcpy(header, svdag.data(), sizeof(header));
+    auto node_at = [&](uint32_t offset) {
+        SVDAGNode node;
+        memcpy(&node, svdag.data() + sizeof(header) + offset * sizeof(SVDAGNode),
+               sizeof(SVDAGNode));
+        return node;
+    };
+
+    std::vector<SVDAGNode> lookups;
+    auto visit = [&](auto &visit_child, const SVDAGNode &node) -> void {
+        for (uint32_t child_offset : node.child_offsets_) {
+            if (child_offset != 0xFFFFFFFF && !(child_offset >> 31)) {
+                visit_child(visit_child, node_at(child_offset));
+            }
+        }
+        for (uint32_t child_offset : node.child_offsets_) {
+            if (child_offset != 0xFFFFFFFF) {
+                lookups.push_back(node_at(child_offset & 0x7FFFFFFF));
+            }
+        }
+    };
+    if (header[3] > 1) {
+        visit(visit, node_at(header[3] - 1));
+    }
+    return lookups;
+}
+
+// Deduplicates lookups with both tables, the way convert_raw_to_svdag does,
+// checks that they agree, and reports how fast each inserted and how much
+// memory it took at most.
+static void benchmark(const std::string &name, const std::vector<SVDAGNode> &lookups) {
+    std::vector<uint32_t> legacy_offsets(lookups.size()), offsets(lookups.size());
+    auto run = [&](std::string_view table_name, auto &table, std::vector<uint32_t> &results) {
+        const uint64_t allocated_before = allocated_bytes;
+        peak_allocated_bytes = allocated_bytes;
+        const auto start = std::chrono::steady_clock::now();
+        uint32_t num_nodes = 0;
+        for (uint64_t i = 0; i < lookups.size(); ++i) {
+            auto [it, inserted] = table.try_emplace(lookups[i], num_nodes);
+            num_nodes += inserted;
+            if constexpr (requires { it->second; }) {
+                results[i] = it->second;
+            } else {
+                results[i] = it;
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "  " << table_name << ": "
+                  << static_cast<double>(lookups.size()) / seconds / 1e6
+                  << " million inserts/s, " << seconds * 1000.0 << " ms, peak "
+                  << static_cast<double>(peak_allocated_bytes - allocated_before) / (1 << 20)
+                  << " MiB for " << num_nodes << " nodes.\n";
+    };
+
+    std::cout << name << ": " << lookups.size() << " lookups.\n";
+    {
+        std::unordered_map<SVDAGNode, uint32_t, LegacyHashSVDAGNode> legacy_table;
+        run("std::unordered_map", legacy_table, legacy_offsets);
+        uint64_t longest_bucket = 0;
+        for (uint64_t b = 0; b < legacy_table.bucket_count(); ++b) {
+            longest_bucket = std::max(longest_bucket,
+                                      static_cast<uint64_t>(legacy_table.bucket_size(b)));
+        }
+        std::cout << "    its longest bucket holds " << longest_bucket << " nodes.\n";
+    }
+    {
+        SVDAGNodeTable table;
+        run("SVDAGNodeTable", table, offsets);
+    }
+    ASSERT(legacy_offsets == offsets, "SVDAGNodeTable deduplicated nodes differently.");
+}
+
+// Deduplicates the nodes of the SVDAG of a procedurally generated chunk, and
+// of a voxelized model if one's given, with std::unordered_map (as SVDAGs were
+// built before) and with SVDAGNodeTable.
+int main(int argc, char *argv[]) {
+    uint32_t size = argc > 1 ? std::stoul(std::string(argv[1])) : 256;
+    auto procedural = generate_basic_procedural_chunk(size, size, size);
+    benchmark("Procedural " + std::to_string(size) + "^3",
+              replay_svdag(convert_raw_to_svdag(procedural, size, size, size, 4)));
+
+    if (argc > 3) {
+        std::string model_path(argv[2]);
+        float res = std::stof(std::string(argv[3]));
+        benchmark(model_path + " at " + argv[3],
+                  replay_svdag(convert_raw_to_svdag(brick_voxelize_obj(model_path, res))));
+    }
+}
@@ -0,0 +1,129 @@
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include <utils/Assert.h>
+#include <voxels/Voxelize.h>
+
+// Compares Triangle::tri_aabb against TriangleBoxTest on random triangles.
+// Every box around every triangle is tested by both TriangleBoxTest paths,
+// which must agree exactly, then each path is timed on the same boxes.
+int main(int argc, char *argv[]) {
+    uint32_t num_triangles = argv[1] ? std::stoul(std::string(argv[1])) : 10000;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(-64.0f, 64.0f);
+    std::uniform_real_distribution<float> log_size(-3.0f, 4.5f);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+    std::vector<Triangle> triangles;
+    while (triangles.size() < num_triangles) {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        float size = std::exp2(log_size(rng));
+        glm::vec3 a = center + glm::vec3(offset(rng), offset(rng), offset(rng)) * size;
+        glm::vec3 b = center + glm::vec3(offset(rng), offset(rng), offset(rng)) * size;
+        glm::vec3 c = center + glm::vec3(offset(rng), offset(rng), offset(rng)) * size;
+        if (glm::length(glm::cross(b - a, c - a)) > 0.0f) {
+            triangles.push_back(Triangle{a, b, c});
+        }
+    }
+
+    // Box centers sit on a grid that doesn't line up with the triangles, the
+    // same way the voxelizer's grid starts at the model's bottom corner.
+    const float voxel_size = 0.7f, origin = 0.3f;
+    const glm::vec3 extents(voxel_size);
+    auto for_each_row = [&](const Triangle &tri, auto &&test_row) {
+        int32_t min_x = static_cast<int32_t>(floor((tri.min_x() - origin) / voxel_size)) - 1;
+        int32_t min_y = static_cast<int32_t>(floor((tri.min_y() - origin) / voxel_size)) - 1;
+        int32_t min_z = static_cast<int32_t>(floor((tri.min_z() - origin) / voxel_size)) - 1;
+        int32_t max_x = static_cast<int32_t>(ceil((tri.max_x() - origin) / voxel_size)) + 1;
+        int32_t max_y = static_cast<int32_t>(ceil((tri.max_y() - origin) / voxel_size)) + 1;
+        int32_t max_z = static_cast<int32_t>(ceil((tri.max_z() - origin) / voxel_size)) + 1;
+        for (int32_t x = min_x; x <= max_x; ++x) {
+            for (int32_t y = min_y; y <= max_y; ++y) {
+                for (int32_t row_z = min_z; row_z <= max_z;
+                     row_z += TriangleBoxTest::MAX_ROW_LENGTH) {
+                    uint32_t row_length = std::min(
+                        static_cast<uint32_t>(max_z - row_z + 1),
+                        TriangleBoxTest::MAX_ROW_LENGTH);
+                    float row_z_centers[TriangleBoxTest::MAX_ROW_LENGTH];
+                    for (uint32_t i = 0; i < row_length; ++i) {
+                        row_z_centers[i] =
+                            static_cast<float>(row_z + static_cast<int32_t>(i)) *
+                                voxel_size +
+                            origin;
+                    }
+                    test_row(static_cast<float>(x) * voxel_size + origin,
+                             static_cast<float>(y) * voxel_size + origin,
+                             row_z_centers, row_length);
+                }
+            }
+        }
+    };
+
+    uint64_t num_boxes = 0, num_overlapping = 0, num_legacy_mismatches = 0;
+    for (const auto &tri : triangles) {
+        TriangleBoxTest box_test(tri, extents);
+        for_each_row(tri, [&](float x, float y, const float *z, uint32_t count) {
+            uint32_t row_mask = box_test.overlaps_row(x, y, z, count);
+            for (uint32_t i = 0; i < count; ++i) {
+                glm::vec3 center(x, y, z[i]);
+                bool scalar = box_test.overlaps(center);
+                ASSERT(scalar == static_cast<bool>((row_mask >> i) & 1),
+                       "SIMD and scalar triangle/box tests disagree.");
+                num_legacy_mismatches += scalar != tri.tri_aabb(center, extents);
+                num_overlapping += scalar;
+                ++num_boxes;
+            }
+        });
+    }
+    std::cout << "INFO: Tested " << num_boxes << " boxes against "
+              << triangles.size() << " triangles, " << num_overlapping
+              << " overlap. The SIMD and scalar paths agree on every box.\n";
+    std::cout << "INFO: " << num_legacy_mismatches
+              << " boxes differ from Triangle::tri_aabb, which normalizes its "
+                 "edges per box and so rounds differently.\n";
+
+    auto time = [&](std::string_view name, auto &&run) {
+        uint64_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &tri : triangles) {
+            count += run(tri);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << name << ": " << seconds * 1000.0 << " ms, "
+                  << static_cast<double>(num_boxes) / seconds / 1e6
+                  << " M boxes/s (" << count << " overlaps)\n";
+    };
+
+    time("Triangle::tri_aabb", [&](const Triangle &tri) {
+        uint64_t count = 0;
+        for_each_row(tri, [&](float x, float y, const float *z, uint32_t n) {
+            for (uint32_t i = 0; i < n; ++i) {
+                count += tri.tri_aabb(glm::vec3(x, y, z[i]), extents);
+            }
+        });
+        return count;
+    });
+    time("TriangleBoxTest::overlaps", [&](const Triangle &tri) {
+        uint64_t count = 0;
+        TriangleBoxTest box_test(tri, extents);
+        for_each_row(tri, [&](float x, float y, const float *z, uint32_t n) {
+            for (uint32_t i = 0; i < n; ++i) {
+                count += box_test.overlaps(glm::vec3(x, y, z[i]));
+            }
+        });
+        return count;
+    });
+    time("TriangleBoxTest::overlaps_row", [&](const Triangle &tri) {
+        uint64_t count = 0;
+        TriangleBoxTest box_test(tri, extents);
+        for_each_row(tri, [&](float x, float y, const float *z, uint32_t n) {
+            count += std::popcount(box_test.overlaps_row(x, y, z, n));
+        });
+        return count;
+    });
+}
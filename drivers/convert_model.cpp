@@ -1,56 +1,61 @@
 #include <cstring>
 #include <fstream>
+#include <thread>
 
 #include <compiler/Compiler.h>
 #include <graphics/GraphicsContext.h>
 #include <utils/Assert.h>
+#include <voxels/Analysis.h>
+#include <voxels/Checkpoint.h>
 #include <voxels/Conversion.h>
+#include <voxels/LODFile.h>
+#include <voxels/MeshCache.h>
 #include <voxels/Voxel.h>
 #include <voxels/VoxelChunkGeneration.h>
 #include <voxels/Voxelize.h>
 
-void df_16_16_16_6_df_8_8_8_6_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_16_16_16_6_raw_8_8_8_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_raw_8_8_8_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_svo_3_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_raw_16_16_16_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_16_16_16_6_svo_7_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_16_16_16_6_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_64_64_64_6_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_64_64_64_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_svo_7_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_64_64_64_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_64_64_64_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_8_8_8_svdag_8_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_256_256_256_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_7_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_5_svdag_6_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_3_svdag_8_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_11_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svdag_11_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_8_8_8_6_df_8_8_8_6_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_8_8_8_6_raw_8_8_8_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_8_8_8_raw_8_8_8_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_8_8_8_raw_8_8_8_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_raw_2_2_2_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_16_16_16_6_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_16_16_16_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_16_16_16_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_4_4_4_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_128_128_128_svdag_2_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_5_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svdag_5_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_32_32_32_6_df_16_16_16_6_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_32_32_32_6_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_32_32_32_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void raw_512_512_512_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void df_512_512_512_6_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svo_9_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-void svdag_9_construct(Voxelizer &voxelizer, std::ofstream &buffer);
-
-static const std::unordered_map<std::string, void (*)(Voxelizer &, std::ofstream &)> format_to_conversion_function = {
+void df_16_16_16_6_df_8_8_8_6_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_16_16_16_6_raw_8_8_8_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_raw_8_8_8_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_svo_3_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_raw_16_16_16_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_16_16_16_6_svo_7_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_16_16_16_6_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_64_64_64_6_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_64_64_64_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_svo_7_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_64_64_64_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_64_64_64_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_8_8_8_svdag_8_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_256_256_256_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_7_svdag_4_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_5_svdag_6_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_3_svdag_8_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_11_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svdag_11_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_8_8_8_6_df_8_8_8_6_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_8_8_8_6_raw_8_8_8_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_8_8_8_raw_8_8_8_svdag_3_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_8_8_8_raw_8_8_8_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_raw_2_2_2_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_16_16_16_6_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_16_16_16_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_svo_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_16_16_16_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_4_4_4_svdag_7_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_128_128_128_svdag_2_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_5_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svdag_5_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_32_32_32_6_df_16_16_16_6_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_32_32_32_6_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_32_32_32_raw_16_16_16_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void raw_512_512_512_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void df_512_512_512_6_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svo_9_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+void svdag_9_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint);
+
+static const std::unordered_map<std::string, void (*)(Voxelizer &, std::ofstream &, ConstructionCheckpoint &)> format_to_conversion_function = {
     {"DF(16, 16, 16, 6) DF(8, 8, 8, 6) SVDAG(4)", df_16_16_16_6_df_8_8_8_6_svdag_4_construct},
     {"DF(16, 16, 16, 6) Raw(8, 8, 8) SVDAG(4)", df_16_16_16_6_raw_8_8_8_svdag_4_construct},
     {"Raw(16, 16, 16) Raw(8, 8, 8) SVDAG(4)", raw_16_16_16_raw_8_8_8_svdag_4_construct},
@@ -156,7 +161,7 @@ int main(int argc, char *argv[]) {
     ASSERT(model_path.ends_with(".obj"),
            "Must provide a .obj model to convert.");
     ASSERT(argv[2], "Must provide a resolution to voxelize at.");
-    ASSERT(argv[3], "Must provide a format to output.");
+    ASSERT(argv[3], "Must provide a format to output, or --analyze.");
 
     auto write = [&](const char *ptr, std::size_t num_bytes, std::string format) {
         std::cout << "Model size: " << num_bytes << "\n";
@@ -166,42 +171,307 @@ int main(int argc, char *argv[]) {
         stream.write(ptr, num_bytes);
     };
 
+    auto write_levels = [&](const std::vector<LODFile::Level> &levels,
+                            std::string format, VoxelChunk::Format chunk_format,
+                            VoxelChunk::AttributeSet attribute_set) {
+        for (uint32_t level = 0; level < levels.size(); ++level) {
+            std::cout << "Level " << level << " (" << levels[level].width << "x"
+                      << levels[level].height << "x" << levels[level].depth
+                      << ") size: " << levels[level].data.size() << "\n";
+        }
+
+        model_path = model_path.substr(0, model_path.size() - 4) + "." + format + ".lod";
+        LODFile::write(model_path, chunk_format, attribute_set, levels);
+    };
+
     float res = std::stof(std::string(argv[2]));
 
+    uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+    uint64_t max_memory_usage = Voxelizer::DEFAULT_MAX_MEMORY_USAGE;
+    VoxelLayout layout = VoxelLayout::Tiled;
+    VoxelChunk::AttributeSet attribute_set = VoxelChunk::AttributeSet::Color;
+    VoxelResolve resolve = VoxelResolve::LastTriangle;
+    DistanceMetric metric = DistanceMetric::Manhattan;
+    uint32_t num_levels = 1;
+    double checkpoint_interval = 0.0;
+    bool incremental = false;
+    bool level_parallel_svdag = false;
+    for (int i = 4; i < argc; ++i) {
+        if (!strcmp(argv[i], "-threads") || !strcmp(argv[i], "--threads")) {
+            ASSERT(i + 1 < argc, "Must provide a number of threads.");
+            num_threads = std::stoul(std::string(argv[++i]));
+            ASSERT(num_threads > 0, "Must voxelize using at least one thread.");
+        } else if (!strcmp(argv[i], "-memory") || !strcmp(argv[i], "--memory")) {
+            ASSERT(i + 1 < argc, "Must provide a memory budget in MiB.");
+            max_memory_usage = std::stoull(std::string(argv[++i])) << 20;
+        } else if (!strcmp(argv[i], "-layout") || !strcmp(argv[i], "--layout")) {
+            ASSERT(i + 1 < argc, "Must provide a voxel layout.");
+            ++i;
+            if (!strcmp(argv[i], "tiled")) {
+                layout = VoxelLayout::Tiled;
+            } else if (!strcmp(argv[i], "morton")) {
+                layout = VoxelLayout::Morton;
+            } else {
+                ASSERT(false, "Voxel layout must be tiled or morton.");
+            }
+        } else if (!strcmp(argv[i], "-attributes") || !strcmp(argv[i], "--attributes")) {
+            ASSERT(i + 1 < argc, "Must provide voxel attributes.");
+            ++i;
+            if (!strcmp(argv[i], "color")) {
+                attribute_set = VoxelChunk::AttributeSet::Color;
+            } else if (!strcmp(argv[i], "color_normal")) {
+                attribute_set = VoxelChunk::AttributeSet::ColorNormal;
+            } else {
+                ASSERT(false, "Voxel attributes must be color or color_normal.");
+            }
+        } else if (!strcmp(argv[i], "-resolve") || !strcmp(argv[i], "--resolve")) {
+            ASSERT(i + 1 < argc, "Must provide a way to resolve overlapping triangles.");
+            ++i;
+            if (!strcmp(argv[i], "last")) {
+                resolve = VoxelResolve::LastTriangle;
+            } else if (!strcmp(argv[i], "nearest")) {
+                resolve = VoxelResolve::NearestTriangle;
+            } else {
+                ASSERT(false, "Overlapping triangles must be resolved by last or nearest.");
+            }
+        } else if (!strcmp(argv[i], "-metric") || !strcmp(argv[i], "--metric")) {
+            ASSERT(i + 1 < argc, "Must provide a distance metric.");
+            ++i;
+            if (!strcmp(argv[i], "manhattan")) {
+                metric = DistanceMetric::Manhattan;
+            } else if (!strcmp(argv[i], "chebyshev")) {
+                metric = DistanceMetric::Chebyshev;
+            } else if (!strcmp(argv[i], "euclidean")) {
+                metric = DistanceMetric::Euclidean;
+            } else {
+                ASSERT(false, "Distance metric must be manhattan, chebyshev or euclidean.");
+            }
+        } else if (!strcmp(argv[i], "-levels") || !strcmp(argv[i], "--levels")) {
+            ASSERT(i + 1 < argc, "Must provide a number of levels of detail.");
+            num_levels = std::stoul(std::string(argv[++i]));
+            ASSERT(num_levels > 0, "Must output at least one level of detail.");
+        } else if (!strcmp(argv[i], "-checkpoint") || !strcmp(argv[i], "--checkpoint")) {
+            ASSERT(i + 1 < argc, "Must provide a number of seconds between checkpoints.");
+            checkpoint_interval = std::stod(std::string(argv[++i]));
+            ASSERT(checkpoint_interval > 0.0, "Must checkpoint at a positive interval.");
+        } else if (!strcmp(argv[i], "-incremental") || !strcmp(argv[i], "--incremental")) {
+            incremental = true;
+        } else if (!strcmp(argv[i], "-svdag-builder") || !strcmp(argv[i], "--svdag-builder")) {
+            ASSERT(i + 1 < argc, "Must provide an SVDAG builder.");
+            ++i;
+            if (!strcmp(argv[i], "sequential")) {
+                level_parallel_svdag = false;
+            } else if (!strcmp(argv[i], "level")) {
+                level_parallel_svdag = true;
+            } else {
+                ASSERT(false, "SVDAG builder must be sequential or level.");
+            }
+        } else {
+            ASSERT(false, "Failed to parse conversion flag.");
+        }
+    }
+
+    // The coarser levels of detail are downsampled from the full resolution
+    // grid, so the model is only parsed and voxelized once. Downsampling
+    // stops early once the grid is a single voxel.
+    auto build_raw_levels = [&](std::vector<std::byte> raw, uint32_t width,
+                                uint32_t height, uint32_t depth,
+                                auto convert) {
+        const uint32_t bytes_per_voxel =
+            attribute_set == VoxelChunk::AttributeSet::ColorNormal ? 8 : 4;
+        std::vector<LODFile::Level> levels;
+        for (uint32_t level = 0; level < num_levels; ++level) {
+            if (level) {
+                raw = downsample_raw(raw, width, height, depth, bytes_per_voxel);
+                width = (width + 1) / 2;
+                height = (height + 1) / 2;
+                depth = (depth + 1) / 2;
+            }
+            levels.push_back({width, height, depth, convert(raw, width, height, depth)});
+            if (width == 1 && height == 1 && depth == 1) {
+                break;
+            }
+        }
+        return levels;
+    };
+
+    ASSERT(!incremental || (!strcmp(argv[3], "svdag") && num_levels == 1),
+           "Only SVDAGs at a single level of detail can be converted "
+           "incrementally.");
+    ASSERT(checkpoint_interval == 0.0 || (strcmp(argv[3], "svdag") &&
+                                          strcmp(argv[3], "raw") &&
+                                          strcmp(argv[3], "df")),
+           "Only custom formats can be checkpointed.");
+    ASSERT(metric == DistanceMetric::Manhattan || !strcmp(argv[3], "df"),
+           "Only the df format measures distances.");
+    ASSERT(!level_parallel_svdag || !strcmp(argv[3], "svdag"),
+           "Only the svdag format can be built a level at a time.");
+
+    // Nothing in a raw or SVDAG file says which attributes its voxels hold,
+    // so ones with normals are written under their own format name, which is
+    // also what model_viewer is told to render them as.
+    const std::string attribute_suffix =
+        attribute_set == VoxelChunk::AttributeSet::ColorNormal ? "_color_normal" : "";
+
+    // Analyzing the model instead of converting it only voxelizes it, to
+    // report what the formats would have to store.
+    if (!strcmp(argv[3], "-analyze") || !strcmp(argv[3], "--analyze")) {
+        auto bricks = brick_voxelize_obj(model_path, res, num_threads);
+        print_occupancy_statistics(analyze_occupancy(bricks));
+        return 0;
+    }
+
     std::vector<std::byte> model;
     std::cout << "Converting model to "
               << argv[3] << std::endl;
     if (!strcmp(argv[3], "svdag")) {
-        uint32_t chunk_width, chunk_height, chunk_depth;
-        auto raw_vox = raw_voxelize_obj(model_path, res, chunk_width,
-                                        chunk_height, chunk_depth);
-        model = convert_raw_to_svdag(raw_vox, chunk_width, chunk_height,
-                                     chunk_depth, 4);
-	write(reinterpret_cast<const char *>(model.data()), model.size(), "svdag");
+        ASSERT(resolve == VoxelResolve::LastTriangle,
+               "SVDAGs can only be built with the last triangle's colors.");
+        // An incremental conversion keeps a snapshot of the model next to the
+        // SVDAG, and the next one only voxelizes and rebuilds what changed
+        // since. Anything else leaves the snapshot stale, so it's removed.
+        const std::string obj_path = model_path;
+        const std::string svdag_path =
+            model_path.substr(0, model_path.size() - 4) + ".svdag" + attribute_suffix;
+        const std::string snapshot_path = svdag_path + ".ivsmesh";
+        const std::string run = std::string(argv[2]) + "\n" +
+                                (attribute_set == VoxelChunk::AttributeSet::ColorNormal
+                                     ? "color_normal" : "color");
+        if (incremental) {
+            auto snapshot = MeshCache::open_snapshot(snapshot_path, run);
+            std::vector<std::byte> previous;
+            if (snapshot && std::filesystem::exists(svdag_path)) {
+                previous.resize(std::filesystem::file_size(svdag_path));
+                std::ifstream(svdag_path, std::ios::in | std::ios::binary)
+                    .read(reinterpret_cast<char *>(previous.data()), previous.size());
+            }
+            std::vector<std::pair<uint64_t, uint64_t>> dirty_ranges;
+            std::optional<MortonBrickStream> bricks;
+            if (previous.size() >= 4 * sizeof(uint32_t)) {
+                bricks = brick_revoxelize_obj(model_path, *snapshot, res, num_threads,
+                                              attribute_set, dirty_ranges);
+            }
+            uint32_t previous_size[3] = {};
+            if (bricks) {
+                memcpy(previous_size, previous.data(), sizeof(previous_size));
+            }
+            if (bricks && previous_size[0] == bricks->width &&
+                previous_size[1] == bricks->height && previous_size[2] == bricks->depth) {
+                model = update_svdag(std::move(previous), *bricks, dirty_ranges);
+            } else {
+                std::cout << "INFO: There's no previous conversion to update, so "
+                             "the whole model is converted.\n";
+            }
+        } else {
+            std::filesystem::remove(snapshot_path);
+        }
+        // The level parallel builder has every thread work on each level, but
+        // writes the nodes in a different order and holds whole levels in
+        // memory, so it's only used when asked for.
+        auto build_svdag = [&](const MortonBrickStream &bricks) {
+            return level_parallel_svdag ? convert_raw_to_svdag(bricks, num_threads)
+                                        : convert_raw_to_svdag(bricks);
+        };
+        if (model.empty()) {
+            auto bricks = brick_voxelize_obj(model_path, res, num_threads,
+                                             attribute_set);
+            if (num_levels > 1) {
+                std::vector<LODFile::Level> levels;
+                for (uint32_t level = 0; level < num_levels; ++level) {
+                    if (level) {
+                        bricks = downsample_bricks(bricks);
+                    }
+                    levels.push_back({bricks.width, bricks.height, bricks.depth,
+                                      build_svdag(bricks)});
+                    if (bricks.width == 1 && bricks.height == 1 && bricks.depth == 1) {
+                        break;
+                    }
+                }
+                write_levels(levels, "svdag", VoxelChunk::Format::SVDAG, attribute_set);
+            } else {
+                model = build_svdag(bricks);
+            }
+        }
+        if (num_levels == 1) {
+	    write(reinterpret_cast<const char *>(model.data()), model.size(), "svdag" + attribute_suffix);
+        }
+        if (incremental) {
+            MeshCache::write_snapshot(obj_path, snapshot_path, run);
+        }
     } else if (!strcmp(argv[3], "raw")) {
         uint32_t chunk_width, chunk_height, chunk_depth;
         auto raw_vox = raw_voxelize_obj(model_path, res, chunk_width,
-                                        chunk_height, chunk_depth);
-        model = append_metadata_to_raw(raw_vox, chunk_width, chunk_height,
-                                       chunk_depth);
-	write(reinterpret_cast<const char *>(model.data()), model.size(), "raw");
+                                        chunk_height, chunk_depth,
+                                        num_threads, attribute_set, resolve);
+        if (num_levels > 1) {
+            auto levels = build_raw_levels(std::move(raw_vox), chunk_width,
+                                           chunk_height, chunk_depth,
+                                           append_metadata_to_raw);
+            write_levels(levels, "raw", VoxelChunk::Format::Raw, attribute_set);
+        } else {
+            model = append_metadata_to_raw(raw_vox, chunk_width, chunk_height,
+                                           chunk_depth);
+	    write(reinterpret_cast<const char *>(model.data()), model.size(), "raw" + attribute_suffix);
+        }
     } else if (!strcmp(argv[3], "df")) {
+        ASSERT(attribute_set == VoxelChunk::AttributeSet::Color,
+               "Distance fields can only be built with the color attributes.");
         uint32_t chunk_width, chunk_height, chunk_depth;
         auto raw_vox = raw_voxelize_obj(model_path, res, chunk_width,
-                                        chunk_height, chunk_depth);
-        model = convert_raw_color_to_df(raw_vox, chunk_width, chunk_height,
-                                        chunk_depth, 4);
-        model = append_metadata_to_raw(model, chunk_width, chunk_height,
-                                       chunk_depth);
-	write(reinterpret_cast<const char *>(model.data()), model.size(), "df");
+                                        chunk_height, chunk_depth,
+                                        num_threads, attribute_set, resolve);
+        auto convert = [&](const std::vector<std::byte> &raw, uint32_t width,
+                           uint32_t height, uint32_t depth) {
+            return append_metadata_to_raw(
+                convert_raw_color_to_df(raw, width, height, depth, 4, metric), width,
+                height, depth);
+        };
+        if (num_levels > 1) {
+            auto levels = build_raw_levels(std::move(raw_vox), chunk_width,
+                                           chunk_height, chunk_depth, convert);
+            write_levels(levels, "df", VoxelChunk::Format::DF, attribute_set);
+        } else {
+            model = convert(raw_vox, chunk_width, chunk_height, chunk_depth);
+	    write(reinterpret_cast<const char *>(model.data()), model.size(), "df");
+        }
     } else {
+        ASSERT(attribute_set == VoxelChunk::AttributeSet::Color &&
+                   resolve == VoxelResolve::LastTriangle,
+               "Custom formats can only be built with the last triangle's "
+               "colors.");
+        ASSERT(num_levels == 1,
+               "Custom formats can only be built at a single level of detail.");
 	std::string format(argv[3]);
         auto bounds = calculate_bounds(parse_format(format));
-        Voxelizer voxelizer(model_path, bounds);
+        Voxelizer voxelizer(model_path, bounds, num_threads, max_memory_usage,
+                            layout);
 
         model_path = model_path.substr(0, model_path.size() - 4) + "." + format_identifier(parse_format(format));
-        std::ofstream stream(model_path, std::ios::out | std::ios::binary);
 
-        format_to_conversion_function.at(format)(voxelizer, stream);
+        // A conversion restarted with the same model, resolution, format and
+        // layout picks up from its last checkpoint, as long as the model's
+        // contents (as hashed by its mesh cache, or just the OBJ's size and
+        // mtime without one) haven't changed since.
+        ConstructionCheckpoint checkpoint;
+        if (checkpoint_interval > 0.0) {
+            std::string contents;
+            if (auto mesh_cache = MeshCache::open(argv[1])) {
+                contents = std::to_string(mesh_cache->get_content_hash());
+            } else {
+                contents = std::to_string(std::filesystem::file_size(argv[1])) + " " +
+                           std::to_string(std::filesystem::last_write_time(argv[1])
+                                              .time_since_epoch()
+                                              .count());
+            }
+            std::string run = std::string(argv[1]) + "\n" + contents + "\n" + argv[2] + "\n" +
+                              format + "\n" + (layout == VoxelLayout::Morton ? "morton" : "tiled");
+            checkpoint = ConstructionCheckpoint(model_path + ".checkpoint", run,
+                                                checkpoint_interval, voxelizer);
+        }
+        std::ofstream stream = checkpoint.open_output(model_path);
+
+        format_to_conversion_function.at(format)(voxelizer, stream, checkpoint);
+        stream.close();
+        checkpoint.finish();
     }
 }
@@ -4,6 +4,7 @@
 #include <compiler/Compiler.h>
 #include <graphics/GraphicsContext.h>
 #include <voxels/Conversion.h>
+#include <voxels/LODFile.h>
 #include <voxels/Voxel.h>
 #include <voxels/VoxelChunkGeneration.h>
 #include <voxels/Voxelize.h>
@@ -13,30 +14,57 @@ int main(int argc, char *argv[]) {
     ASSERT(argv[2], "Must provide a format of the model.");
     std::string model_path(argv[1]);
 
+    // A .lod file is rendered at one of its levels of detail, given as
+    // "lod:<level>", or at full resolution if it's just "lod". Only that
+    // level is read from the file.
+    std::string_view format_name(argv[2]);
+    const bool is_lod = format_name == "lod" || format_name.starts_with("lod:");
+    // Raw and SVDAG models converted with -attributes color_normal are
+    // written as "raw_color_normal" and "svdag_color_normal".
+    const VoxelChunk::AttributeSet attribute_set = format_name.ends_with("_color_normal")
+                                                       ? VoxelChunk::AttributeSet::ColorNormal
+                                                       : VoxelChunk::AttributeSet::Color;
+
     ChunkManager chunk_manager;
-    std::ifstream stream(model_path, std::ios::in | std::ios::binary);
-    const auto file_size = std::filesystem::file_size(model_path);
-    std::vector<std::byte> model_bytes = std::vector<std::byte>(file_size);
-    stream.read(reinterpret_cast<char *>(model_bytes.data()), file_size);
-    std::cout << "Model size: " << model_bytes.size() << " bytes\n";
+    std::vector<std::byte> model_bytes;
+    if (!is_lod) {
+        std::ifstream stream(model_path, std::ios::in | std::ios::binary);
+        const auto file_size = std::filesystem::file_size(model_path);
+        model_bytes = std::vector<std::byte>(file_size);
+        stream.read(reinterpret_cast<char *>(model_bytes.data()), file_size);
+        std::cout << "Model size: " << model_bytes.size() << " bytes\n";
+    }
 
     uint32_t *model_ptr = reinterpret_cast<uint32_t *>(model_bytes.data());
     VoxelChunkPtr chunk;
     uint32_t chunk_width, chunk_height, chunk_depth;
-    if (!strcmp(argv[2], "svdag")) {
+    if (is_lod) {
+        uint32_t level = format_name == "lod" ? 0 : std::stoul(std::string(format_name.substr(4)));
+        LODFile lod_file(model_path);
+        std::cout << "Rendering level " << level << " of "
+                  << lod_file.get_num_levels() << " levels of detail.\n";
+        auto lod_level = lod_file.read_level(level);
+        std::cout << "Model size: " << lod_level.data.size() << " bytes\n";
+        chunk_width = lod_level.width;
+        chunk_height = lod_level.height;
+        chunk_depth = lod_level.depth;
+        chunk = chunk_manager.add_chunk(
+            std::move(lod_level.data), chunk_width, chunk_height, chunk_depth,
+            lod_file.get_format(), lod_file.get_attribute_set());
+    } else if (!strcmp(argv[2], "svdag") || !strcmp(argv[2], "svdag_color_normal")) {
         chunk_width = model_ptr[0];
         chunk_height = model_ptr[1];
         chunk_depth = model_ptr[2];
         chunk = chunk_manager.add_chunk(
             std::move(model_bytes), chunk_width, chunk_height, chunk_depth,
-            VoxelChunk::Format::SVDAG, VoxelChunk::AttributeSet::Color);
-    } else if (!strcmp(argv[2], "raw")) {
+            VoxelChunk::Format::SVDAG, attribute_set);
+    } else if (!strcmp(argv[2], "raw") || !strcmp(argv[2], "raw_color_normal")) {
         chunk_width = model_ptr[0];
         chunk_height = model_ptr[1];
         chunk_depth = model_ptr[2];
         chunk = chunk_manager.add_chunk(
             std::move(model_bytes), chunk_width, chunk_height, chunk_depth,
-            VoxelChunk::Format::Raw, VoxelChunk::AttributeSet::Color);
+            VoxelChunk::Format::Raw, attribute_set);
     } else if (!strcmp(argv[2], "df")) {
         chunk_width = model_ptr[0];
         chunk_height = model_ptr[1];
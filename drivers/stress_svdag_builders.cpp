@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <utils/Assert.h>
+#include <voxels/Conversion.h>
+#include <voxels/SVDAGNodeTable.h>
+#include <voxels/VoxelChunkGeneration.h>
+#include <voxels/Voxelize.h>
+
+// A run of count voxels, consecutive in Morton order, that all hold voxel.
+struct VoxelRun {
+    uint64_t start, count;
+    SVDAGNode voxel;
+
+    bool operator==(const VoxelRun &other) const = default;
+};
+
+// Decodes an SVDAG into the runs of occupied voxels it holds, in Morton
+// order, merging neighbouring runs of the same voxel. Builders are free to
+// fold identical children and order their nodes however they like, but the
+// runs only depend on the voxels.
+static std::vector<VoxelRun> decode_svdag(const std::vector<std::byte> &svdag) {
+    uint32_t header[4];
+    memcpy(header, svdag.data(), sizeof(header));
+    ASSERT(svdag.size() == sizeof(header) + static_cast<uint64_t>(header[3]) * sizeof(SVDAGNode),
+           "SVDAG's size doesn't match its node count.");
+    auto node_at = [&](uint32_t offset) {
+        ASSERT(offset < header[3], "SVDAG node points past the last node.");
+        SVDAGNode node;
+        memcpy(&node, svdag.data() + sizeof(header) + offset * sizeof(SVDAGNode),
+               sizeof(SVDAGNode));
+        return node;
+    };
+
+    // The tree is as deep as it takes to cover the grid's longest side.
+    const uint32_t power_of_two = std::bit_width(std::max({header[0], header[1], header[2]}) - 1);
+    std::vector<VoxelRun> runs;
+    auto visit = [&](auto &visit, const SVDAGNode &node, bool is_leaf, uint32_t d,
+                     uint64_t start) -> void {
+        const uint64_t count = static_cast<uint64_t>(1) << (3 * (power_of_two - d));
+        if (is_leaf) {
+            if (!runs.empty() && runs.back().start + runs.back().count == start &&
+                runs.back().voxel == node) {
+                runs.back().count += count;
+            } else {
+                runs.push_back({start, count, node});
+            }
+            return;
+        }
+        ASSERT(d < power_of_two, "SVDAG has an internal node at the leaf level.");
+        for (uint32_t i = 0; i < 8; ++i) {
+            const uint32_t child_offset = node.child_offsets_[i];
+            if (child_offset != 0xFFFFFFFF) {
+                visit(visit, node_at(child_offset & 0x7FFFFFFF), child_offset >> 31, d + 1,
+                      start + i * (count / 8));
+            }
+        }
+    };
+    // A lone node can only be a leaf, since the root is never empty.
+    visit(visit, node_at(header[3] - 1), header[3] == 1, 0, 0);
+    return runs;
+}
+
+static uint32_t num_svdag_nodes(const std::vector<std::byte> &svdag) {
+    uint32_t num_nodes;
+    memcpy(&num_nodes, svdag.data() + sizeof(uint32_t) * 3, sizeof(uint32_t));
+    return num_nodes;
+}
+
+// Builds the bricks' SVDAG with the sequential builder and with the level
+// parallel one on every number of threads from one up to max_threads, and
+// checks they all decode to the same voxels with the same number of nodes.
+// If the raw grid is given, so is the SVDAG converted straight from it.
+static void compare(const std::string &name, const MortonBrickStream &bricks,
+                    uint32_t max_threads, const std::vector<std::byte> *raw = nullptr) {
+    const auto sequential = convert_raw_to_svdag(bricks);
+    const auto expected = decode_svdag(sequential);
+    if (raw) {
+        ASSERT(decode_svdag(convert_raw_to_svdag(*raw, bricks.width, bricks.height,
+                                                 bricks.depth, bricks.bytes_per_voxel)) ==
+                   expected,
+               "The SVDAG built from the bricks holds different voxels than the one "
+               "converted from the raw grid.");
+    }
+    for (uint32_t num_threads = 1; num_threads <= max_threads; ++num_threads) {
+        const auto level_parallel = convert_raw_to_svdag(bricks, num_threads);
+        ASSERT(decode_svdag(level_parallel) == expected,
+               "The level parallel SVDAG builder holds different voxels than the "
+               "sequential one.");
+        ASSERT(num_svdag_nodes(level_parallel) == num_svdag_nodes(sequential),
+               "The level parallel SVDAG builder wrote a different number of nodes than "
+               "the sequential one.");
+    }
+    std::cout << "INFO: " << name << ": " << num_svdag_nodes(sequential) << " nodes, "
+              << expected.size() << " runs of voxels match on 1 to " << max_threads
+              << " threads.\n";
+}
+
+// Compares the SVDAG builders on random grids of assorted sizes and
+// densities, on a procedurally generated chunk, and on a voxelized model if
+// one's given.
+int main(int argc, char *argv[]) {
+    uint32_t num_grids = argc > 1 ? std::stoul(std::string(argv[1])) : 100;
+    uint32_t max_threads = argc > 2 ? std::stoul(std::string(argv[2]))
+                                    : std::max(std::thread::hardware_concurrency(), 1U);
+
+    // Few colors and mostly empty or mostly full grids, so that plenty of
+    // subtrees are identical and get deduplicated or folded.
+    std::mt19937 rng(0);
+    for (uint32_t grid = 0; grid < num_grids; ++grid) {
+        const uint32_t width = 1 + rng() % 40, height = 1 + rng() % 40, depth = 1 + rng() % 40;
+        const double density = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        const uint32_t num_colors = 1 + rng() % 3;
+        std::vector<std::byte> raw(static_cast<uint64_t>(width) * height * depth * 4);
+        for (uint64_t i = 0; i < raw.size(); i += 4) {
+            if (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < density) {
+                const uint32_t color = 0xFF000000 | (0x40 << (8 * (rng() % num_colors)));
+                memcpy(&raw[i], &color, sizeof(uint32_t));
+            }
+        }
+        if (std::all_of(raw.begin(), raw.end(), [](std::byte b) { return b == std::byte{0}; })) {
+            continue;
+        }
+        compare("Random " + std::to_string(width) + "x" + std::to_string(height) + "x" +
+                    std::to_string(depth),
+                make_brick_stream(raw, width, height, depth, 4), max_threads, &raw);
+    }
+
+    const uint32_t size = argc > 3 ? std::stoul(std::string(argv[3])) : 128;
+    const auto procedural = generate_basic_procedural_chunk(size, size, size);
+    compare("Procedural " + std::to_string(size) + "^3",
+            make_brick_stream(procedural, size, size, size, 4), max_threads, &procedural);
+
+    if (argc > 5) {
+        std::string model_path(argv[4]);
+        float res = std::stof(std::string(argv[5]));
+        compare(model_path + " at " + argv[5], brick_voxelize_obj(model_path, res),
+                max_threads);
+    }
+}
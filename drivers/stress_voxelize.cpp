@@ -0,0 +1,53 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <utils/Assert.h>
+#include <voxels/Voxelize.h>
+
+// Voxelizes an OBJ over and over, on every number of threads from one up to
+// the given maximum, with both ways of resolving voxels covered by several
+// triangles, and checks that every run produces exactly the same grid as the
+// single threaded one.
+int main(int argc, char *argv[]) {
+    ASSERT(argc > 2, "Must provide a .obj model and a resolution to voxelize at.");
+    std::string model_path(argv[1]);
+    float voxel_size = std::stof(std::string(argv[2]));
+    uint32_t max_threads = argc > 3 ? std::stoul(std::string(argv[3]))
+                                    : std::max(std::thread::hardware_concurrency(), 1U);
+    uint32_t num_repeats = argc > 4 ? std::stoul(std::string(argv[4])) : 3;
+
+    auto voxelize = [&](uint32_t num_threads, VoxelResolve resolve, double &seconds) {
+        uint32_t width, height, depth;
+        auto start = std::chrono::steady_clock::now();
+        auto voxels = raw_voxelize_obj(model_path, voxel_size, width, height, depth,
+                                       num_threads, VoxelChunk::AttributeSet::Color,
+                                       resolve);
+        auto end = std::chrono::steady_clock::now();
+        seconds = std::chrono::duration<double>(end - start).count();
+        return voxels;
+    };
+
+    for (VoxelResolve resolve : {VoxelResolve::LastTriangle, VoxelResolve::NearestTriangle}) {
+        std::string_view name =
+            resolve == VoxelResolve::LastTriangle ? "last triangle" : "nearest triangle";
+        double seconds;
+        const auto expected = voxelize(1, resolve, seconds);
+        for (uint32_t num_threads = 1; num_threads <= max_threads; ++num_threads) {
+            for (uint32_t repeat = 0; repeat < num_repeats; ++repeat) {
+                auto voxels = voxelize(num_threads, resolve, seconds);
+                ASSERT(voxels.size() == expected.size(),
+                       "Voxelizing on a different number of threads changed the grid's size.");
+                uint64_t num_mismatches = 0;
+                for (uint64_t i = 0; i < voxels.size(); i += sizeof(uint32_t)) {
+                    num_mismatches += memcmp(&voxels[i], &expected[i], sizeof(uint32_t)) != 0;
+                }
+                std::cout << "INFO: " << name << ", " << num_threads << " threads, run "
+                          << repeat << ": " << seconds * 1000.0 << " ms, "
+                          << num_mismatches << " voxels differ from 1 thread.\n";
+                ASSERT(!num_mismatches, "Voxelization depends on the number of threads.");
+            }
+        }
+    }
+}
@@ -148,6 +148,19 @@ construction_df_packing_flags=(
 	"-df-packing"
 	)
 
+layout_formats=(
+	"Raw(16, 16, 16) SVDAG(7)"
+	"DF(16, 16, 16, 6) SVDAG(7)"
+	"Raw(8, 8, 8) Raw(8, 8, 8) Raw(8, 8, 8)"
+	"SVO(11)"
+	"SVDAG(11)"
+	)
+
+layouts=(
+	"tiled"
+	"morton"
+	)
+
 intersection_opt_flags=(
 	""
 	"-restart-sv"
@@ -312,6 +325,24 @@ elif [ "$1" = "construction_opt_run" ]; then
 		done
 	done
 	cd ../experiments
+elif [ "$1" = "layout_run" ]; then
+	cd ../build
+	OUT="${2:-layout-measurements}"
+	rm -f ../experiments/$OUT
+	touch ../experiments/$OUT
+	for layout in "${layouts[@]}"
+	do
+		for format in "${layout_formats[@]}"
+		do
+			for model in "${models[@]}"
+			do
+				echo "$format $layout" >> ../experiments/$OUT
+				echo "$model" >> ../experiments/$OUT
+				{ /usr/bin/time -v drivers/convert_model ../experiments/obj/$model/$model.obj 1 "$format" -layout $layout; } 2>&1 | grep -e "Elapsed (wall clock) time" -e "Maximum resident set size" >> ../experiments/$OUT
+			done
+		done
+	done
+	cd ../experiments
 elif [ "$1" = "intersection_opt_run" ]; then
 	cd ../build
 	OUT="${2:-intersection-opt-measurements}"
@@ -24,6 +24,9 @@ const std::map<std::pair<VoxelChunk::Format, VoxelChunk::AttributeSet>,
         {{VoxelChunk::Format::SVDAG, VoxelChunk::AttributeSet::Color}, 3},
         {{VoxelChunk::Format::Raw, VoxelChunk::AttributeSet::Emissive}, 4},
         {{VoxelChunk::Format::DF, VoxelChunk::AttributeSet::Color}, 5},
+        {{VoxelChunk::Format::Raw, VoxelChunk::AttributeSet::ColorNormal}, 6},
+        {{VoxelChunk::Format::SVO, VoxelChunk::AttributeSet::ColorNormal}, 7},
+        {{VoxelChunk::Format::SVDAG, VoxelChunk::AttributeSet::ColorNormal}, 8},
 };
 
 const uint32_t MAX_NUM_CHUNKS_LOADED_PER_FRAME = 32;
@@ -290,6 +293,14 @@ GraphicsContext::GraphicsContext(std::shared_ptr<Window> window) {
         std::make_shared<Shader>(device_, "SVDAG_Color_rint");
     auto df_color_rchit = std::make_shared<Shader>(device_, "DF_Color_rchit");
     auto df_color_rint = std::make_shared<Shader>(device_, "DF_Color_rint");
+    auto raw_color_normal_rchit =
+        std::make_shared<Shader>(device_, "Raw_ColorNormal_rchit");
+    auto raw_color_normal_rint =
+        std::make_shared<Shader>(device_, "Raw_ColorNormal_rint");
+    auto svo_color_normal_rchit =
+        std::make_shared<Shader>(device_, "SVO_ColorNormal_rchit");
+    auto svdag_color_normal_rchit =
+        std::make_shared<Shader>(device_, "SVDAG_ColorNormal_rchit");
     auto emissive_rchit = std::make_shared<Shader>(device_, "Emissive_rchit");
     auto download_rchit = std::make_shared<Shader>(device_, "Download_rchit");
     auto generic_rchit = std::make_shared<Shader>(device_, "Generic_rchit");
@@ -309,6 +320,9 @@ GraphicsContext::GraphicsContext(std::shared_ptr<Window> window) {
         {svdag_color_rchit, svdag_color_rint},
         {emissive_rchit, raw_color_rint},
         {df_color_rchit, df_color_rint},
+        {raw_color_normal_rchit, raw_color_normal_rint},
+        {svo_color_normal_rchit, svo_color_rint},
+        {svdag_color_normal_rchit, svdag_color_rint},
     };
     std::vector<std::vector<std::shared_ptr<Shader>>> download_shader_groups = {
         {rgen},
@@ -319,6 +333,9 @@ GraphicsContext::GraphicsContext(std::shared_ptr<Window> window) {
         {download_rchit, svdag_color_rint},
         {download_rchit, raw_color_rint},
         {download_rchit, df_color_rint},
+        {download_rchit, raw_color_normal_rint},
+        {download_rchit, svo_color_rint},
+        {download_rchit, svdag_color_rint},
     };
 
     for (const std::string &custom : customs) {
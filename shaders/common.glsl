@@ -15,6 +15,13 @@ struct RawColor {
     uint8_t alpha_;
 };
 
+// ColorNormal voxels are a color followed by a normal, packed as pack_normal
+// in voxels/PackedNormal.h does.
+struct RawColorNormal {
+    RawColor color_;
+    uint32_t normal_;
+};
+
 struct SVONode {
     uint32_t child_offset_;
     uint8_t valid_mask_;
@@ -30,6 +37,14 @@ struct SVOLeaf_Color {
     uint8_t _padding_[4];
 };
 
+struct SVOLeaf_ColorNormal {
+    uint8_t red_;
+    uint8_t green_;
+    uint8_t blue_;
+    uint8_t alpha_;
+    uint32_t normal_;
+};
+
 struct SVDAGNode {
     uint32_t child_offsets_[8];
 };
@@ -42,8 +57,28 @@ struct SVDAGLeaf_Color {
     uint8_t _padding_[28];
 };
 
+struct SVDAGLeaf_ColorNormal {
+    uint8_t red_;
+    uint8_t green_;
+    uint8_t blue_;
+    uint8_t alpha_;
+    uint32_t normal_;
+    uint8_t _padding_[24];
+};
+
 const uint SVDAG_INVALID_OFFSET = 0xFFFFFFFF;
 
+// Decodes a normal packed by pack_normal in voxels/PackedNormal.h, whose
+// unpack_normal does the same on the CPU.
+vec3 unpack_normal(uint32_t packed) {
+    vec2 octahedral = unpackSnorm2x16(packed);
+    vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+    if (normal.z < 0.0) {
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(normal);
+}
+
 layout (push_constant) uniform PushConstants {
     uint64_t elapsed_ms;
     uint download_bit;
@@ -77,6 +112,13 @@ layout(set = 1, binding = 1) buffer RawBuffer {
     RawColor voxel_colors[];
 } raw_buffers[];
 
+layout(set = 1, binding = 1) buffer RawBuffer_ColorNormal {
+    uint32_t voxel_width;
+    uint32_t voxel_height;
+    uint32_t voxel_depth;
+    RawColorNormal voxels[];
+} raw_color_normal_buffers[];
+
 layout(set = 1, binding = 1) buffer SVOBuffer {
     uint32_t voxel_width;
     uint32_t voxel_height;
@@ -93,6 +135,14 @@ layout(set = 1, binding = 1) buffer SVOBuffer_Color {
     SVOLeaf_Color nodes[];
 } svo_leaf_color_buffers[];
 
+layout(set = 1, binding = 1) buffer SVOBuffer_ColorNormal {
+    uint32_t voxel_width;
+    uint32_t voxel_height;
+    uint32_t voxel_depth;
+    uint32_t num_nodes;
+    SVOLeaf_ColorNormal nodes[];
+} svo_leaf_color_normal_buffers[];
+
 layout(set = 1, binding = 1) buffer SVDAGBuffer {
     uint32_t voxel_width;
     uint32_t voxel_height;
@@ -109,6 +159,14 @@ layout(set = 1, binding = 1) buffer SVDAGBuffer_Color {
     SVDAGLeaf_Color nodes[];
 } svdag_leaf_color_buffers[];
 
+layout(set = 1, binding = 1) buffer SVDAGBuffer_ColorNormal {
+    uint32_t voxel_width;
+    uint32_t voxel_height;
+    uint32_t voxel_depth;
+    uint32_t num_nodes;
+    SVDAGLeaf_ColorNormal nodes[];
+} svdag_leaf_color_normal_buffers[];
+
 layout(set = 1, binding = 2) buffer chunk_dimensions_ {
     uint32_t chunk_dimensions[MAX_MODELS * 3];
 };
@@ -25,6 +25,23 @@ const vec3 voxel_bitangents[6] = vec3[6](
                       vec3(-1.0, 0.0, 0.0)  // bitangent for z
                       );
 
+// Shades a hit with a voxel's precomputed world space normal, rather than
+// the normal of the face that was hit, re-orthogonalizing the face's tangent
+// frame around it. Normals facing away from the face are ignored, since rays
+// leaving the surface are offset along the normal.
+void use_voxel_normal(inout RayPayload payload, vec3 normal) {
+    if (dot(normal, payload.world_normal) <= 0.0) {
+        return;
+    }
+    vec3 tangent = payload.tangent - normal * dot(payload.tangent, normal);
+    if (dot(tangent, tangent) < 1e-6) {
+        tangent = payload.bitangent - normal * dot(payload.bitangent, normal);
+    }
+    payload.world_normal = normal;
+    payload.tangent = normalize(tangent);
+    payload.bitangent = cross(normal, payload.tangent);
+}
+
 // Need to transform between local direction sampled from hemisphere and world normal
 vec3 local_to_world(const vec3 wo, const vec3 normal, const vec3 tangent, const vec3 bitangent) {
     return vec3(
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+
+#include "Analysis.h"
+
+namespace {
+
+// FNV-1a over 8 byte words, as the mesh cache hashes files.
+uint64_t mix(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    return hash ^ (hash >> 32);
+}
+
+// Estimates how many distinct hashes it's given, in bounded memory. It keeps
+// the ones whose lowest shift bits are all zero, and once it's kept too many,
+// it shifts one bit more and drops the ones that no longer qualify, so it
+// keeps one in every 2^shift distinct hashes.
+class HashSample {
+  public:
+    void add(uint64_t hash) {
+        // The splitmix64 finalizer, so the low bits are as random as any.
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+        if (hash & mask()) {
+            return;
+        }
+        hashes_.insert(hash);
+        while (hashes_.size() > MAX_HASHES) {
+            ++shift_;
+            std::erase_if(hashes_, [&](uint64_t kept) { return kept & mask(); });
+        }
+    }
+
+    uint64_t estimate() const { return static_cast<uint64_t>(hashes_.size()) << shift_; }
+
+  private:
+    static constexpr uint64_t MAX_HASHES = 1 << 16;
+
+    uint64_t mask() const { return (static_cast<uint64_t>(1) << shift_) - 1; }
+
+    uint32_t shift_ = 0;
+    std::unordered_set<uint64_t> hashes_;
+};
+
+} // namespace
+
+OccupancyStatistics analyze_occupancy(const MortonBrickStream &bricks) {
+    constexpr uint32_t MAX_BRICK_HEIGHT = 9;
+    constexpr uint32_t MAX_COLORS = 16;
+    constexpr uint64_t NO_NODE = ~static_cast<uint64_t>(0);
+    const auto start = std::chrono::steady_clock::now();
+
+    const uint32_t largest = std::max({bricks.width, bricks.height, bricks.depth, 1U});
+    const uint32_t power_of_two = std::bit_width(largest - 1);
+    const uint32_t max_brick_height = std::min(power_of_two, MAX_BRICK_HEIGHT);
+
+    OccupancyStatistics statistics;
+    for (uint32_t height = 0; height <= power_of_two; ++height) {
+        auto nodes_along = [&](uint32_t size) {
+            return static_cast<uint64_t>(((size - 1) >> height) + 1);
+        };
+        statistics.levels.push_back({height,
+                                     nodes_along(bricks.width) * nodes_along(bricks.height) *
+                                         nodes_along(bricks.depth),
+                                     0, 0});
+    }
+    for (uint32_t height = 1; height <= max_brick_height; ++height) {
+        statistics.bricks.push_back({1U << height, 0, 0, {}});
+    }
+
+    // Voxels are visited in Morton order, so every subtree's voxels are
+    // visited one after another, and only the subtree containing the current
+    // voxel has to be tracked at each height. Once a subtree is finished, it's
+    // added to its parent, whose hash mixes in each child's hash along with
+    // where it is, so equal hashes mean equal subtrees.
+    struct Node {
+        uint64_t key = NO_NODE;
+        uint64_t hash = 0;
+        uint64_t num_voxels = 0;
+        // Up to MAX_COLORS + 1 distinct colors, which is all the histogram
+        // needs to tell apart.
+        std::vector<uint32_t> colors;
+    };
+    std::vector<Node> nodes(power_of_two + 1);
+    std::vector<HashSample> samples(power_of_two + 1);
+    auto finish_node = [&](auto &finish_parent, uint32_t height) -> void {
+        Node &node = nodes[height];
+        if (node.key == NO_NODE) {
+            return;
+        }
+        samples[height].add(node.hash);
+        ++statistics.levels[height].num_occupied;
+        if (height >= 1 && height <= max_brick_height) {
+            OccupancyStatistics::Bricks &brick_statistics = statistics.bricks[height - 1];
+            ++brick_statistics.num_occupied;
+            brick_statistics.num_voxels += node.num_voxels;
+            uint32_t bucket = std::bit_width(node.colors.size() - 1);
+            ++brick_statistics.color_histogram[std::min(
+                bucket, OccupancyStatistics::NUM_COLOR_BUCKETS - 1)];
+        }
+
+        if (height < power_of_two) {
+            Node &parent = nodes[height + 1];
+            if (parent.key != node.key >> 3) {
+                finish_parent(finish_parent, height + 1);
+                parent.key = node.key >> 3;
+                parent.hash = 0xcbf29ce484222325ULL;
+                parent.num_voxels = 0;
+                parent.colors.clear();
+            }
+            parent.hash = mix(mix(parent.hash, node.key & 7), node.hash);
+            parent.num_voxels += node.num_voxels;
+            for (uint32_t color : node.colors) {
+                if (height + 1 <= max_brick_height && parent.colors.size() <= MAX_COLORS &&
+                    std::find(parent.colors.begin(), parent.colors.end(), color) ==
+                        parent.colors.end()) {
+                    parent.colors.push_back(color);
+                }
+            }
+        }
+        node.key = NO_NODE;
+    };
+
+    uint64_t num_voxels = 0;
+    for (uint64_t i = 0; i < bricks.size(); ++i) {
+        std::span<const std::byte> brick = bricks.brick(i);
+        for (uint32_t in_brick = 0; in_brick < MortonBrickStream::BRICK_VOLUME; ++in_brick) {
+            uint32_t color;
+            memcpy(&color, &brick[in_brick * bricks.bytes_per_voxel], sizeof(uint32_t));
+            if (!color) {
+                continue;
+            }
+            ++num_voxels;
+            Node &voxel = nodes[0];
+            voxel.key = bricks.keys[i] * MortonBrickStream::BRICK_VOLUME + in_brick;
+            voxel.hash = mix(0xcbf29ce484222325ULL, color);
+            voxel.num_voxels = 1;
+            voxel.colors.assign(1, color);
+            finish_node(finish_node, 0);
+        }
+    }
+    for (uint32_t height = 0; height <= power_of_two; ++height) {
+        finish_node(finish_node, height);
+        statistics.levels[height].num_unique = samples[height].estimate();
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    std::cout << "INFO: Analyzed " << num_voxels << " voxels in "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms.\n";
+    return statistics;
+}
+
+void print_occupancy_statistics(const OccupancyStatistics &statistics) {
+    auto percent = [](uint64_t part, uint64_t whole) {
+        return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+    };
+
+    // An SVO has a node for every occupied subtree, and an SVDAG one for
+    // every different one.
+    uint64_t num_occupied = 0, num_unique = 0;
+    std::cout << "Occupancy by level, from single voxels up to the whole grid:\n";
+    for (const OccupancyStatistics::Level &level : statistics.levels) {
+        std::cout << "  " << (1U << level.height) << "^3: " << level.num_occupied
+                  << " of " << level.num_nodes << " occupied ("
+                  << percent(level.num_occupied, level.num_nodes) << "%), ~"
+                  << level.num_unique << " different ("
+                  << percent(level.num_unique, level.num_occupied)
+                  << "% of occupied).\n";
+        num_occupied += level.num_occupied;
+        num_unique += level.num_unique;
+    }
+    std::cout << "An SVO would take about " << num_occupied
+              << " nodes, and an SVDAG about " << num_unique << ".\n";
+
+    static constexpr const char *BUCKET_NAMES[OccupancyStatistics::NUM_COLOR_BUCKETS] = {
+        "1", "2", "3-4", "5-8", "9-16", ">16"};
+    std::cout << "Occupied bricks by size, and how many colors they hold:\n";
+    for (const OccupancyStatistics::Bricks &bricks : statistics.bricks) {
+        const uint64_t brick_volume = static_cast<uint64_t>(bricks.edge) * bricks.edge * bricks.edge;
+        std::cout << "  " << bricks.edge << "^3: " << bricks.num_occupied << " occupied, "
+                  << percent(bricks.num_voxels, bricks.num_occupied * brick_volume)
+                  << "% full, " << bricks.num_occupied * brick_volume * sizeof(uint32_t)
+                  << " bytes as raw bricks. Colors:";
+        for (uint32_t bucket = 0; bucket < OccupancyStatistics::NUM_COLOR_BUCKETS; ++bucket) {
+            std::cout << " " << BUCKET_NAMES[bucket] << ": "
+                      << percent(bricks.color_histogram[bucket], bricks.num_occupied) << "%"
+                      << (bucket + 1 < OccupancyStatistics::NUM_COLOR_BUCKETS ? "," : ".\n");
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "BrickStream.h"
+
+// Statistics of a voxelized model that predict how well each format stores
+// it, so formats that obviously won't do well can be ruled out without
+// converting into them. They're gathered in one pass over the bricks, which
+// takes a fraction of the time building any format does.
+struct OccupancyStatistics {
+    // Distinct colors in a brick, bucketed as 1, 2, 3-4, 5-8, 9-16 and more.
+    static constexpr uint32_t NUM_COLOR_BUCKETS = 6;
+
+    // The nodes of the tree over the grid whose subtrees are 2^height voxels
+    // wide, with height 0 being single voxels.
+    struct Level {
+        uint32_t height;
+        // Nodes overlapping the grid, and the ones with a voxel in them.
+        uint64_t num_nodes;
+        uint64_t num_occupied;
+        // About how many of the occupied nodes' subtrees are different, which
+        // is roughly how many nodes an SVDAG needs at this level. Estimated
+        // by hashing every subtree, and only keeping a sample of the hashes
+        // (all of them, if there are few enough).
+        uint64_t num_unique;
+    };
+
+    // The occupied bricks of one of the candidate brick sizes.
+    struct Bricks {
+        uint32_t edge;
+        uint64_t num_occupied;
+        // Voxels set in the occupied bricks.
+        uint64_t num_voxels;
+        std::array<uint64_t, NUM_COLOR_BUCKETS> color_histogram;
+    };
+
+    std::vector<Level> levels;
+    std::vector<Bricks> bricks;
+};
+
+// Bricks range from 2^3 voxels up to 512^3, or the whole grid if that's
+// smaller. Voxels are told apart by their colors only.
+OccupancyStatistics analyze_occupancy(const MortonBrickStream &bricks);
+
+void print_occupancy_statistics(const OccupancyStatistics &statistics);
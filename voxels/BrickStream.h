@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A voxel grid stored as just the BRICK_EDGE^3 bricks with at least one
+// non-zero voxel, sorted by the Morton code of the brick's position. A
+// brick's voxels are in Morton order as well, so brick i holds exactly the
+// voxels whose Morton codes are keys[i] * BRICK_VOLUME + [0, BRICK_VOLUME).
+// Anything walking the grid in Morton order can step straight from one
+// brick to the next, since everything in between is empty.
+struct MortonBrickStream {
+    static constexpr uint32_t BRICK_EDGE = 8;
+    static constexpr uint32_t BRICK_VOLUME = BRICK_EDGE * BRICK_EDGE * BRICK_EDGE;
+
+    uint32_t width = 0, height = 0, depth = 0;
+    uint32_t bytes_per_voxel = 0;
+
+    std::vector<uint64_t> keys;
+    // BRICK_VOLUME * bytes_per_voxel bytes per brick, in the order of keys.
+    std::vector<std::byte> voxels;
+
+    uint64_t size() const { return keys.size(); }
+
+    std::span<const std::byte> brick(uint64_t i) const {
+        const uint64_t brick_size = BRICK_VOLUME * bytes_per_voxel;
+        return std::span<const std::byte>(voxels).subspan(i * brick_size, brick_size);
+    }
+
+    // Bytes used by the bricks, which is what the stream's memory scales
+    // with, rather than the volume of the grid.
+    uint64_t memory_usage() const {
+        return keys.size() * sizeof(uint64_t) + voxels.size();
+    }
+};
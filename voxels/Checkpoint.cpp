@@ -0,0 +1,94 @@
+#include <cstring>
+
+#include "Checkpoint.h"
+#include "utils/Assert.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'I', 'V', 'S', 'C', 'K', 'P', 'T', '\0'};
+
+}
+
+ConstructionCheckpoint::ConstructionCheckpoint(std::filesystem::path directory,
+                                               std::string run, double interval,
+                                               Voxelizer &voxelizer)
+    : enabled_(true), directory_(std::move(directory)), run_(std::move(run)),
+      interval_(interval) {
+    // The state file starts with the magic, version and run, followed by
+    // the outer level's next iteration, the output size and then whatever
+    // state the construction saved.
+    std::filesystem::path state_path = directory_ / "state";
+    auto ignore = [&](std::string_view reason) {
+        std::cout << "INFO: Ignoring checkpoint " << directory_ << ": " << reason << ".\n";
+    };
+    if (std::filesystem::exists(state_path)) {
+        std::ifstream stream(state_path, std::ios::in | std::ios::binary);
+        char magic[8];
+        uint32_t version = 0;
+        uint64_t run_size = 0;
+        stream.read(magic, sizeof(magic));
+        read_state(stream, version);
+        read_state(stream, run_size);
+        std::string saved_run(stream ? run_size : 0, '\0');
+        stream.read(saved_run.data(), saved_run.size());
+        uint64_t next = 0;
+        read_state(stream, next);
+        read_state(stream, output_size_);
+        if (!stream || memcmp(magic, MAGIC, sizeof(MAGIC)) || version != VERSION) {
+            ignore("it was written by a different version");
+        } else if (saved_run != run_) {
+            ignore("it was saved by a different conversion");
+        } else {
+            resuming_ = true;
+            state_offset_ = sizeof(MAGIC) + sizeof(uint32_t) + sizeof(uint64_t) + run_size;
+            std::cout << "INFO: Resuming from checkpoint " << directory_ << ".\n";
+        }
+    }
+    if (resuming_) {
+        voxelizer.restore_chunks(directory_ / "chunks");
+    } else {
+        std::filesystem::remove_all(directory_);
+        std::filesystem::create_directories(directory_);
+    }
+    start_ = last_save_ = std::chrono::steady_clock::now();
+}
+
+std::ofstream ConstructionCheckpoint::open_output(const std::filesystem::path &path) {
+    if (!resuming_) {
+        return std::ofstream(path, std::ios::out | std::ios::binary);
+    }
+    ASSERT(std::filesystem::exists(path) &&
+               std::filesystem::file_size(path) >= static_cast<uint64_t>(output_size_) * sizeof(uint32_t),
+           "The output of the checkpointed conversion is missing or was truncated.");
+    std::filesystem::resize_file(path, static_cast<uint64_t>(output_size_) * sizeof(uint32_t));
+    return std::ofstream(path, std::ios::in | std::ios::out | std::ios::binary);
+}
+
+void ConstructionCheckpoint::write_header(std::ofstream &stream) const {
+    stream.write(MAGIC, sizeof(MAGIC));
+    write_state(stream, VERSION);
+    write_state(stream, static_cast<uint64_t>(run_.size()));
+    stream.write(run_.data(), run_.size());
+}
+
+void ConstructionCheckpoint::finish_save(std::chrono::steady_clock::time_point start,
+                                         uint64_t next) {
+    last_save_ = std::chrono::steady_clock::now();
+    save_time_ += last_save_ - start;
+    ++num_saves_;
+    std::cout << "INFO: Saved checkpoint at iteration " << next
+              << " of the outermost level in "
+              << std::chrono::duration<double>(last_save_ - start).count() << " s.\n";
+}
+
+void ConstructionCheckpoint::finish() {
+    if (!enabled_) {
+        return;
+    }
+    double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    std::cout << "INFO: Saved " << num_saves_ << " checkpoints, taking "
+              << save_time_.count() << " s, "
+              << (total_time > 0.0 ? 100.0 * save_time_.count() / total_time : 0.0)
+              << "% of the conversion's " << total_time << " s.\n";
+    std::filesystem::remove_all(directory_);
+}
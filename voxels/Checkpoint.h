@@ -0,0 +1,176 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Voxelize.h"
+#include "utils/Assert.h"
+
+// Periodically saves the state of a generated construction, so a conversion
+// that crashes or runs out of memory can be restarted from where it was
+// instead of from scratch. A checkpoint is a directory holding the chunks
+// voxelized so far (see Voxelizer::save_chunks) and a state file with the
+// position of the outermost level's loop, that level's queues or node,
+// deduplication map and is_empty, and how many words of output had been
+// written. Inner levels are only ever checkpointed between the outer
+// level's iterations, when none of their state is live.
+class ConstructionCheckpoint {
+  public:
+    // Bumped whenever the state file layout changes.
+    static constexpr uint32_t VERSION = 1;
+
+    // A checkpoint that's never saved and never resumes anything.
+    ConstructionCheckpoint() = default;
+
+    // Saves to directory at most every interval seconds. run identifies the
+    // conversion (model, resolution, format and so on). If directory holds a
+    // checkpoint of the same run, its chunks are restored into voxelizer and
+    // the construction resumes from it.
+    ConstructionCheckpoint(std::filesystem::path directory, std::string run,
+                           double interval, Voxelizer &voxelizer);
+
+    bool resuming() const {return resuming_;}
+
+    // Opens the construction's output. When resuming, the output is cut back
+    // to what had been written when the checkpoint was saved.
+    std::ofstream open_output(const std::filesystem::path &path);
+
+    // Whether it's time to save again. Cheap enough to call on every
+    // iteration of the outer level.
+    bool due() {
+        return enabled_ &&
+               std::chrono::steady_clock::now() - last_save_ >= interval_;
+    }
+
+    // Saves the construction's state, where next is the outer level's next
+    // iteration and state is the rest of its live variables.
+    template <typename... State>
+    void save(Voxelizer &voxelizer,
+              std::pair<std::ofstream &, uint32_t &> buffer, uint64_t next,
+              const State &...state) {
+        auto start = std::chrono::steady_clock::now();
+        voxelizer.save_chunks(directory_ / "chunks");
+        buffer.first.flush();
+        std::filesystem::path temporary_path = directory_ / "state.tmp";
+        std::ofstream stream(temporary_path, std::ios::out | std::ios::binary);
+        write_header(stream);
+        write_state(stream, next);
+        write_state(stream, buffer.second);
+        (write_state(stream, state), ...);
+        stream.close();
+        ASSERT(!stream.fail(), "Failed to write checkpoint.");
+        std::filesystem::rename(temporary_path, directory_ / "state");
+        finish_save(start, next);
+    }
+
+    // If resuming, sets next and the state to what was saved, and points
+    // the output at its end. Otherwise leaves them alone.
+    template <typename... State>
+    void restore(std::pair<std::ofstream &, uint32_t &> buffer,
+                 uint64_t &next, State &...state) {
+        if (!resuming_) {
+            return;
+        }
+        std::ifstream stream(directory_ / "state", std::ios::in | std::ios::binary);
+        stream.seekg(state_offset_);
+        read_state(stream, next);
+        read_state(stream, buffer.second);
+        (read_state(stream, state), ...);
+        ASSERT(!stream.fail(), "Checkpoint is truncated.");
+        buffer.first.seekp(static_cast<uint64_t>(buffer.second) * sizeof(uint32_t));
+        std::cout << "INFO: Resuming construction at iteration " << next
+                  << " of the outermost level.\n";
+    }
+
+    // Reports how much time checkpointing took, and removes the checkpoint,
+    // since the conversion it was for is done.
+    void finish();
+
+  private:
+    void write_header(std::ofstream &stream) const;
+    void finish_save(std::chrono::steady_clock::time_point start, uint64_t next);
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    static void write_state(std::ofstream &stream, const T &value) {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void write_state(std::ofstream &stream, const std::vector<T> &values) {
+        write_state(stream, static_cast<uint64_t>(values.size()));
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            stream.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+        } else {
+            for (const auto &value : values) {
+                write_state(stream, value);
+            }
+        }
+    }
+
+    template <typename K, typename V>
+    static void write_state(std::ofstream &stream, const std::unordered_map<K, V> &map) {
+        write_state(stream, static_cast<uint64_t>(map.size()));
+        for (const auto &[key, value] : map) {
+            write_state(stream, key);
+            write_state(stream, value);
+        }
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    static void read_state(std::ifstream &stream, T &value) {
+        stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void read_state(std::ifstream &stream, std::vector<T> &values) {
+        uint64_t size = 0;
+        read_state(stream, size);
+        values.resize(size);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            stream.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+        } else {
+            for (auto &value : values) {
+                read_state(stream, value);
+            }
+        }
+    }
+
+    template <typename K, typename V>
+    static void read_state(std::ifstream &stream, std::unordered_map<K, V> &map) {
+        uint64_t size = 0;
+        read_state(stream, size);
+        map.clear();
+        map.reserve(size);
+        for (uint64_t i = 0; i < size && stream; ++i) {
+            K key;
+            V value;
+            read_state(stream, key);
+            read_state(stream, value);
+            map.emplace(std::move(key), std::move(value));
+        }
+    }
+
+    bool enabled_ = false;
+    bool resuming_ = false;
+    std::filesystem::path directory_;
+    std::string run_;
+    std::chrono::duration<double> interval_{0.0};
+
+    // Where the saved state starts in the state file, past the header, and
+    // how many words of output it covers.
+    uint64_t state_offset_ = 0;
+    uint32_t output_size_ = 0;
+
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_save_;
+    std::chrono::duration<double> save_time_{0.0};
+    uint64_t num_saves_ = 0;
+};
@@ -1,43 +1,257 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <cstring>
+#include <future>
+#include <memory>
 
 #include <external/libmorton/include/libmorton/morton.h>
 
 #include "Conversion.h"
+#include "NodeWriter.h"
+#include "PackedNormal.h"
+#include "SVDAGNodeTable.h"
 #include "utils/Assert.h"
 
-struct RawColor {
-    uint8_t red_;
-    uint8_t green_;
-    uint8_t blue_;
-    uint8_t alpha_;
-};
-
 std::vector<std::byte> append_metadata_to_raw(const std::vector<std::byte> &raw,
                                               uint32_t width, uint32_t height,
                                               uint32_t depth) {
-    std::vector<std::byte> raw_data;
-    for (int i = 0; i < 3 * sizeof(uint32_t); i++) {
-        raw_data.emplace_back();
-    }
-
+    std::vector<std::byte> raw_data(3 * sizeof(uint32_t) + raw.size());
     memcpy(&raw_data.at(0), &width, sizeof(uint32_t));
     memcpy(&raw_data.at(sizeof(uint32_t)), &height, sizeof(uint32_t));
     memcpy(&raw_data.at(sizeof(uint32_t) * 2), &depth, sizeof(uint32_t));
-    for (uint32_t i = 0; i < raw.size(); i += 4) {
-        RawColor voxel = {.red_ = static_cast<uint8_t>(raw.at(i)),
-                          .green_ = static_cast<uint8_t>(raw.at(i + 1)),
-                          .blue_ = static_cast<uint8_t>(raw.at(i + 2)),
-                          .alpha_ = static_cast<uint8_t>(raw.at(i + 3))};
+    memcpy(raw_data.data() + sizeof(uint32_t) * 3, raw.data(), raw.size());
+    return raw_data;
+}
 
-        for (uint32_t i = 0; i < sizeof(RawColor); ++i) {
-            raw_data.emplace_back();
+// Tiles the voxels with Morton codes in [begin, end) with the fewest whole
+// subtrees of the power_of_two levels deep tree over the grid, and calls
+// visit(level, morton) for each, in order, where level is the depth of the
+// subtree's root and morton its first voxel.
+template <typename F>
+static void for_each_subtree(uint64_t begin, uint64_t end,
+                             uint32_t power_of_two, F &&visit) {
+    for (uint64_t morton = begin; morton < end;) {
+        uint32_t height = std::min<uint32_t>(std::countr_zero(morton) / 3, power_of_two);
+        while ((static_cast<uint64_t>(1) << (3 * height)) > end - morton) {
+            --height;
         }
+        visit(power_of_two - height, morton);
+        morton += static_cast<uint64_t>(1) << (3 * height);
+    }
+}
+
+// Walks the power_of_two levels deep grid of bricks in Morton order, and calls
+// visit(level, voxel) for each leaf, where level is power_of_two and voxel
+// points at its bytes. Runs of empty voxels between bricks are visited as the
+// fewest whole subtrees that tile them instead, with level set to the depth of
+// the subtree's root and voxel null. A subtree of empty leaves always
+// collapses into the same node as an empty leaf, so the builders push it
+// straight into its parent's queue.
+template <typename F>
+static void for_each_morton_leaf(const MortonBrickStream &bricks,
+                                 uint32_t power_of_two, F &&visit) {
+    const uint64_t num_voxels = static_cast<uint64_t>(1) << (3 * power_of_two);
+    uint64_t morton = 0;
+    auto skip_to = [&](uint64_t end) {
+        for_each_subtree(morton, end, power_of_two,
+                         [&](uint32_t level, uint64_t) { visit(level, nullptr); });
+        morton = std::max(morton, end);
+    };
 
-        memcpy(&raw_data.back() - sizeof(RawColor) + 1, &voxel,
-               sizeof(RawColor));
+    for (uint64_t i = 0; i < bricks.size(); ++i) {
+        uint64_t brick_start = bricks.keys[i] * MortonBrickStream::BRICK_VOLUME;
+        if (brick_start >= num_voxels) {
+            break;
+        }
+        skip_to(brick_start);
+        std::span<const std::byte> brick = bricks.brick(i);
+        uint64_t brick_end = std::min(brick_start + MortonBrickStream::BRICK_VOLUME, num_voxels);
+        for (; morton < brick_end; ++morton) {
+            visit(power_of_two, &brick[(morton - brick_start) * bricks.bytes_per_voxel]);
+        }
     }
-    // memcpy(&raw_data.at(sizeof(uint32_t) * 3), raw.data(), raw.size());
-    return raw_data;
+    skip_to(num_voxels);
+}
+
+MortonBrickStream make_brick_stream(const std::vector<std::byte> &raw,
+                                    uint32_t width, uint32_t height,
+                                    uint32_t depth, uint32_t bytes_per_voxel) {
+    constexpr uint32_t BRICK_EDGE = MortonBrickStream::BRICK_EDGE;
+    MortonBrickStream bricks;
+    bricks.width = width;
+    bricks.height = height;
+    bricks.depth = depth;
+    bricks.bytes_per_voxel = bytes_per_voxel;
+
+    std::vector<std::pair<uint64_t, uint64_t>> brick_keys;
+    std::vector<std::byte> brick_voxels(MortonBrickStream::BRICK_VOLUME * bytes_per_voxel);
+    std::vector<std::byte> unsorted_voxels;
+    for (uint32_t brick_z = 0; brick_z < depth; brick_z += BRICK_EDGE) {
+        for (uint32_t brick_y = 0; brick_y < height; brick_y += BRICK_EDGE) {
+            for (uint32_t brick_x = 0; brick_x < width; brick_x += BRICK_EDGE) {
+                std::fill(brick_voxels.begin(), brick_voxels.end(), std::byte(0));
+                bool is_empty = true;
+                for (uint32_t z = brick_z; z < std::min(brick_z + BRICK_EDGE, depth); ++z) {
+                    for (uint32_t y = brick_y; y < std::min(brick_y + BRICK_EDGE, height); ++y) {
+                        for (uint32_t x = brick_x; x < std::min(brick_x + BRICK_EDGE, width); ++x) {
+                            const std::byte *voxel = &raw[(x + y * static_cast<size_t>(width) +
+                                                           z * static_cast<size_t>(width) * height) *
+                                                          bytes_per_voxel];
+                            if (std::any_of(voxel, voxel + bytes_per_voxel,
+                                            [](std::byte b) { return b != std::byte(0); })) {
+                                is_empty = false;
+                                uint64_t in_brick = libmorton::morton3D_32_encode(
+                                    x - brick_x, y - brick_y, z - brick_z);
+                                memcpy(&brick_voxels[in_brick * bytes_per_voxel], voxel, bytes_per_voxel);
+                            }
+                        }
+                    }
+                }
+                if (!is_empty) {
+                    brick_keys.emplace_back(
+                        libmorton::morton3D_64_encode(brick_x / BRICK_EDGE, brick_y / BRICK_EDGE,
+                                                      brick_z / BRICK_EDGE),
+                        brick_keys.size());
+                    unsorted_voxels.insert(unsorted_voxels.end(), brick_voxels.begin(), brick_voxels.end());
+                }
+            }
+        }
+    }
+
+    std::sort(brick_keys.begin(), brick_keys.end());
+    bricks.voxels.resize(unsorted_voxels.size());
+    for (auto [key, i] : brick_keys) {
+        bricks.keys.push_back(key);
+        memcpy(&bricks.voxels[(bricks.keys.size() - 1) * brick_voxels.size()],
+               &unsorted_voxels[i * brick_voxels.size()], brick_voxels.size());
+    }
+    return bricks;
+}
+
+// Averages the children of a voxel one level up the mip pyramid. Empty
+// children are skipped, so the parent is only empty if all of them are.
+class ChildAverage {
+  public:
+    explicit ChildAverage(uint32_t bytes_per_voxel)
+        : bytes_per_voxel_(bytes_per_voxel) {}
+
+    void add(const std::byte *voxel) {
+        if (std::all_of(voxel, voxel + bytes_per_voxel_,
+                        [](std::byte b) { return b == std::byte(0); })) {
+            return;
+        }
+        if (!first_) {
+            first_ = voxel;
+        }
+        uint32_t color;
+        memcpy(&color, voxel, sizeof(uint32_t));
+        for (uint32_t channel = 0; channel < 4; ++channel) {
+            color_sum_[channel] += (color >> (channel * 8)) & 0xFF;
+        }
+        if (bytes_per_voxel_ == 2 * sizeof(uint32_t)) {
+            uint32_t normal;
+            memcpy(&normal, voxel + sizeof(uint32_t), sizeof(uint32_t));
+            normal_sum_ += unpack_normal(normal);
+        }
+        ++count_;
+    }
+
+    // Leaves out untouched if every child was empty.
+    void write(std::byte *out) const {
+        if (!count_) {
+            return;
+        }
+        uint32_t color = 0;
+        for (uint32_t channel = 0; channel < 4; ++channel) {
+            color |= ((color_sum_[channel] + count_ / 2) / count_) << (channel * 8);
+        }
+        memcpy(out, first_, bytes_per_voxel_);
+        // An average that rounds down to zero would read as empty, so the
+        // first child's color is kept instead. Likewise for normals that
+        // cancel out.
+        if (color) {
+            memcpy(out, &color, sizeof(uint32_t));
+        }
+        if (bytes_per_voxel_ == 2 * sizeof(uint32_t) && glm::length(normal_sum_) > 1e-6f) {
+            uint32_t normal = pack_normal(glm::normalize(normal_sum_));
+            memcpy(out + sizeof(uint32_t), &normal, sizeof(uint32_t));
+        }
+    }
+
+  private:
+    uint32_t bytes_per_voxel_;
+    const std::byte *first_ = nullptr;
+    uint32_t color_sum_[4] = {};
+    glm::vec3 normal_sum_ = glm::vec3(0.0f);
+    uint32_t count_ = 0;
+};
+
+std::vector<std::byte> downsample_raw(const std::vector<std::byte> &raw,
+                                      uint32_t width, uint32_t height,
+                                      uint32_t depth, uint32_t bytes_per_voxel) {
+    ASSERT(bytes_per_voxel == sizeof(uint32_t) || bytes_per_voxel == 2 * sizeof(uint32_t),
+           "Can only downsample voxels with the color or color and normal attributes.");
+    const uint32_t coarse_width = (width + 1) / 2, coarse_height = (height + 1) / 2,
+                   coarse_depth = (depth + 1) / 2;
+    std::vector<std::byte> coarse(static_cast<size_t>(coarse_width) * coarse_height *
+                                  coarse_depth * bytes_per_voxel);
+    for (uint32_t z = 0; z < coarse_depth; ++z) {
+        for (uint32_t y = 0; y < coarse_height; ++y) {
+            for (uint32_t x = 0; x < coarse_width; ++x) {
+                ChildAverage average(bytes_per_voxel);
+                for (uint32_t child_z = 2 * z; child_z < std::min(2 * z + 2, depth); ++child_z) {
+                    for (uint32_t child_y = 2 * y; child_y < std::min(2 * y + 2, height); ++child_y) {
+                        for (uint32_t child_x = 2 * x; child_x < std::min(2 * x + 2, width); ++child_x) {
+                            average.add(&raw[(child_x + child_y * static_cast<size_t>(width) +
+                                              child_z * static_cast<size_t>(width) * height) *
+                                             bytes_per_voxel]);
+                        }
+                    }
+                }
+                average.write(&coarse[(x + y * static_cast<size_t>(coarse_width) +
+                                       z * static_cast<size_t>(coarse_width) * coarse_height) *
+                                      bytes_per_voxel]);
+            }
+        }
+    }
+    return coarse;
+}
+
+MortonBrickStream downsample_bricks(const MortonBrickStream &bricks) {
+    constexpr uint32_t BRICK_VOLUME = MortonBrickStream::BRICK_VOLUME;
+    const uint32_t bytes_per_voxel = bricks.bytes_per_voxel;
+    ASSERT(bytes_per_voxel == sizeof(uint32_t) || bytes_per_voxel == 2 * sizeof(uint32_t),
+           "Can only downsample voxels with the color or color and normal attributes.");
+    MortonBrickStream coarse;
+    coarse.width = (bricks.width + 1) / 2;
+    coarse.height = (bricks.height + 1) / 2;
+    coarse.depth = (bricks.depth + 1) / 2;
+    coarse.bytes_per_voxel = bytes_per_voxel;
+
+    // A voxel's eight children are consecutive in Morton order, so coarse
+    // brick k is made of fine bricks 8k to 8k + 7, each of which shrinks
+    // into one eighth of it.
+    constexpr uint32_t CHILD_VOLUME = BRICK_VOLUME / 8;
+    std::vector<std::byte> brick_voxels(BRICK_VOLUME * bytes_per_voxel);
+    for (uint64_t i = 0; i < bricks.size();) {
+        const uint64_t key = bricks.keys[i] / 8;
+        std::fill(brick_voxels.begin(), brick_voxels.end(), std::byte(0));
+        for (; i < bricks.size() && bricks.keys[i] / 8 == key; ++i) {
+            std::span<const std::byte> brick = bricks.brick(i);
+            const uint64_t first_voxel = (bricks.keys[i] % 8) * CHILD_VOLUME;
+            for (uint32_t voxel = 0; voxel < CHILD_VOLUME; ++voxel) {
+                ChildAverage average(bytes_per_voxel);
+                for (uint32_t child = 0; child < 8; ++child) {
+                    average.add(&brick[(voxel * 8 + child) * bytes_per_voxel]);
+                }
+                average.write(&brick_voxels[(first_voxel + voxel) * bytes_per_voxel]);
+            }
+        }
+        coarse.keys.push_back(key);
+        coarse.voxels.insert(coarse.voxels.end(), brick_voxels.begin(), brick_voxels.end());
+    }
+    return coarse;
 }
 
 struct SVONode {
@@ -50,6 +264,14 @@ std::vector<std::byte> convert_raw_to_svo(const std::vector<std::byte> &raw,
                                           uint32_t width, uint32_t height,
                                           uint32_t depth,
                                           uint32_t bytes_per_voxel) {
+    return convert_raw_to_svo(
+        make_brick_stream(raw, width, height, depth, bytes_per_voxel));
+}
+
+std::vector<std::byte> convert_raw_to_svo(const MortonBrickStream &bricks) {
+    const uint32_t width = bricks.width, height = bricks.height,
+                   depth = bricks.depth;
+    const uint32_t bytes_per_voxel = bricks.bytes_per_voxel;
     static_assert(sizeof(SVONode) == 8);
     ASSERT(bytes_per_voxel <= sizeof(SVONode),
            "Can't convert a raw chunk to an SVO chunk whose voxels take up "
@@ -71,7 +293,6 @@ std::vector<std::byte> convert_raw_to_svo(const std::vector<std::byte> &raw,
         log2(static_cast<double>(width > height ? width > depth ? width : depth
                                  : height > depth ? height
                                                   : depth)));
-    const uint32_t bounded_edge_length = 1 << power_of_two;
 
     const uint32_t queue_size = 8;
     const uint32_t num_queues = power_of_two + 1;
@@ -80,45 +301,29 @@ std::vector<std::byte> convert_raw_to_svo(const std::vector<std::byte> &raw,
         queue.reserve(queue_size);
     }
 
-    std::vector<std::byte> svo;
-    for (uint32_t i = 0; i < sizeof(uint32_t) * 4; ++i) {
-        svo.emplace_back();
-    }
-    memcpy(&svo.at(0), &width, sizeof(uint32_t));
-    memcpy(&svo.at(sizeof(uint32_t)), &height, sizeof(uint32_t));
-    memcpy(&svo.at(sizeof(uint32_t) * 2), &depth, sizeof(uint32_t));
+    NodeWriter<SVONode> svo(std::vector<std::byte>(sizeof(uint32_t) * 4));
+    memcpy(&svo.prefix().at(0), &width, sizeof(uint32_t));
+    memcpy(&svo.prefix().at(sizeof(uint32_t)), &height, sizeof(uint32_t));
+    memcpy(&svo.prefix().at(sizeof(uint32_t) * 2), &depth, sizeof(uint32_t));
 
     auto push_node_to_svo = [&](SVONode node, bool internal) {
         if (internal) {
-            uint32_t new_size = static_cast<uint32_t>(
-                (svo.size() - sizeof(uint32_t) * 4) / sizeof(SVONode));
-            node.child_offset_ = new_size - node.child_offset_;
-        }
-        for (uint32_t i = 0; i < sizeof(SVONode); ++i) {
-            svo.emplace_back();
+            node.child_offset_ = static_cast<uint32_t>(svo.size()) - node.child_offset_;
         }
-        memcpy(&svo.back() - sizeof(SVONode) + 1, &node, sizeof(SVONode));
+        svo.push(node);
     };
 
-    const uint64_t num_voxels =
-        bounded_edge_length * bounded_edge_length * bounded_edge_length;
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t x = 0, y = 0, z = 0;
-        libmorton::morton3D_64_decode(morton, x, y, z);
-
+    for_each_morton_leaf(bricks, power_of_two,
+                         [&](uint32_t d, const std::byte *voxel) {
         SVONode node = EMPTY_SVO_NODE;
-        if (x < width && y < height && z < depth) {
-            size_t voxel_offset =
-                (x + y * width + z * width * height) * bytes_per_voxel;
-            memcpy(&node, &raw[voxel_offset], bytes_per_voxel);
+        if (voxel) {
+            memcpy(&node, voxel, bytes_per_voxel);
         }
 
-        queues.at(num_queues - 1).emplace_back(node, true);
-        uint32_t d = num_queues - 1;
+        queues.at(d).emplace_back(node, true);
         while (d > 0 && queues.at(d).size() == queue_size) {
             SVONode node{};
-            node.child_offset_ = static_cast<uint32_t>(
-                (svo.size() - sizeof(uint32_t) * 4) / sizeof(SVONode));
+            node.child_offset_ = static_cast<uint32_t>(svo.size());
             node.valid_mask_ = 0;
             node.leaf_mask_ = 0;
 
@@ -153,14 +358,13 @@ std::vector<std::byte> convert_raw_to_svo(const std::vector<std::byte> &raw,
             queues.at(d).clear();
             --d;
         }
-    }
+    });
     push_node_to_svo(queues.at(0).at(0).first, true);
 
-    const uint32_t num_nodes = static_cast<uint32_t>(
-        (svo.size() - sizeof(uint32_t) * 4) / sizeof(SVONode));
-    memcpy(&svo.at(sizeof(uint32_t) * 3), &num_nodes, sizeof(uint32_t));
+    const uint32_t num_nodes = static_cast<uint32_t>(svo.size());
+    memcpy(&svo.prefix().at(sizeof(uint32_t) * 3), &num_nodes, sizeof(uint32_t));
 
-    return svo;
+    return svo.finish();
 }
 
 static void debug_print_svo_leaf_helper(const std::span<const std::byte> &svo,
@@ -239,126 +443,73 @@ void debug_print_svo(const std::vector<std::byte> &svo,
     }
 }
 
-struct SVDAGNode {
-    uint32_t child_offsets_[8];
-
-    bool operator==(const SVDAGNode &other) const {
-        return child_offsets_[0] == other.child_offsets_[0] &&
-               child_offsets_[1] == other.child_offsets_[1] &&
-               child_offsets_[2] == other.child_offsets_[2] &&
-               child_offsets_[3] == other.child_offsets_[3] &&
-               child_offsets_[4] == other.child_offsets_[4] &&
-               child_offsets_[5] == other.child_offsets_[5] &&
-               child_offsets_[6] == other.child_offsets_[6] &&
-               child_offsets_[7] == other.child_offsets_[7];
-    }
-};
-
 static constexpr uint32_t SVDAG_INVALID_OFFSET = 0xFFFFFFFF;
 
-struct HashSVDAGNode {
-    size_t operator()(const SVDAGNode &node) const {
-        return node.child_offsets_[0] ^ (node.child_offsets_[1] << 4) ^
-               (node.child_offsets_[2] << 8) ^ (node.child_offsets_[3] << 12) ^
-               (node.child_offsets_[4] << 16) ^ (node.child_offsets_[5] << 20) ^
-               (node.child_offsets_[6] << 24) ^ (node.child_offsets_[7] << 28);
-    }
-};
-
 std::vector<std::byte> convert_raw_to_svdag(const std::vector<std::byte> &raw,
                                             uint32_t width, uint32_t height,
                                             uint32_t depth,
                                             uint32_t bytes_per_voxel) {
-    static_assert(sizeof(SVDAGNode) == 32);
-    ASSERT(bytes_per_voxel <= sizeof(SVDAGNode),
-           "Can't convert a raw chunk to an SVDAG chunk whose voxels take up "
-           "more space than an internal SVDAG node.");
+    return convert_raw_to_svdag(
+        make_brick_stream(raw, width, height, depth, bytes_per_voxel));
+}
 
-    const SVDAGNode EMPTY_SVDAG_NODE = []() {
-        SVDAGNode node;
-        memset(&node, 0, sizeof(SVDAGNode));
-        return node;
-    }();
-    auto nodes_equal = [&](const SVDAGNode &a, const SVDAGNode &b) {
-        return memcmp(&a, &b, sizeof(SVDAGNode)) == 0;
-    };
-    auto is_node_empty = [&](const SVDAGNode &node) {
-        return nodes_equal(node, EMPTY_SVDAG_NODE);
-    };
+// Builds an SVDAG bottom up, from the nodes of its power_of_two levels deep
+// tree pushed in Morton order. push(level, node, is_leaf) adds a node at depth
+// level, and once a parent's eight children are in, they're merged into it: a
+// parent whose children are all identical becomes that child, and otherwise
+// each non-empty child is appended to the SVDAG, unless an identical node
+// already was, and the parent points at it.
+class SVDAGBuilder {
+  public:
+    // Nodes are appended after whatever svdag already holds.
+    SVDAGBuilder(uint32_t power_of_two, std::vector<std::byte> svdag)
+        : queues_(power_of_two + 1), svdag_(std::move(svdag)) {
+        for (auto &queue : queues_) {
+            queue.reserve(QUEUE_SIZE);
+        }
+    }
 
-    const uint32_t power_of_two = ceil(
-        log2(static_cast<double>(width > height ? width > depth ? width : depth
-                                 : height > depth ? height
-                                                  : depth)));
-    const uint64_t bounded_edge_length = 1 << power_of_two;
+    static bool nodes_equal(const SVDAGNode &a, const SVDAGNode &b) {
+        return memcmp(&a, &b, sizeof(SVDAGNode)) == 0;
+    }
 
-    const uint32_t queue_size = 8;
-    const uint32_t num_queues = power_of_two + 1;
-    std::vector<std::vector<std::pair<SVDAGNode, bool>>> queues(num_queues);
-    for (auto &queue : queues) {
-        queue.reserve(queue_size);
+    static bool is_node_empty(const SVDAGNode &node) {
+        return nodes_equal(node, SVDAGNode{});
     }
 
-    std::vector<std::byte> svdag;
-    std::unordered_map<SVDAGNode, uint32_t, HashSVDAGNode>
-        already_inserted_nodes;
-    for (uint32_t i = 0; i < sizeof(uint32_t) * 4; ++i) {
-        svdag.emplace_back();
+    // Makes nodes identical to node, which is already at offset, point there
+    // rather than at a copy.
+    void reuse_node(const SVDAGNode &node, uint32_t offset) {
+        already_inserted_nodes_.try_emplace(node, offset);
     }
-    memcpy(&svdag.at(0), &width, sizeof(uint32_t));
-    memcpy(&svdag.at(sizeof(uint32_t)), &height, sizeof(uint32_t));
-    memcpy(&svdag.at(sizeof(uint32_t) * 2), &depth, sizeof(uint32_t));
 
-    auto push_node_to_svdag = [&](SVDAGNode node) {
+    uint32_t push_node(const SVDAGNode &node) {
         ASSERT(!is_node_empty(node), "Attempted to push an empty SVDAG node.");
-        if (already_inserted_nodes.contains(node)) {
-            return already_inserted_nodes.at(node);
-        } else {
-            uint32_t offset =
-                static_cast<uint32_t>(svdag.size() - sizeof(uint32_t) * 4) /
-                sizeof(SVDAGNode);
-            for (uint32_t i = 0; i < sizeof(SVDAGNode); ++i) {
-                svdag.emplace_back();
-            }
-            memcpy(&svdag.back() - sizeof(SVDAGNode) + 1, &node,
-                   sizeof(SVDAGNode));
-            already_inserted_nodes.emplace(node, offset);
-            return offset;
-        }
-    };
-
-    const uint64_t num_voxels =
-        bounded_edge_length * bounded_edge_length * bounded_edge_length;
-    uint32_t num_printed = 0;
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
-        uint_fast32_t x = 0, y = 0, z = 0;
-        libmorton::morton3D_64_decode(morton, x, y, z);
-
-        SVDAGNode leaf_node = EMPTY_SVDAG_NODE;
-        if (x < width && y < height && z < depth) {
-            size_t voxel_offset =
-                (x + y * width + z * width * height) * bytes_per_voxel;
-            memcpy(&leaf_node, &raw[voxel_offset], bytes_per_voxel);
+        auto [offset, inserted] = already_inserted_nodes_.try_emplace(node, num_nodes());
+        if (inserted) {
+            svdag_.push(node);
         }
+        return offset;
+    }
 
-        queues.at(num_queues - 1).emplace_back(leaf_node, true);
-        uint32_t d = num_queues - 1;
-        while (d > 0 && queues.at(d).size() == queue_size) {
+    void push(uint32_t d, const SVDAGNode &leaf_node, bool is_leaf) {
+        queues_.at(d).emplace_back(leaf_node, is_leaf);
+        while (d > 0 && queues_.at(d).size() == QUEUE_SIZE) {
             bool identical = true;
-            for (uint32_t i = 0; i < queue_size; ++i) {
-                identical = identical && nodes_equal(queues.at(d).at(i).first,
-                                                     queues.at(d).at(0).first);
+            for (uint32_t i = 0; i < QUEUE_SIZE; ++i) {
+                identical = identical && nodes_equal(queues_.at(d).at(i).first,
+                                                     queues_.at(d).at(0).first);
             }
 
             SVDAGNode node{};
             if (identical) {
-                node = queues.at(d).at(0).first;
+                node = queues_.at(d).at(0).first;
             } else {
-                for (uint32_t i = 0; i < queue_size; ++i) {
-                    const SVDAGNode &child = queues.at(d).at(i).first;
-                    const bool is_leaf = queues.at(d).at(i).second;
+                for (uint32_t i = 0; i < QUEUE_SIZE; ++i) {
+                    const SVDAGNode &child = queues_.at(d).at(i).first;
+                    const bool is_leaf = queues_.at(d).at(i).second;
                     if (!is_node_empty(child)) {
-                        uint32_t offset = push_node_to_svdag(child);
+                        uint32_t offset = push_node(child);
                         node.child_offsets_[i] =
                             offset | (static_cast<uint32_t>(is_leaf) << 31);
                     } else {
@@ -367,28 +518,454 @@ std::vector<std::byte> convert_raw_to_svdag(const std::vector<std::byte> &raw,
                 }
             }
 
-            queues.at(d - 1).emplace_back(
-                node, identical ? queues.at(d).at(0).second : false);
-            queues.at(d).clear();
+            queues_.at(d - 1).emplace_back(
+                node, identical ? queues_.at(d).at(0).second : false);
+            queues_.at(d).clear();
             --d;
         }
+    }
+
+    // The root and whether it's a leaf, once the whole tree was pushed.
+    const std::pair<SVDAGNode, bool> &root() const { return queues_.at(0).at(0); }
+
+    uint32_t num_nodes() const {
+        return static_cast<uint32_t>((svdag_.size_in_bytes() - sizeof(uint32_t) * 4) /
+                                     sizeof(SVDAGNode));
+    }
+
+    // The SVDAG it started with is the prefix, and the nodes pushed since
+    // are appended to it.
+    NodeWriter<SVDAGNode> &svdag() { return svdag_; }
+
+  private:
+    static constexpr uint32_t QUEUE_SIZE = 8;
+
+    std::vector<std::vector<std::pair<SVDAGNode, bool>>> queues_;
+    NodeWriter<SVDAGNode> svdag_;
+    SVDAGNodeTable already_inserted_nodes_;
+};
+
+// How many levels deep the SVDAG over a grid is.
+static uint32_t svdag_levels(uint32_t width, uint32_t height, uint32_t depth) {
+    return ceil(log2(static_cast<double>(width > height ? width > depth ? width : depth
+                                         : height > depth ? height
+                                                          : depth)));
+}
+
+std::vector<std::byte> convert_raw_to_svdag(const MortonBrickStream &bricks) {
+    const uint32_t width = bricks.width, height = bricks.height,
+                   depth = bricks.depth;
+    const uint32_t bytes_per_voxel = bricks.bytes_per_voxel;
+    static_assert(sizeof(SVDAGNode) == 32);
+    ASSERT(bytes_per_voxel <= sizeof(SVDAGNode),
+           "Can't convert a raw chunk to an SVDAG chunk whose voxels take up "
+           "more space than an internal SVDAG node.");
+
+    const uint32_t power_of_two = svdag_levels(width, height, depth);
+
+    std::vector<std::byte> svdag(sizeof(uint32_t) * 4);
+    memcpy(&svdag.at(0), &width, sizeof(uint32_t));
+    memcpy(&svdag.at(sizeof(uint32_t)), &height, sizeof(uint32_t));
+    memcpy(&svdag.at(sizeof(uint32_t) * 2), &depth, sizeof(uint32_t));
+    SVDAGBuilder builder(power_of_two, std::move(svdag));
+
+    const uint64_t num_voxels = static_cast<uint64_t>(1) << (3 * power_of_two);
+    uint64_t morton = 0;
+    uint32_t num_printed = 0;
+    for_each_morton_leaf(bricks, power_of_two,
+                         [&](uint32_t d, const std::byte *voxel) {
+        SVDAGNode leaf_node{};
+        if (voxel) {
+            memcpy(&leaf_node, voxel, bytes_per_voxel);
+        }
+        morton += static_cast<uint64_t>(1) << (3 * (power_of_two - d));
+        builder.push(d, leaf_node, true);
         if (morton * 100 / num_voxels - num_printed >= 10) {
             num_printed = morton * 100 / num_voxels;
             std::cout << num_printed << "% finished.\n";
         }
-    }
+    });
     std::cout << "100% finished.\n";
-    uint32_t root = push_node_to_svdag(queues.at(0).at(0).first);
+    uint32_t root = builder.push_node(builder.root().first);
 
-    const uint32_t num_nodes = static_cast<uint32_t>(
-        (svdag.size() - sizeof(uint32_t) * 4) / sizeof(SVDAGNode));
+    const uint32_t num_nodes = builder.num_nodes();
     ASSERT(root + 1 == num_nodes, "Root node in SVDAG is not the last node.");
 
+    memcpy(&builder.svdag().prefix().at(sizeof(uint32_t) * 3), &num_nodes, sizeof(uint32_t));
+
+    return builder.svdag().finish();
+}
+
+std::vector<std::byte> convert_raw_to_svdag(const MortonBrickStream &bricks,
+                                            uint32_t num_threads) {
+    const uint32_t bytes_per_voxel = bricks.bytes_per_voxel;
+    ASSERT(bytes_per_voxel <= sizeof(SVDAGNode),
+           "Can't convert a raw chunk to an SVDAG chunk whose voxels take up "
+           "more space than an internal SVDAG node.");
+    const auto start = std::chrono::steady_clock::now();
+    const uint32_t power_of_two = svdag_levels(bricks.width, bricks.height, bricks.depth);
+    const uint64_t num_voxels = static_cast<uint64_t>(1) << (3 * power_of_two);
+
+    num_threads = std::max(num_threads, 1U);
+    std::unique_ptr<ctpl::thread_pool> pool;
+    if (num_threads > 1) {
+        pool = std::make_unique<ctpl::thread_pool>(num_threads);
+    }
+    // Calls f(t, boundaries[t], boundaries[t + 1]) for every thread t.
+    auto for_each_range = [&](const std::vector<uint64_t> &boundaries, auto &&f) {
+        if (!pool) {
+            for (uint32_t t = 0; t < num_threads; ++t) {
+                f(t, boundaries[t], boundaries[t + 1]);
+            }
+            return;
+        }
+        std::vector<std::future<void>> futures;
+        for (uint32_t t = 0; t < num_threads; ++t) {
+            futures.push_back(pool->push(
+                [&f, &boundaries, t](int) { f(t, boundaries[t], boundaries[t + 1]); }));
+        }
+        for (auto &future : futures) {
+            future.get();
+        }
+    };
+    auto even_boundaries = [&](uint64_t size) {
+        std::vector<uint64_t> boundaries(num_threads + 1);
+        for (uint32_t t = 0; t <= num_threads; ++t) {
+            boundaries[t] = size * t / num_threads;
+        }
+        return boundaries;
+    };
+    // Turns how many items each thread's range produces into where the
+    // range's first item goes, followed by the total.
+    auto exclusive_sum = [](std::vector<uint64_t> counts) {
+        uint64_t total = 0;
+        for (uint64_t &count : counts) {
+            total += std::exchange(count, total);
+        }
+        counts.push_back(total);
+        return counts;
+    };
+
+    // A level's non-empty nodes, sorted by their Morton codes among the nodes
+    // of that level, and whether they're leaves. The arrays are left
+    // uninitialized, so the threads filling them in are the first to touch
+    // their pages, rather than one thread zeroing them.
+    struct Level {
+        uint64_t size = 0;
+        std::unique_ptr<uint64_t[]> keys;
+        std::unique_ptr<SVDAGNode[]> nodes;
+        std::unique_ptr<uint8_t[]> is_leaf;
+
+        void resize(uint64_t new_size) {
+            size = new_size;
+            keys.reset(new uint64_t[size]);
+            nodes.reset(new SVDAGNode[size]);
+            is_leaf.reset(new uint8_t[size]);
+        }
+    };
+
+    // The deepest level is the non-empty voxels.
+    Level level;
+    {
+        const std::vector<uint64_t> boundaries = even_boundaries(bricks.size());
+        auto for_each_voxel = [&](uint64_t begin, uint64_t end, auto &&visit) {
+            for (uint64_t i = begin; i < end; ++i) {
+                const uint64_t brick_start = bricks.keys[i] * MortonBrickStream::BRICK_VOLUME;
+                std::span<const std::byte> brick = bricks.brick(i);
+                for (uint64_t in_brick = 0; in_brick < MortonBrickStream::BRICK_VOLUME &&
+                                            brick_start + in_brick < num_voxels;
+                     ++in_brick) {
+                    const std::byte *voxel = &brick[in_brick * bytes_per_voxel];
+                    if (std::any_of(voxel, voxel + bytes_per_voxel,
+                                    [](std::byte b) { return b != std::byte(0); })) {
+                        visit(brick_start + in_brick, voxel);
+                    }
+                }
+            }
+        };
+        std::vector<uint64_t> counts(num_threads);
+        for_each_range(boundaries, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            for_each_voxel(begin, end, [&](uint64_t, const std::byte *) { ++counts[t]; });
+        });
+        const std::vector<uint64_t> firsts = exclusive_sum(std::move(counts));
+        level.resize(firsts.back());
+        for_each_range(boundaries, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            uint64_t j = firsts[t];
+            for_each_voxel(begin, end, [&](uint64_t morton, const std::byte *voxel) {
+                level.keys[j] = morton;
+                level.nodes[j] = SVDAGNode{};
+                memcpy(&level.nodes[j], voxel, bytes_per_voxel);
+                level.is_leaf[j] = true;
+                ++j;
+            });
+        });
+    }
+
+    // Nodes are deduplicated against every node written so far, with each
+    // thread owning the nodes whose hashes fall in its share of the tables.
+    std::vector<SVDAGNodeTable> tables(num_threads);
+    auto table_of = [&](const SVDAGNode &node) {
+        if (num_threads == 1) {
+            return 0U;
+        }
+        return static_cast<uint32_t>(
+            ((SVDAGNodeTable::hash_node(node) >> 32) * num_threads) >> 32);
+    };
+    enum class Resolved : uint8_t { Skipped, Found, New, Repeated };
+
+    std::vector<std::byte> svdag(sizeof(uint32_t) * 4);
+    memcpy(&svdag.at(0), &bricks.width, sizeof(uint32_t));
+    memcpy(&svdag.at(sizeof(uint32_t)), &bricks.height, sizeof(uint32_t));
+    memcpy(&svdag.at(sizeof(uint32_t) * 2), &bricks.depth, sizeof(uint32_t));
+    uint32_t num_nodes = 0;
+    for (uint32_t d = power_of_two; d > 0; --d) {
+        const uint64_t num_children = level.size;
+        ASSERT(num_nodes + num_children < SVDAG_INVALID_OFFSET,
+               "Too many nodes for an SVDAG's 32 bit offsets.");
+        auto starts_parent = [&](uint64_t i) {
+            return i == 0 || level.keys[i] >> 3 != level.keys[i - 1] >> 3;
+        };
+
+        // Threads split the children between them on their parents'
+        // boundaries, so each builds whole parents.
+        std::vector<uint64_t> boundaries = even_boundaries(num_children);
+        for (uint32_t t = 1; t < num_threads; ++t) {
+            boundaries[t] = std::max(boundaries[t], boundaries[t - 1]);
+            while (boundaries[t] < num_children && !starts_parent(boundaries[t])) {
+                ++boundaries[t];
+            }
+        }
+
+        // A parent whose eight children are identical becomes that child, the
+        // same as in SVDAGBuilder::push, and otherwise its children are
+        // written.
+        std::unique_ptr<Resolved[]> resolved(new Resolved[num_children]);
+        std::vector<uint64_t> parent_counts(num_threads);
+        std::vector<std::vector<std::vector<uint32_t>>> by_table(
+            num_threads, std::vector<std::vector<uint32_t>>(num_threads));
+        for_each_range(boundaries, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            for (uint64_t first = begin; first < end; ++parent_counts[t]) {
+                uint64_t last = first + 1;
+                bool identical = true;
+                for (; last < end && !starts_parent(last); ++last) {
+                    identical = identical &&
+                                SVDAGBuilder::nodes_equal(level.nodes[last], level.nodes[first]);
+                }
+                const bool collapses = identical && last - first == 8;
+                for (uint64_t i = first; i < last; ++i) {
+                    resolved[i] = collapses ? Resolved::Skipped : Resolved::New;
+                    if (!collapses) {
+                        by_table[t][table_of(level.nodes[i])].push_back(static_cast<uint32_t>(i));
+                    }
+                }
+                first = last;
+            }
+        });
+
+        // Each table's thread takes its nodes in Morton order, so the first of
+        // several identical new nodes is the one written. Until offsets are
+        // handed out, the new nodes map to num_nodes plus their index.
+        std::unique_ptr<uint32_t[]> offsets(new uint32_t[num_children]);
+        for_each_range(even_boundaries(num_threads), [&](uint32_t, uint64_t begin, uint64_t end) {
+            for (uint64_t table = begin; table < end; ++table) {
+                for (uint32_t t = 0; t < num_threads; ++t) {
+                    for (uint32_t i : by_table[t][table]) {
+                        auto [offset, inserted] = tables[table].try_emplace(
+                            level.nodes[i], num_nodes + i);
+                        offsets[i] = offset;
+                        if (!inserted) {
+                            resolved[i] = offset < num_nodes ? Resolved::Found : Resolved::Repeated;
+                        }
+                    }
+                }
+            }
+        });
+
+        // New nodes are written in Morton order after the levels below.
+        const std::vector<uint64_t> even = even_boundaries(num_children);
+        std::vector<uint64_t> new_counts(num_threads);
+        for_each_range(even, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            new_counts[t] = std::count(&resolved[begin], &resolved[end], Resolved::New);
+        });
+        const std::vector<uint64_t> first_new = exclusive_sum(std::move(new_counts));
+        svdag.resize(svdag.size() + first_new.back() * sizeof(SVDAGNode));
+        for_each_range(even, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            uint32_t offset = num_nodes + static_cast<uint32_t>(first_new[t]);
+            for (uint64_t i = begin; i < end; ++i) {
+                if (resolved[i] == Resolved::New) {
+                    offsets[i] = offset++;
+                    memcpy(svdag.data() + sizeof(uint32_t) * 4 + offsets[i] * sizeof(SVDAGNode),
+                           &level.nodes[i], sizeof(SVDAGNode));
+                }
+            }
+        });
+        for_each_range(even, [&](uint32_t, uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; ++i) {
+                if (resolved[i] == Resolved::Repeated) {
+                    offsets[i] = offsets[offsets[i] - num_nodes];
+                }
+            }
+        });
+        for_each_range(even_boundaries(num_threads), [&](uint32_t, uint64_t begin, uint64_t end) {
+            for (uint64_t table = begin; table < end; ++table) {
+                for (uint32_t t = 0; t < num_threads; ++t) {
+                    for (uint32_t i : by_table[t][table]) {
+                        if (resolved[i] == Resolved::New) {
+                            *tables[table].find(level.nodes[i]) = offsets[i];
+                        }
+                    }
+                }
+            }
+        });
+        num_nodes += static_cast<uint32_t>(first_new.back());
+
+        const std::vector<uint64_t> first_parent = exclusive_sum(std::move(parent_counts));
+        Level parents;
+        parents.resize(first_parent.back());
+        for_each_range(boundaries, [&](uint32_t t, uint64_t begin, uint64_t end) {
+            uint64_t j = first_parent[t];
+            for (uint64_t first = begin; first < end; ++j) {
+                parents.keys[j] = level.keys[first] >> 3;
+                if (resolved[first] == Resolved::Skipped) {
+                    parents.nodes[j] = level.nodes[first];
+                    parents.is_leaf[j] = level.is_leaf[first];
+                    first += 8;
+                    continue;
+                }
+                SVDAGNode &node = parents.nodes[j];
+                std::fill(std::begin(node.child_offsets_), std::end(node.child_offsets_),
+                          SVDAG_INVALID_OFFSET);
+                parents.is_leaf[j] = false;
+                do {
+                    node.child_offsets_[level.keys[first] & 7] =
+                        offsets[first] | (static_cast<uint32_t>(level.is_leaf[first]) << 31);
+                    ++first;
+                } while (first < end && !starts_parent(first));
+            }
+        });
+        level = std::move(parents);
+    }
+
+    ASSERT(level.size == 1, "Attempted to push an empty SVDAG node.");
+    svdag.resize(svdag.size() + sizeof(SVDAGNode));
+    memcpy(&svdag.back() - sizeof(SVDAGNode) + 1, &level.nodes[0], sizeof(SVDAGNode));
+    ++num_nodes;
     memcpy(&svdag.at(sizeof(uint32_t) * 3), &num_nodes, sizeof(uint32_t));
 
+    const auto end = std::chrono::steady_clock::now();
+    std::cout << "INFO: Built an SVDAG of " << num_nodes << " nodes a level at a time in "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms on " << num_threads << " threads.\n";
     return svdag;
 }
 
+std::vector<std::byte>
+update_svdag(std::vector<std::byte> svdag, const MortonBrickStream &bricks,
+             std::span<const std::pair<uint64_t, uint64_t>> dirty_ranges) {
+    uint32_t header[4];
+    ASSERT(svdag.size() >= sizeof(header) + sizeof(SVDAGNode),
+           "Can't update a malformed SVDAG.");
+    memcpy(header, svdag.data(), sizeof(header));
+    ASSERT(header[0] == bricks.width && header[1] == bricks.height &&
+               header[2] == bricks.depth,
+           "Can't update an SVDAG with a grid of a different size.");
+    ASSERT(header[3] > 0 && svdag.size() == sizeof(header) + header[3] * sizeof(SVDAGNode),
+           "Can't update a malformed SVDAG.");
+
+    const uint32_t power_of_two = svdag_levels(header[0], header[1], header[2]);
+    const uint64_t num_voxels = static_cast<uint64_t>(1) << (3 * power_of_two);
+    const uint64_t previous_size = svdag.size();
+    SVDAGBuilder builder(power_of_two, std::move(svdag));
+    auto node_at = [&](uint32_t offset) {
+        SVDAGNode node;
+        memcpy(&node,
+               builder.svdag().prefix().data() + sizeof(header) + offset * sizeof(SVDAGNode),
+               sizeof(SVDAGNode));
+        return node;
+    };
+
+    // New nodes identical to previous ones point at those, so the SVDAG stays
+    // as deduplicated as one converted from scratch. Hashing every node takes
+    // about as long as reading them in did.
+    for (uint32_t offset = 0; offset < header[3]; ++offset) {
+        builder.reuse_node(node_at(offset), offset);
+    }
+
+    // A subtree outside the dirty ranges is whatever node the previous SVDAG
+    // has for it, found by walking down from its root. A single node SVDAG is
+    // a leaf, and any leaf on the way down covers the whole subtree.
+    const SVDAGNode previous_root = node_at(header[3] - 1);
+    uint64_t num_reused = 0;
+    auto find_previous = [&](uint64_t morton, uint32_t level) {
+        std::pair<SVDAGNode, bool> node(previous_root, header[3] == 1);
+        for (uint32_t d = 0; d < level && !node.second; ++d) {
+            uint32_t child = node.first.child_offsets_[(morton >> (3 * (power_of_two - d - 1))) & 7];
+            if (child == SVDAG_INVALID_OFFSET) {
+                return std::pair<SVDAGNode, bool>(SVDAGNode{}, true);
+            }
+            node = {node_at(child & ~(1U << 31)), child >> 31};
+        }
+        ++num_reused;
+        return node;
+    };
+
+    uint64_t morton = 0;
+    auto push_subtrees = [&](uint64_t end, bool previous) {
+        for_each_subtree(morton, end, power_of_two, [&](uint32_t level, uint64_t start) {
+            auto [node, is_leaf] = previous ? find_previous(start, level)
+                                            : std::pair<SVDAGNode, bool>(SVDAGNode{}, true);
+            builder.push(level, node, is_leaf);
+        });
+        morton = std::max(morton, end);
+    };
+    uint64_t brick = 0;
+    for (auto [begin, end] : dirty_ranges) {
+        push_subtrees(std::min(begin, num_voxels), true);
+        end = std::min(end, num_voxels);
+        for (; brick < bricks.size() && bricks.keys[brick] * MortonBrickStream::BRICK_VOLUME < end;
+             ++brick) {
+            const uint64_t brick_start = bricks.keys[brick] * MortonBrickStream::BRICK_VOLUME;
+            ASSERT(brick_start >= morton, "Every brick must be in a dirty range.");
+            push_subtrees(brick_start, false);
+            std::span<const std::byte> voxels = bricks.brick(brick);
+            for (; morton < std::min(brick_start + MortonBrickStream::BRICK_VOLUME, end); ++morton) {
+                SVDAGNode leaf_node{};
+                memcpy(&leaf_node, &voxels[(morton - brick_start) * bricks.bytes_per_voxel],
+                       bricks.bytes_per_voxel);
+                builder.push(power_of_two, leaf_node, true);
+            }
+        }
+        push_subtrees(end, false);
+    }
+    ASSERT(brick == bricks.size(), "Every brick must be in a dirty range.");
+    push_subtrees(num_voxels, true);
+
+    // The root has to be the last node, so it's appended even if an
+    // identical node is already in the SVDAG, unless it's the previous root,
+    // in which case nothing changed. A grid of a single color is a single
+    // leaf, just as it would be if it were converted from scratch.
+    const auto [root, root_is_leaf] = builder.root();
+    ASSERT(!SVDAGBuilder::is_node_empty(root), "Attempted to push an empty SVDAG node.");
+    NodeWriter<SVDAGNode> &data = builder.svdag();
+    if (root_is_leaf) {
+        data.clear();
+        data.prefix().resize(sizeof(header));
+    } else if (SVDAGBuilder::nodes_equal(root, previous_root) && header[3] > 1) {
+        data.clear();
+        data.prefix().resize(previous_size - sizeof(SVDAGNode));
+    }
+    const uint32_t num_appended = builder.num_nodes() + 1 - header[3];
+    data.push(root);
+    const uint32_t num_nodes = builder.num_nodes();
+    memcpy(&data.prefix().at(sizeof(uint32_t) * 3), &num_nodes, sizeof(uint32_t));
+    std::cout << "INFO: Reused " << num_reused << " subtrees of the previous SVDAG, and "
+              << (root_is_leaf ? "replaced it with a single leaf"
+                               : "appended " + std::to_string(num_appended) + " nodes to its " +
+                                     std::to_string(header[3]))
+              << ".\n";
+    return data.finish();
+}
+
 static void
 debug_print_svdag_leaf_helper(const std::span<const std::byte> &svdag,
                               uint32_t bytes_per_voxel, uint32_t level) {
@@ -483,44 +1060,21 @@ void debug_print_svdag(const std::vector<std::byte> &svdag,
 
 std::vector<std::byte>
 convert_raw_color_to_df(const std::vector<std::byte> &raw, uint32_t width,
-                        uint32_t height, uint32_t depth, uint32_t max_dist) {
+                        uint32_t height, uint32_t depth, uint32_t max_dist,
+                        DistanceMetric metric) {
+    ASSERT(max_dist > 0 && max_dist <= 255,
+           "Distance fields store distances from 1 to 255 in a byte.");
+    const uint64_t num_voxels = static_cast<uint64_t>(width) * height * depth;
+    std::vector<bool> occupied(num_voxels);
+    for (uint64_t voxel = 0; voxel < num_voxels; ++voxel) {
+        occupied[voxel] = raw[voxel * 4 + 3] != static_cast<std::byte>(0);
+    }
+    std::vector<uint32_t> distances =
+        distance_transform(occupied, width, height, depth, max_dist, metric);
+
     std::vector<std::byte> df(raw);
-    for (uint32_t z = 0; z < depth; ++z) {
-        for (uint32_t y = 0; y < height; ++y) {
-            for (uint32_t x = 0; x < width; ++x) {
-                size_t voxel_offset = (x + y * width + z * width * height) * 4;
-                if (raw[voxel_offset + 3] != static_cast<std::byte>(0)) {
-                    df[voxel_offset + 3] = static_cast<std::byte>(0);
-                } else {
-                    uint32_t min_dist = max_dist;
-                    for (uint32_t kz = z > max_dist ? z - max_dist : 0;
-                         kz <= z + max_dist && kz < depth; ++kz) {
-                        for (uint32_t ky = y > max_dist ? y - max_dist : 0;
-                             ky <= y + max_dist && ky < height; ++ky) {
-                            for (uint32_t kx = x > max_dist ? x - max_dist : 0;
-                                 kx <= x + max_dist && kx < width; ++kx) {
-                                size_t kvoxel_offset =
-                                    (kx + ky * width + kz * width * height) * 4;
-                                if (raw[kvoxel_offset + 3] !=
-                                    static_cast<std::byte>(0)) {
-                                    uint32_t dist = (z > kz ? z - kz : kz - z) +
-                                                    (y > ky ? y - ky : ky - y) +
-                                                    (x > kx ? x - kx : kx - x);
-                                    if (dist < min_dist) {
-                                        min_dist = dist;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    ASSERT(min_dist > 0,
-                           "The minimum distance from an empty voxel to a "
-                           "non-empty voxel cannot be 0.");
-                    df[voxel_offset + 3] = static_cast<std::byte>(min_dist);
-                }
-            }
-        }
-        printf("%u/%u\n", z + 1, depth);
+    for (uint64_t voxel = 0; voxel < num_voxels; ++voxel) {
+        df[voxel * 4 + 3] = static_cast<std::byte>(distances[voxel]);
     }
     return df;
 }
@@ -1,16 +1,42 @@
 #pragma once
 
+#include "BrickStream.h"
+#include "DistanceTransform.h"
 #include "Voxel.h"
 
+// Prefixes the raw grid with its dimensions. Voxels are copied as they are,
+// so any attribute set's voxels are carried through.
 std::vector<std::byte> append_metadata_to_raw(const std::vector<std::byte> &raw,
                                               uint32_t width, uint32_t height,
                                               uint32_t depth);
 
+// Gathers the non-empty bricks of an x-major raw grid.
+MortonBrickStream make_brick_stream(const std::vector<std::byte> &raw,
+                                    uint32_t width, uint32_t height,
+                                    uint32_t depth, uint32_t bytes_per_voxel);
+
+// Builds the next level of a mip pyramid: a grid half the size along each
+// axis, rounding up, where a voxel is occupied if any of its 2x2x2 children
+// is. It takes the average color of its occupied children and, with the
+// ColorNormal attributes, the normalized sum of their normals.
+std::vector<std::byte> downsample_raw(const std::vector<std::byte> &raw,
+                                      uint32_t width, uint32_t height,
+                                      uint32_t depth, uint32_t bytes_per_voxel);
+
+// The same as downsample_raw, on the raw grid the bricks came from, but it
+// only visits the bricks. A coarse brick is made of eight consecutive fine
+// ones, so each level of the pyramid takes one pass over the one before.
+MortonBrickStream downsample_bricks(const MortonBrickStream &bricks);
+
 std::vector<std::byte> convert_raw_to_svo(const std::vector<std::byte> &raw,
                                           uint32_t width, uint32_t height,
                                           uint32_t depth,
                                           uint32_t bytes_per_voxel);
 
+// Builds the same SVO as converting the raw grid the bricks came from, but
+// only visits the bricks, so it takes time proportional to them.
+std::vector<std::byte> convert_raw_to_svo(const MortonBrickStream &bricks);
+
 void debug_print_svo(const std::vector<std::byte> &svo,
                      uint32_t bytes_per_voxel);
 
@@ -19,9 +45,37 @@ std::vector<std::byte> convert_raw_to_svdag(const std::vector<std::byte> &raw,
                                             uint32_t depth,
                                             uint32_t bytes_per_voxel);
 
+// Builds the same SVDAG as converting the raw grid the bricks came from, but
+// only visits the bricks, so it takes time proportional to them.
+std::vector<std::byte> convert_raw_to_svdag(const MortonBrickStream &bricks);
+
+// Builds an SVDAG of the same voxels on num_threads threads, a level at a
+// time from the leaves up: each level's parents are built from its nodes in
+// parallel, and the nodes are deduplicated against every one written before,
+// with the threads splitting the nodes between them by hash. Its nodes are
+// written a level at a time, so they're the same nodes as convert_raw_to_svdag
+// writes, but in a different order. The order doesn't depend on num_threads.
+std::vector<std::byte> convert_raw_to_svdag(const MortonBrickStream &bricks,
+                                            uint32_t num_threads);
+
+// Updates an SVDAG built by convert_raw_to_svdag after the voxels with Morton
+// codes in dirty_ranges (sorted and disjoint) changed to the ones in bricks,
+// which may only hold bricks in those ranges. Everything outside them reuses
+// the previous SVDAG's nodes where they are, so only the dirty subtrees and
+// their ancestors are built, and the ones the SVDAG doesn't have yet are
+// appended, along with a new root. Nodes that
+// became unreachable are left in place, until the model is converted from
+// scratch again.
+std::vector<std::byte>
+update_svdag(std::vector<std::byte> svdag, const MortonBrickStream &bricks,
+             std::span<const std::pair<uint64_t, uint64_t>> dirty_ranges);
+
 void debug_print_svdag(const std::vector<std::byte> &svdag,
                        uint32_t bytes_per_voxel);
 
+// Replaces each voxel's alpha with its distance to the nearest non-empty
+// voxel, capped at max_dist, or 0 if it's not empty itself.
 std::vector<std::byte>
 convert_raw_color_to_df(const std::vector<std::byte> &raw, uint32_t width,
-                        uint32_t height, uint32_t depth, uint32_t max_dist);
+                        uint32_t height, uint32_t depth, uint32_t max_dist,
+                        DistanceMetric metric = DistanceMetric::Manhattan);
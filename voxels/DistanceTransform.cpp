@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "DistanceTransform.h"
+
+namespace {
+
+// The grid's lines along one axis: how many cells each holds, how far apart
+// they are, and where each line starts.
+struct Lines {
+    uint64_t length;
+    uint64_t stride;
+    std::array<uint64_t, 2> counts;
+    std::array<uint64_t, 2> strides;
+
+    Lines(const std::array<uint32_t, 3> &dims, uint32_t axis) {
+        const std::array<uint64_t, 3> all_strides = {1, dims[0],
+                                                     static_cast<uint64_t>(dims[0]) * dims[1]};
+        length = dims[axis];
+        stride = all_strides[axis];
+        for (uint32_t other = 0, i = 0; other < 3; ++other) {
+            if (other != axis) {
+                counts[i] = dims[other];
+                strides[i] = all_strides[other];
+                ++i;
+            }
+        }
+    }
+
+    template <typename F> void for_each(F &&f) const {
+        for (uint64_t b = 0; b < counts[1]; ++b) {
+            for (uint64_t a = 0; a < counts[0]; ++a) {
+                f(a * strides[0] + b * strides[1]);
+            }
+        }
+    }
+};
+
+// Distances are summed up squared while they're Euclidean, and stay as they
+// are otherwise. Anything at or past the cap is stored as the cap: each pass
+// only adds to distances (or takes the larger of two), so what's past the cap
+// stays past it, and the capped distances come out the same.
+uint64_t along_axis(uint64_t cells, DistanceMetric metric) {
+    return metric == DistanceMetric::Euclidean ? cells * cells : cells;
+}
+
+// Rounds towards negative infinity, where integer division rounds towards 0.
+int64_t floor_div(int64_t numerator, int64_t denominator) {
+    int64_t quotient = numerator / denominator;
+    return quotient - ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0)));
+}
+
+// The first pass: each cell's distance along the axis to the nearest
+// occupied cell on its line, or other occupied cell if exclusive is set.
+void nearest_on_line(const std::vector<bool> &occupied, std::vector<uint32_t> &distances,
+                     const Lines &lines, bool exclusive, DistanceMetric metric, uint32_t cap) {
+    constexpr uint64_t NONE = ~static_cast<uint64_t>(0);
+    auto distance = [&](uint64_t cells) {
+        return static_cast<uint32_t>(std::min<uint64_t>(along_axis(cells, metric), cap));
+    };
+    lines.for_each([&](uint64_t start) {
+        uint64_t last = NONE;
+        for (uint64_t i = 0; i < lines.length; ++i) {
+            const uint64_t cell = start + i * lines.stride;
+            if (!exclusive && occupied[cell]) {
+                last = i;
+            }
+            distances[cell] = last == NONE ? cap : distance(i - last);
+            if (exclusive && occupied[cell]) {
+                last = i;
+            }
+        }
+        last = NONE;
+        for (uint64_t i = lines.length; i-- > 0;) {
+            const uint64_t cell = start + i * lines.stride;
+            if (!exclusive && occupied[cell]) {
+                last = i;
+            }
+            if (last != NONE) {
+                distances[cell] = std::min(distances[cell], distance(last - i));
+            }
+            if (exclusive && occupied[cell]) {
+                last = i;
+            }
+        }
+    });
+}
+
+// Every later pass: each cell's distance becomes the nearest any cell on its
+// line is to an occupied cell, counting the distance to that cell along the
+// axis. Manhattan distances only need a sweep each way. The others keep the
+// lower envelope of the cells' distance functions, as Meijster, Roerdink and
+// Hesselink do, where sep(i, u) is the last cell closer through i than u.
+void fold_in_axis(std::vector<uint32_t> &distances, const Lines &lines, DistanceMetric metric,
+                  uint32_t cap) {
+    std::vector<uint32_t> line(lines.length);
+    std::vector<int64_t> starts(lines.length), owners(lines.length);
+    auto f = [&](int64_t x, int64_t i) -> int64_t {
+        const int64_t along = x > i ? x - i : i - x;
+        return metric == DistanceMetric::Euclidean ? along * along + line[i]
+                                                   : std::max<int64_t>(along, line[i]);
+    };
+    auto sep = [&](int64_t i, int64_t u) -> int64_t {
+        const int64_t g_i = line[i], g_u = line[u];
+        if (metric == DistanceMetric::Euclidean) {
+            return floor_div(u * u - i * i + g_u - g_i, 2 * (u - i));
+        }
+        return g_i <= g_u ? std::max(i + g_u, (i + u) / 2) : std::min(u - g_i, (i + u) / 2);
+    };
+
+    lines.for_each([&](uint64_t start) {
+        for (uint64_t i = 0; i < lines.length; ++i) {
+            line[i] = distances[start + i * lines.stride];
+        }
+
+        if (metric == DistanceMetric::Manhattan) {
+            for (uint64_t i = 1; i < lines.length; ++i) {
+                line[i] = std::min(line[i], line[i - 1] + 1);
+            }
+            for (uint64_t i = lines.length - 1; i-- > 0;) {
+                line[i] = std::min(line[i], line[i + 1] + 1);
+            }
+            for (uint64_t i = 0; i < lines.length; ++i) {
+                distances[start + i * lines.stride] = std::min(line[i], cap);
+            }
+            return;
+        }
+
+        const int64_t length = static_cast<int64_t>(lines.length);
+        int64_t q = 0;
+        owners[0] = 0;
+        starts[0] = 0;
+        for (int64_t u = 1; u < length; ++u) {
+            while (q >= 0 && f(starts[q], owners[q]) > f(starts[q], u)) {
+                --q;
+            }
+            if (q < 0) {
+                q = 0;
+                owners[0] = u;
+            } else {
+                const int64_t w = 1 + sep(owners[q], u);
+                if (w < length) {
+                    ++q;
+                    owners[q] = u;
+                    starts[q] = w;
+                }
+            }
+        }
+        for (int64_t u = length - 1; u >= 0; --u) {
+            distances[start + u * lines.stride] =
+                static_cast<uint32_t>(std::min<int64_t>(f(u, owners[q]), cap));
+            if (u == starts[q]) {
+                --q;
+            }
+        }
+    });
+}
+
+} // namespace
+
+std::vector<uint32_t> distance_transform(const std::vector<bool> &occupied, uint32_t width,
+                                         uint32_t height, uint32_t depth, uint32_t max_dist,
+                                         DistanceMetric metric, bool exclude_self) {
+    const uint64_t num_cells = static_cast<uint64_t>(width) * height * depth;
+    std::vector<uint32_t> distances(num_cells);
+    if (!num_cells) {
+        return distances;
+    }
+
+    const std::array<uint32_t, 3> dims = {width, height, depth};
+    const std::array<Lines, 3> lines = {Lines(dims, 0), Lines(dims, 1), Lines(dims, 2)};
+    const uint32_t cap = static_cast<uint32_t>(along_axis(max_dist, metric));
+
+    nearest_on_line(occupied, distances, lines[0], exclude_self, metric, cap);
+    fold_in_axis(distances, lines[1], metric, cap);
+    fold_in_axis(distances, lines[2], metric, cap);
+
+    // A cell's nearest other occupied cell is somewhere else along x, or at
+    // the same x but somewhere else along y, or at the same x and y but
+    // somewhere else along z. The passes above only covered the first.
+    if (exclude_self) {
+        std::vector<uint32_t> same_x(num_cells);
+        nearest_on_line(occupied, same_x, lines[1], true, metric, cap);
+        fold_in_axis(same_x, lines[2], metric, cap);
+        for (uint64_t cell = 0; cell < num_cells; ++cell) {
+            distances[cell] = std::min(distances[cell], same_x[cell]);
+        }
+        nearest_on_line(occupied, same_x, lines[2], true, metric, cap);
+        for (uint64_t cell = 0; cell < num_cells; ++cell) {
+            distances[cell] = std::min(distances[cell], same_x[cell]);
+        }
+    }
+
+    if (metric == DistanceMetric::Euclidean) {
+        for (uint32_t &distance : distances) {
+            uint32_t root = static_cast<uint32_t>(std::sqrt(static_cast<double>(distance)));
+            while (static_cast<uint64_t>(root) * root > distance) {
+                --root;
+            }
+            while (static_cast<uint64_t>(root + 1) * (root + 1) <= distance) {
+                ++root;
+            }
+            distance = root;
+        }
+    }
+    return distances;
+}
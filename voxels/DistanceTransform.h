@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// How distances between voxels are measured. The shaders step through
+// distance fields assuming Manhattan distances, so the other metrics are only
+// safe to trace with shaders that assume them.
+enum class DistanceMetric {
+    Manhattan,
+    Chebyshev,
+    Euclidean,
+};
+
+// For every cell of a width x height x depth grid, laid out x first, then y,
+// then z, the distance to the nearest occupied cell, capped at max_dist.
+// Occupied cells are 0 away from themselves, unless exclude_self is set, in
+// which case every cell gets the distance to the nearest occupied cell other
+// than itself. Euclidean distances are rounded down, so they never overshoot.
+//
+// It's separable: the distances along one axis are found first, then each
+// following pass folds in one more axis, taking the lower envelope of the
+// previous pass's distances along each line. Every pass takes time linear in
+// the number of cells, however large max_dist is.
+std::vector<uint32_t> distance_transform(const std::vector<bool> &occupied, uint32_t width,
+                                         uint32_t height, uint32_t depth, uint32_t max_dist,
+                                         DistanceMetric metric = DistanceMetric::Manhattan,
+                                         bool exclude_self = false);
@@ -0,0 +1,87 @@
+#include <cstring>
+
+#include "LODFile.h"
+#include "utils/Assert.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'I', 'V', 'S', 'L', 'O', 'D', '\0', '\0'};
+
+// The header is followed by a table with a LevelHeader per level, and then
+// the levels themselves, finest first, each starting 16 byte aligned.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t attribute_set;
+    uint32_t num_levels;
+};
+
+uint64_t align_offset(uint64_t offset) {
+    return (offset + 15) & ~static_cast<uint64_t>(15);
+}
+
+}
+
+void LODFile::write(const std::filesystem::path &path,
+                    VoxelChunk::Format format,
+                    VoxelChunk::AttributeSet attribute_set,
+                    const std::vector<Level> &levels) {
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.format = static_cast<uint32_t>(format);
+    header.attribute_set = static_cast<uint32_t>(attribute_set);
+    header.num_levels = levels.size();
+
+    std::vector<LevelHeader> level_headers;
+    uint64_t offset = align_offset(sizeof(Header) + levels.size() * sizeof(LevelHeader));
+    for (const auto &level : levels) {
+        level_headers.push_back({level.width, level.height, level.depth, 0,
+                                 offset, level.data.size()});
+        offset = align_offset(offset + level.data.size());
+    }
+
+    std::ofstream stream(path, std::ios::out | std::ios::binary);
+    auto pad_to = [&](uint64_t position) {
+        static constexpr char zeros[16] = {};
+        stream.write(zeros, position - static_cast<uint64_t>(stream.tellp()));
+    };
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    stream.write(reinterpret_cast<const char *>(level_headers.data()),
+                 level_headers.size() * sizeof(LevelHeader));
+    for (uint32_t i = 0; i < levels.size(); ++i) {
+        pad_to(level_headers[i].offset);
+        stream.write(reinterpret_cast<const char *>(levels[i].data.data()),
+                     levels[i].data.size());
+    }
+    stream.close();
+    ASSERT(!stream.fail(), "Failed to write the LOD file.");
+    std::cout << "INFO: Wrote " << levels.size() << " levels of detail to " << path << ".\n";
+}
+
+LODFile::LODFile(const std::filesystem::path &path)
+    : stream_(path, std::ios::in | std::ios::binary) {
+    Header header;
+    stream_.read(reinterpret_cast<char *>(&header), sizeof(Header));
+    ASSERT(!stream_.fail() && !memcmp(header.magic, MAGIC, sizeof(MAGIC)),
+           "Not a LOD file.");
+    ASSERT(header.version == VERSION, "LOD file was written by a different version.");
+    format_ = static_cast<VoxelChunk::Format>(header.format);
+    attribute_set_ = static_cast<VoxelChunk::AttributeSet>(header.attribute_set);
+    levels_.resize(header.num_levels);
+    stream_.read(reinterpret_cast<char *>(levels_.data()),
+                 levels_.size() * sizeof(LevelHeader));
+    ASSERT(!stream_.fail(), "LOD file is truncated.");
+}
+
+LODFile::Level LODFile::read_level(uint32_t level) {
+    ASSERT(level < levels_.size(), "LOD file doesn't have that many levels.");
+    const LevelHeader &level_header = levels_[level];
+    Level result = {level_header.width, level_header.height, level_header.depth,
+                    std::vector<std::byte>(level_header.size)};
+    stream_.seekg(level_header.offset);
+    stream_.read(reinterpret_cast<char *>(result.data.data()), result.data.size());
+    ASSERT(!stream_.fail(), "LOD file is truncated.");
+    return result;
+}
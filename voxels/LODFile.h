@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Voxel.h"
+
+// A model at several levels of detail, stored in one .lod file. Level 0 is
+// the full resolution grid, and each level after it is the previous one
+// downsampled, so half its size along each axis, rounding up. Every level
+// holds exactly the bytes a single level file of the model's format would,
+// and the header records where each one starts, so readers can load only
+// the levels they need, one at a time.
+class LODFile {
+  public:
+    // Bumped whenever the file layout changes.
+    static constexpr uint32_t VERSION = 1;
+
+    struct Level {
+        uint32_t width, height, depth;
+        std::vector<std::byte> data;
+    };
+
+    static void write(const std::filesystem::path &path,
+                      VoxelChunk::Format format,
+                      VoxelChunk::AttributeSet attribute_set,
+                      const std::vector<Level> &levels);
+
+    // Only reads the header. Levels are read on demand by read_level.
+    explicit LODFile(const std::filesystem::path &path);
+
+    uint32_t get_num_levels() const {return levels_.size();}
+    VoxelChunk::Format get_format() const {return format_;}
+    VoxelChunk::AttributeSet get_attribute_set() const {return attribute_set_;}
+
+    Level read_level(uint32_t level);
+
+  private:
+    struct LevelHeader {
+        uint32_t width, height, depth;
+        uint32_t padding;
+        uint64_t offset, size;
+    };
+
+    std::ifstream stream_;
+    VoxelChunk::Format format_;
+    VoxelChunk::AttributeSet attribute_set_;
+    std::vector<LevelHeader> levels_;
+};
@@ -0,0 +1,99 @@
+#include <fstream>
+
+#include "MappedFile.h"
+
+#if defined(WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define IVS_POSIX_MAPPING
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    if (!data_ || !buffer_.empty()) {
+        return;
+    }
+#if defined(WIN32)
+    UnmapViewOfFile(data_);
+#elif defined(IVS_POSIX_MAPPING)
+    munmap(const_cast<std::byte *>(data_), size_);
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::filesystem::path &path,
+                                             bool sequential) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+#if defined(WIN32)
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING,
+                                sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return nullptr;
+    }
+    file->size_ = size.QuadPart;
+    // Empty files can't be mapped, and there's nothing to map anyway.
+    if (file->size_) {
+        HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (!view) {
+            CloseHandle(handle);
+            return nullptr;
+        }
+        file->data_ = static_cast<const std::byte *>(view);
+    }
+    CloseHandle(handle);
+#elif defined(IVS_POSIX_MAPPING)
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(descriptor, &file_stat)) {
+        close(descriptor);
+        return nullptr;
+    }
+    file->size_ = file_stat.st_size;
+    if (file->size_) {
+        void *mapping = mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close(descriptor);
+            return nullptr;
+        }
+        if (sequential) {
+            madvise(mapping, file->size_, MADV_SEQUENTIAL);
+        }
+        file->data_ = static_cast<const std::byte *>(mapping);
+    }
+    close(descriptor);
+#else
+    (void) sequential;
+    std::ifstream stream(path, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!stream) {
+        return nullptr;
+    }
+    file->size_ = static_cast<uint64_t>(stream.tellg());
+    if (file->size_) {
+        file->buffer_.resize(file->size_);
+        stream.seekg(0);
+        if (!stream.read(reinterpret_cast<char *>(file->buffer_.data()), file->size_)) {
+            return nullptr;
+        }
+        file->data_ = file->buffer_.data();
+    }
+#endif
+    return file;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// The contents of a whole file, read-only. It's memory-mapped on POSIX
+// systems and Windows, and read into a buffer anywhere else, so callers
+// don't have to care which.
+class MappedFile {
+  public:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    // Maps the file at path, or returns null if it can't be opened or
+    // mapped. If sequential is set, the mapping is read front to back, so
+    // the system can read ahead of it.
+    static std::unique_ptr<MappedFile> open(const std::filesystem::path &path,
+                                            bool sequential = false);
+
+    // Null for an empty file.
+    const std::byte *data() const {return data_;}
+    uint64_t size() const {return size_;}
+
+  private:
+    MappedFile() = default;
+
+    const std::byte *data_ = nullptr;
+    uint64_t size_ = 0;
+    // Only used where files can't be mapped.
+    std::vector<std::byte> buffer_;
+};
@@ -0,0 +1,349 @@
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <type_traits>
+
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "utils/Assert.h"
+
+static_assert(std::is_trivially_copyable_v<Triangle>,
+              "Triangles are copied to and from the mesh cache bytewise.");
+
+namespace {
+
+constexpr char MAGIC[8] = {'I', 'V', 'S', 'M', 'E', 'S', 'H', '\0'};
+constexpr char SNAPSHOT_MAGIC[8] = {'I', 'V', 'S', 'S', 'N', 'A', 'P', '\0'};
+
+// The cache starts with a header, then the dependencies (each a
+// DependencyHeader followed by its path), then the triangles, the texture
+// table and finally every texture's pixels. Sections start 16 byte aligned.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t triangle_size;
+    float min[3];
+    float max[3];
+    uint32_t has_materials;
+    uint32_t num_dependencies;
+    uint64_t content_hash;
+    uint64_t num_triangles;
+    uint64_t triangles_offset;
+    uint64_t num_textures;
+    uint64_t textures_offset;
+};
+
+struct DependencyHeader {
+    int64_t mtime;
+    uint64_t size;
+    uint64_t path_length;
+};
+
+// A snapshot is a copy of a cache with the run it was taken for appended,
+// followed by this.
+struct SnapshotTrailer {
+    uint64_t run_length;
+    char magic[8];
+};
+
+struct TextureHeader {
+    int32_t material_id;
+    int32_t width;
+    int32_t height;
+    int32_t padding;
+    uint64_t pixels_offset;
+};
+
+uint64_t align_offset(uint64_t offset) { return (offset + 15) & ~15ULL; }
+
+int64_t get_mtime(const std::filesystem::path &path) {
+    return std::filesystem::last_write_time(path).time_since_epoch().count();
+}
+
+// FNV-1a over 8 byte words, which is plenty to tell whether a model changed
+// and a lot faster than hashing byte by byte.
+uint64_t hash_files(const std::vector<std::filesystem::path> &paths) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&](uint64_t word) {
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    };
+    std::vector<char> buffer(1 << 20);
+    for (const auto &path : paths) {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        while (stream.read(buffer.data(), buffer.size()) || stream.gcount()) {
+            uint64_t num_read = stream.gcount();
+            uint64_t num_words = num_read / sizeof(uint64_t);
+            for (uint64_t i = 0; i < num_words; ++i) {
+                uint64_t word;
+                memcpy(&word, buffer.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+                mix(word);
+            }
+            for (uint64_t i = num_words * sizeof(uint64_t); i < num_read; ++i) {
+                mix(static_cast<unsigned char>(buffer[i]));
+            }
+        }
+        mix(std::filesystem::file_size(path));
+    }
+    return hash;
+}
+
+// Appended to the path of a file being written, so other processes writing
+// the same file at the same time write to a different temporary file.
+std::string temporary_suffix() {
+    std::random_device device;
+    std::ostringstream suffix;
+    suffix << ".tmp" << std::hex << device() << device();
+    return suffix.str();
+}
+
+// Writes the file at path with write_contents(stream), into a temporary file
+// that's then renamed into place, since other conversions of the same model
+// may be writing it at the same time. Returns whether it was written, and
+// leaves no temporary file behind if it wasn't.
+template <typename F> bool replace_file(const std::filesystem::path &path, F &&write_contents) {
+    std::filesystem::path temporary_path = path;
+    temporary_path += temporary_suffix();
+    std::error_code error;
+    std::ofstream stream(temporary_path, std::ios::out | std::ios::binary);
+    if (stream) {
+        write_contents(stream);
+    }
+    stream.close();
+    if (!stream.fail()) {
+        std::filesystem::rename(temporary_path, path, error);
+        if (!error) {
+            return true;
+        }
+    }
+    std::filesystem::remove(temporary_path, error);
+    return false;
+}
+
+} // namespace
+
+std::filesystem::path MeshCache::get_cache_path(std::string_view obj_path) {
+    return std::filesystem::path(obj_path).replace_extension(".ivsmesh");
+}
+
+MeshCache::~MeshCache() = default;
+
+std::unique_ptr<MeshCache> MeshCache::open(std::string_view obj_path) {
+    return open_file(get_cache_path(obj_path), std::nullopt);
+}
+
+std::unique_ptr<MeshCache> MeshCache::open_snapshot(const std::filesystem::path &snapshot_path,
+                                                    std::string_view run) {
+    return open_file(snapshot_path, run);
+}
+
+void MeshCache::write_snapshot(std::string_view obj_path,
+                               const std::filesystem::path &snapshot_path,
+                               std::string_view run) {
+    SnapshotTrailer trailer = {run.size(), {}};
+    memcpy(trailer.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    bool written = replace_file(snapshot_path, [&](std::ofstream &stream) {
+        std::ifstream cache(get_cache_path(obj_path), std::ios::in | std::ios::binary);
+        stream << cache.rdbuf();
+        stream.write(run.data(), run.size());
+        stream.write(reinterpret_cast<const char *>(&trailer), sizeof(SnapshotTrailer));
+    });
+    ASSERT(written, "Failed to write the mesh snapshot.");
+    std::cout << "INFO: Wrote mesh snapshot " << snapshot_path << ".\n";
+}
+
+std::unique_ptr<MeshCache> MeshCache::open_file(const std::filesystem::path &cache_path,
+                                                std::optional<std::string_view> run) {
+    std::unique_ptr<MeshCache> cache(new MeshCache());
+    cache->file_ = MappedFile::open(cache_path);
+    if (!cache->file_ || cache->file_->size() < sizeof(Header)) {
+        return nullptr;
+    }
+
+    // Every offset is checked against the size of the file, so a truncated
+    // cache is treated as a stale one.
+    const std::byte *data = cache->file_->data();
+    uint64_t size = cache->file_->size();
+    auto stale = [&](std::string_view reason) -> std::unique_ptr<MeshCache> {
+        std::cout << "INFO: Ignoring mesh " << (run ? "snapshot " : "cache ")
+                  << cache_path << ": " << reason << ".\n";
+        return nullptr;
+    };
+    if (run) {
+        SnapshotTrailer trailer;
+        if (size < sizeof(Header) + sizeof(SnapshotTrailer)) {
+            return stale("it's truncated");
+        }
+        memcpy(&trailer, data + size - sizeof(SnapshotTrailer), sizeof(SnapshotTrailer));
+        if (memcmp(trailer.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+            trailer.run_length > size - sizeof(Header) - sizeof(SnapshotTrailer)) {
+            return stale("it isn't a snapshot");
+        }
+        size -= sizeof(SnapshotTrailer) + trailer.run_length;
+        if (std::string_view(reinterpret_cast<const char *>(data + size), trailer.run_length) != *run) {
+            return stale("it was taken for a different conversion");
+        }
+    }
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION ||
+        header.triangle_size != sizeof(Triangle)) {
+        return stale("it was written by a different version");
+    }
+
+    std::vector<std::filesystem::path> dependencies;
+    std::vector<uint64_t> dependency_offsets;
+    bool mtimes_match = true;
+    uint64_t offset = sizeof(Header);
+    for (uint32_t i = 0; i < header.num_dependencies; ++i) {
+        DependencyHeader dependency;
+        if (offset + sizeof(DependencyHeader) > size) {
+            return stale("it's truncated");
+        }
+        memcpy(&dependency, data + offset, sizeof(DependencyHeader));
+        dependency_offsets.push_back(offset);
+        offset += sizeof(DependencyHeader);
+        if (dependency.path_length > size - offset) {
+            return stale("it's truncated");
+        }
+        std::filesystem::path path(std::string(reinterpret_cast<const char *>(data + offset), dependency.path_length));
+        offset += dependency.path_length;
+
+        // A snapshot is of the model as it was, so its files have moved on.
+        if (run) {
+            continue;
+        }
+        std::error_code error;
+        uint64_t file_size = std::filesystem::file_size(path, error);
+        if (error || file_size != dependency.size) {
+            return stale(path.string() + " changed");
+        }
+        mtimes_match = mtimes_match && get_mtime(path) == dependency.mtime;
+        dependencies.push_back(path);
+    }
+    const uint64_t dependencies_end = offset;
+    if (!run && !mtimes_match && hash_files(dependencies) != header.content_hash) {
+        return stale("the model changed");
+    }
+
+    if (header.triangles_offset + header.num_triangles * sizeof(Triangle) > size ||
+        header.textures_offset + header.num_textures * sizeof(TextureHeader) > size) {
+        return stale("it's truncated");
+    }
+    cache->triangles_ = std::span<const Triangle>(
+        reinterpret_cast<const Triangle *>(data + header.triangles_offset),
+        header.num_triangles);
+    for (uint64_t i = 0; i < header.num_textures; ++i) {
+        TextureHeader texture;
+        memcpy(&texture, data + header.textures_offset + i * sizeof(TextureHeader), sizeof(TextureHeader));
+        if (texture.pixels_offset + static_cast<uint64_t>(texture.width) * texture.height * 4 > size) {
+            return stale("it's truncated");
+        }
+        // Textures are only ever read, even though Model hands out non-const
+        // pointers to them.
+        cache->textures_[texture.material_id] = {
+            reinterpret_cast<stbi_uc *>(const_cast<std::byte *>(data) + texture.pixels_offset),
+            texture.width, texture.height};
+    }
+    cache->min_ = glm::vec3(header.min[0], header.min[1], header.min[2]);
+    cache->max_ = glm::vec3(header.max[0], header.max[1], header.max[2]);
+    cache->has_materials_ = header.has_materials;
+    cache->content_hash_ = header.content_hash;
+
+    // Only the mtimes changed, so they're updated in place, or every later
+    // run would hash the whole model again. The file is only patched if it's
+    // still the one that was mapped, in case another conversion replaced it.
+    if (!run && !mtimes_match) {
+        std::fstream stream(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<char> on_disk(dependencies_end);
+        if (stream.read(on_disk.data(), on_disk.size()) &&
+            !memcmp(on_disk.data(), data, on_disk.size())) {
+            for (uint32_t i = 0; i < dependencies.size(); ++i) {
+                int64_t mtime = get_mtime(dependencies[i]);
+                stream.seekp(dependency_offsets[i] + offsetof(DependencyHeader, mtime));
+                stream.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+            }
+        }
+        stream.close();
+        if (stream.fail()) {
+            std::cout << "INFO: Couldn't update the mtimes in mesh cache " << cache_path << ".\n";
+        }
+    }
+    return cache;
+}
+
+void MeshCache::write(std::string_view obj_path,
+                      const std::vector<std::filesystem::path> &dependencies,
+                      const Model &model) {
+    std::filesystem::path cache_path = get_cache_path(obj_path);
+    const std::vector<Triangle> &triangles = model.get_triangles();
+    const auto &textures = model.get_textures();
+
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.triangle_size = sizeof(Triangle);
+    glm::vec3 min = model.get_min(), max = model.get_max();
+    memcpy(header.min, &min, sizeof(header.min));
+    memcpy(header.max, &max, sizeof(header.max));
+    header.has_materials = model.has_materials();
+    header.num_dependencies = dependencies.size();
+    header.content_hash = hash_files(dependencies);
+
+    std::vector<std::string> paths;
+    uint64_t offset = sizeof(Header);
+    for (const auto &dependency : dependencies) {
+        paths.push_back(std::filesystem::absolute(dependency).string());
+        offset += sizeof(DependencyHeader) + paths.back().size();
+    }
+    header.num_triangles = triangles.size();
+    header.triangles_offset = align_offset(offset);
+    header.num_textures = textures.size();
+    header.textures_offset = align_offset(header.triangles_offset + triangles.size() * sizeof(Triangle));
+
+    // The cache only saves time on later runs, so failing to write it (say
+    // the model is in a read-only directory) isn't an error.
+    bool wrote_cache = replace_file(cache_path, [&](std::ofstream &stream) {
+        auto pad_to = [&](uint64_t position) {
+            static constexpr char zeros[16] = {};
+            stream.write(zeros, position - static_cast<uint64_t>(stream.tellp()));
+        };
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        for (uint32_t i = 0; i < dependencies.size(); ++i) {
+            DependencyHeader dependency = {get_mtime(dependencies[i]),
+                                           std::filesystem::file_size(dependencies[i]),
+                                           paths[i].size()};
+            stream.write(reinterpret_cast<const char *>(&dependency), sizeof(DependencyHeader));
+            stream.write(paths[i].data(), paths[i].size());
+        }
+        pad_to(header.triangles_offset);
+        stream.write(reinterpret_cast<const char *>(triangles.data()), triangles.size() * sizeof(Triangle));
+        pad_to(header.textures_offset);
+
+        uint64_t pixels_offset = align_offset(header.textures_offset + textures.size() * sizeof(TextureHeader));
+        // Materials sharing an image share its pixels in the cache too.
+        std::vector<std::tuple<stbi_uc *, uint64_t, uint64_t>> pixels;
+        std::unordered_map<stbi_uc *, uint64_t> written_pixels;
+        for (const auto &[material_id, texture] : textures) {
+            auto [texture_pixels, width, height] = texture;
+            auto [written, inserted] = written_pixels.try_emplace(texture_pixels, pixels_offset);
+            TextureHeader texture_header = {material_id, width, height, 0, written->second};
+            stream.write(reinterpret_cast<const char *>(&texture_header), sizeof(TextureHeader));
+            if (inserted) {
+                uint64_t num_bytes = static_cast<uint64_t>(width) * height * 4;
+                pixels.emplace_back(texture_pixels, pixels_offset, num_bytes);
+                pixels_offset = align_offset(pixels_offset + num_bytes);
+            }
+        }
+        for (auto [texture_pixels, texture_offset, num_bytes] : pixels) {
+            pad_to(texture_offset);
+            stream.write(reinterpret_cast<const char *>(texture_pixels), num_bytes);
+        }
+    });
+    if (!wrote_cache) {
+        std::cout << "INFO: Couldn't write mesh cache " << cache_path << ".\n";
+        return;
+    }
+    std::cout << "INFO: Wrote mesh cache " << cache_path << ".\n";
+}
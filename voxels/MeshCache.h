@@ -0,0 +1,80 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+
+#include "Voxelize.h"
+
+class MappedFile;
+
+// A binary copy of everything Model loads from an OBJ: its bounds, triangle
+// list and decoded textures. It's stored in a .ivsmesh file next to the OBJ
+// and memory-mapped, so later runs skip parsing the OBJ and decoding every
+// texture. The file records the mtime, size and a content hash of the OBJ and
+// every MTL and texture it used. If the mtimes all match, the cache is used
+// as-is, and if only they changed (say the model was unzipped again), it's
+// still used as long as the contents hash the same, and the new mtimes are
+// recorded so later runs don't hash them again.
+class MeshCache {
+  public:
+    // Bumped whenever the file layout (or Triangle) changes.
+    static constexpr uint32_t VERSION = 1;
+
+    ~MeshCache();
+
+    // Maps the cache for the OBJ at obj_path, or returns null if there isn't
+    // one or it's stale.
+    static std::unique_ptr<MeshCache> open(std::string_view obj_path);
+
+    // Writes the cache for a model loaded from obj_path, which depended on
+    // the files in dependencies (the OBJ itself included). If it can't be
+    // written, the model just isn't cached.
+    static void write(std::string_view obj_path,
+                      const std::vector<std::filesystem::path> &dependencies,
+                      const Model &model);
+
+    static std::filesystem::path get_cache_path(std::string_view obj_path);
+
+    // Copies the cache for the OBJ at obj_path to snapshot_path, tagged with
+    // run (whatever else the snapshot has to match to be reused). Unlike the
+    // cache, a snapshot keeps the model as it was when it was taken, which is
+    // what an incremental conversion compares the edited model against.
+    static void write_snapshot(std::string_view obj_path,
+                               const std::filesystem::path &snapshot_path,
+                               std::string_view run);
+
+    // Maps the snapshot at snapshot_path, or returns null if there isn't one
+    // or it was taken for a different run. Its dependencies aren't checked.
+    static std::unique_ptr<MeshCache> open_snapshot(const std::filesystem::path &snapshot_path,
+                                                    std::string_view run);
+
+    glm::vec3 get_min() const {return min_;}
+    glm::vec3 get_max() const {return max_;}
+    bool has_materials() const {return has_materials_;}
+    // The hash of the OBJ and every file it depended on.
+    uint64_t get_content_hash() const {return content_hash_;}
+
+    // Both point into the mapped file, and are only valid while the cache is.
+    std::span<const Triangle> get_triangles() const {return triangles_;}
+    const std::unordered_map<int, std::tuple<stbi_uc *, int, int>> &
+    get_textures() const {return textures_;}
+
+  private:
+    MeshCache() = default;
+
+    // Maps the cache at cache_path. It's a snapshot taken for run if one is
+    // given, and a cache whose dependencies have to be up to date otherwise.
+    static std::unique_ptr<MeshCache> open_file(const std::filesystem::path &cache_path,
+                                                std::optional<std::string_view> run);
+
+    std::unique_ptr<MappedFile> file_;
+
+    glm::vec3 min_, max_;
+    bool has_materials_;
+    uint64_t content_hash_;
+    std::span<const Triangle> triangles_;
+    std::unordered_map<int, std::tuple<stbi_uc *, int, int>> textures_;
+};
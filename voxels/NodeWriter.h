@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Builds a converter's output: a prefix of bytes (its header, and anything
+// already written before it), followed by nodes appended one at a time.
+// Nodes go into blocks of BLOCK_SIZE nodes, allocated as they fill up, so
+// appending a node is a single store, and growing never moves what's already
+// written. Once done, the output is gathered into one buffer, freeing each
+// block as soon as it's copied, or copied into a region of memory (such as a
+// mapped file) or streamed to a file as it is.
+template <typename Node, uint64_t BLOCK_SIZE = 1 << 15> class NodeWriter {
+  public:
+    static_assert(std::is_trivially_copyable_v<Node>);
+
+    explicit NodeWriter(std::vector<std::byte> prefix) : prefix_(std::move(prefix)) {}
+
+    // Appends node, returning its index among the appended nodes.
+    uint64_t push(const Node &node) {
+        if (size_ % BLOCK_SIZE == 0) {
+            blocks_.push_back(std::make_unique_for_overwrite<Node[]>(BLOCK_SIZE));
+        }
+        blocks_.back()[size_ % BLOCK_SIZE] = node;
+        return size_++;
+    }
+
+    // Drops every appended node, leaving the prefix as it is.
+    void clear() {
+        blocks_.clear();
+        size_ = 0;
+    }
+
+    // Appended nodes, not counting the prefix.
+    uint64_t size() const { return size_; }
+
+    uint64_t size_in_bytes() const { return prefix_.size() + size_ * sizeof(Node); }
+
+    // The prefix can be patched (say, to fill in a node count once it's
+    // known) or resized until the output is gathered.
+    std::vector<std::byte> &prefix() { return prefix_; }
+    const std::vector<std::byte> &prefix() const { return prefix_; }
+
+    // Copies the output into destination, which holds size_in_bytes().
+    void copy_to(std::span<std::byte> destination) const {
+        memcpy(destination.data(), prefix_.data(), prefix_.size());
+        uint64_t offset = prefix_.size();
+        for_each_block([&](std::span<const std::byte> block) {
+            memcpy(destination.data() + offset, block.data(), block.size());
+            offset += block.size();
+        });
+    }
+
+    void write(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(prefix_.data()), prefix_.size());
+        for_each_block([&](std::span<const std::byte> block) {
+            stream.write(reinterpret_cast<const char *>(block.data()), block.size());
+        });
+    }
+
+    // Gathers the output into the prefix's buffer, which grows once to fit
+    // it, and empties the writer.
+    std::vector<std::byte> finish() {
+        std::vector<std::byte> output = std::move(prefix_);
+        output.reserve(output.size() + size_ * sizeof(Node));
+        for (uint64_t b = 0; b < blocks_.size(); ++b) {
+            std::span<const std::byte> block = block_bytes(b);
+            output.insert(output.end(), block.begin(), block.end());
+            blocks_[b].reset();
+        }
+        clear();
+        return output;
+    }
+
+  private:
+    std::span<const std::byte> block_bytes(uint64_t b) const {
+        const uint64_t num_nodes = std::min(BLOCK_SIZE, size_ - b * BLOCK_SIZE);
+        return {reinterpret_cast<const std::byte *>(blocks_[b].get()), num_nodes * sizeof(Node)};
+    }
+
+    template <typename F> void for_each_block(F &&f) const {
+        for (uint64_t b = 0; b < blocks_.size(); ++b) {
+            f(block_bytes(b));
+        }
+    }
+
+    std::vector<std::byte> prefix_;
+    std::vector<std::unique_ptr<Node[]>> blocks_;
+    uint64_t size_ = 0;
+};
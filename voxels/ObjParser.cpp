@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include <external/CTPL/ctpl_stl.h>
+
+#include "MappedFile.h"
+#include "ObjParser.h"
+
+namespace {
+
+// A vertex, texture coordinate or normal index from a face. Negative OBJ
+// indices count back from the last element read, so they're stored relative
+// to the start of the range they were parsed in until the ranges before it
+// have been counted.
+struct IndexReference {
+    enum class Kind : uint8_t {
+        Missing,
+        Absolute,
+        Relative,
+    };
+
+    int64_t value = -1;
+    Kind kind = Kind::Missing;
+
+    int resolve(int64_t base) const {
+        switch (kind) {
+        case Kind::Absolute:
+            return static_cast<int>(value);
+        case Kind::Relative:
+            return static_cast<int>(base + value);
+        default:
+            return -1;
+        }
+    }
+
+    // Whether the reference is missing, or resolves to one of the count
+    // elements read in the whole file.
+    bool in_range(int64_t base, uint64_t count) const {
+        if (kind == Kind::Missing) {
+            return true;
+        }
+        const int64_t index = kind == Kind::Absolute ? value : base + value;
+        return index >= 0 && static_cast<uint64_t>(index) < count;
+    }
+};
+
+struct FaceVertex {
+    IndexReference vertex, texcoord, normal;
+};
+
+struct ParsedRange {
+    std::vector<float> vertices, texcoords, normals;
+    std::vector<FaceVertex> face_vertices;
+    std::vector<uint32_t> face_sizes;
+
+    // For every face, the index in material_names of the usemtl before it, or
+    // -1 if that usemtl came in an earlier range.
+    std::vector<int32_t> face_materials;
+    std::vector<std::string> material_names;
+
+    // The file names listed on every mtllib line.
+    std::vector<std::vector<std::string>> mtl_libraries;
+
+    bool has_large_polygon = false;
+    std::string error;
+};
+
+bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+void skip_spaces(const char *&p, const char *end) {
+    while (p < end && is_space(*p)) {
+        ++p;
+    }
+}
+
+std::string_view parse_name(const char *&p, const char *end) {
+    skip_spaces(p, end);
+    const char *start = p;
+    while (p < end && !is_space(*p)) {
+        ++p;
+    }
+    return std::string_view(start, p - start);
+}
+
+// Missing or malformed numbers read as 0, like in tinyobjloader. Numbers are
+// parsed as doubles, then rounded to floats, also like tinyobjloader.
+float parse_float(const char *&p, const char *end) {
+    skip_spaces(p, end);
+    const char *start = p;
+    if (start < end && *start == '+') {
+        ++start;
+    }
+    double value;
+    auto [ptr, error] = std::from_chars(start, end, value);
+    if (error != std::errc()) {
+        return 0.0f;
+    }
+    p = ptr;
+    return static_cast<float>(value);
+}
+
+bool parse_index(const char *&p, const char *end, uint64_t num_read,
+                 IndexReference &reference) {
+    int64_t index;
+    auto [ptr, error] = std::from_chars(p, end, index);
+    if (error != std::errc() || index == 0) {
+        return false;
+    }
+    p = ptr;
+    if (index > 0) {
+        reference = {index - 1, IndexReference::Kind::Absolute};
+    } else {
+        reference = {static_cast<int64_t>(num_read) + index,
+                     IndexReference::Kind::Relative};
+    }
+    return true;
+}
+
+void parse_line(const char *p, const char *end, ParsedRange &range) {
+    skip_spaces(p, end);
+    if (p < end && end[-1] == '\r') {
+        --end;
+    }
+    if (end - p < 2) {
+        return;
+    }
+
+    auto starts_with = [&](std::string_view keyword) {
+        return static_cast<uint64_t>(end - p) > keyword.size() &&
+               !memcmp(p, keyword.data(), keyword.size()) &&
+               is_space(p[keyword.size()]);
+    };
+    if (starts_with("v")) {
+        p += 1;
+        for (uint32_t i = 0; i < 3; ++i) {
+            range.vertices.push_back(parse_float(p, end));
+        }
+    } else if (starts_with("vt")) {
+        p += 2;
+        for (uint32_t i = 0; i < 2; ++i) {
+            range.texcoords.push_back(parse_float(p, end));
+        }
+    } else if (starts_with("vn")) {
+        p += 2;
+        for (uint32_t i = 0; i < 3; ++i) {
+            range.normals.push_back(parse_float(p, end));
+        }
+    } else if (starts_with("f")) {
+        p += 1;
+        uint32_t face_size = 0;
+        while (true) {
+            skip_spaces(p, end);
+            if (p == end) {
+                break;
+            }
+            FaceVertex face_vertex;
+            bool parsed = parse_index(p, end, range.vertices.size() / 3,
+                                      face_vertex.vertex);
+            if (parsed && p < end && *p == '/') {
+                ++p;
+                if (p < end && *p == '/') {
+                    ++p;
+                    parsed = parse_index(p, end, range.normals.size() / 3,
+                                         face_vertex.normal);
+                } else {
+                    parsed = parse_index(p, end, range.texcoords.size() / 2,
+                                         face_vertex.texcoord);
+                    if (parsed && p < end && *p == '/') {
+                        ++p;
+                        parsed = parse_index(p, end, range.normals.size() / 3,
+                                             face_vertex.normal);
+                    }
+                }
+            }
+            if (!parsed || (p < end && !is_space(*p))) {
+                if (range.error.empty()) {
+                    range.error = "Failed to parse face: " + std::string(p, end);
+                }
+                return;
+            }
+            range.face_vertices.push_back(face_vertex);
+            ++face_size;
+        }
+        range.has_large_polygon = range.has_large_polygon || face_size > 4;
+        range.face_sizes.push_back(face_size);
+        range.face_materials.push_back(
+            static_cast<int32_t>(range.material_names.size()) - 1);
+    } else if (starts_with("usemtl")) {
+        p += 6;
+        range.material_names.emplace_back(parse_name(p, end));
+    } else if (starts_with("mtllib")) {
+        p += 6;
+        std::vector<std::string> names;
+        for (auto name = parse_name(p, end); !name.empty();
+             name = parse_name(p, end)) {
+            names.emplace_back(name);
+        }
+        range.mtl_libraries.push_back(std::move(names));
+    }
+}
+
+void parse_range(const char *begin, const char *end, ParsedRange &range) {
+    while (begin < end) {
+        const char *line_end =
+            static_cast<const char *>(memchr(begin, '\n', end - begin));
+        if (!line_end) {
+            line_end = end;
+        }
+        parse_line(begin, line_end, range);
+        begin = line_end + 1;
+    }
+}
+
+} // namespace
+
+bool ObjParser::parse(std::string_view filepath, uint32_t num_threads) {
+    std::string path(filepath);
+    std::unique_ptr<MappedFile> file = MappedFile::open(path, true);
+    if (!file) {
+        error_ = "Cannot open or map file [" + path + "]";
+        return false;
+    }
+    const uint64_t size = file->size();
+    const char *data = reinterpret_cast<const char *>(file->data());
+
+    num_threads = std::max(num_threads, 1U);
+    std::unique_ptr<ctpl::thread_pool> pool;
+    if (num_threads > 1) {
+        pool = std::make_unique<ctpl::thread_pool>(num_threads);
+    }
+    auto for_each_range = [&](uint32_t num_ranges, auto &&f) {
+        if (!pool) {
+            for (uint32_t i = 0; i < num_ranges; ++i) {
+                f(i);
+            }
+            return;
+        }
+        std::vector<std::future<void>> futures;
+        for (uint32_t i = 0; i < num_ranges; ++i) {
+            futures.push_back(pool->push([&f, i](int) { f(i); }));
+        }
+        for (auto &future : futures) {
+            future.get();
+        }
+    };
+
+    // Split the file into a few ranges per thread (of at least a MiB each),
+    // each ending right after a newline.
+    const uint64_t min_range_size = 1 << 20;
+    const uint32_t num_ranges = static_cast<uint32_t>(std::clamp<uint64_t>(
+        size / min_range_size, 1, static_cast<uint64_t>(num_threads) * 4));
+    std::vector<uint64_t> boundaries = {0};
+    for (uint32_t i = 1; i < num_ranges; ++i) {
+        uint64_t boundary = std::max(size * i / num_ranges, boundaries.back());
+        const void *newline = memchr(data + boundary, '\n', size - boundary);
+        boundaries.push_back(newline ? static_cast<const char *>(newline) - data + 1 : size);
+    }
+    boundaries.push_back(size);
+
+    std::vector<ParsedRange> ranges(num_ranges);
+    for_each_range(num_ranges, [&](uint32_t i) {
+        parse_range(data + boundaries[i], data + boundaries[i + 1], ranges[i]);
+    });
+    file.reset();
+
+    for (const auto &range : ranges) {
+        if (!range.error.empty()) {
+            error_ = range.error;
+            return false;
+        }
+        if (range.has_large_polygon) {
+            error_ = "Faces with more than 4 vertices aren't supported.";
+            return false;
+        }
+    }
+
+    // Materials are loaded in the order their mtllib lines appear, and the
+    // first file on a line that can be opened is the one used.
+    std::string directory;
+    const auto last_slash = path.find_last_of("/");
+    if (last_slash != std::string::npos) {
+        directory = path.substr(0, last_slash + 1);
+    }
+    std::map<std::string, int> material_map;
+    for (const auto &range : ranges) {
+        for (const auto &names : range.mtl_libraries) {
+            bool loaded = false;
+            for (const auto &name : names) {
+                std::ifstream stream(directory + name);
+                if (stream) {
+                    std::string warning, error;
+                    tinyobj::LoadMtl(&material_map, &materials_, &stream,
+                                     &warning, &error);
+                    warning_ += warning;
+                    loaded = true;
+                    break;
+                }
+            }
+            if (!loaded) {
+                warning_ += "Failed to load material file(s).\n";
+            }
+        }
+    }
+
+    // Where every range's elements and triangles start, and the material in
+    // effect at the start of every range.
+    const uint32_t num_bases = num_ranges + 1;
+    std::vector<uint64_t> vertex_bases(num_bases), texcoord_bases(num_bases),
+        normal_bases(num_bases), triangle_bases(num_bases);
+    std::vector<int> first_materials(num_ranges);
+    std::vector<std::vector<int>> material_ids(num_ranges);
+    int material_id = -1;
+    for (uint32_t i = 0; i < num_ranges; ++i) {
+        const ParsedRange &range = ranges[i];
+        uint64_t num_triangles = 0;
+        for (uint32_t face_size : range.face_sizes) {
+            num_triangles += face_size < 3 ? 0 : face_size - 2;
+        }
+        vertex_bases[i + 1] = vertex_bases[i] + range.vertices.size() / 3;
+        texcoord_bases[i + 1] = texcoord_bases[i] + range.texcoords.size() / 2;
+        normal_bases[i + 1] = normal_bases[i] + range.normals.size() / 3;
+        triangle_bases[i + 1] = triangle_bases[i] + num_triangles;
+
+        first_materials[i] = material_id;
+        for (const auto &name : range.material_names) {
+            auto it = material_map.find(name);
+            if (it == material_map.end()) {
+                warning_ += "material [ '" + name + "' ] not found in .mtl\n";
+            }
+            material_id = it == material_map.end() ? -1 : it->second;
+            material_ids[i].push_back(material_id);
+        }
+    }
+
+    // Faces can only refer to elements the file has, or triangulating them
+    // would read past the vertices, and so would anything using them.
+    std::vector<uint8_t> ranges_in_bounds(num_ranges, true);
+    for_each_range(num_ranges, [&](uint32_t i) {
+        for (const FaceVertex &face_vertex : ranges[i].face_vertices) {
+            if (!face_vertex.vertex.in_range(vertex_bases[i], vertex_bases.back()) ||
+                !face_vertex.texcoord.in_range(texcoord_bases[i], texcoord_bases.back()) ||
+                !face_vertex.normal.in_range(normal_bases[i], normal_bases.back())) {
+                ranges_in_bounds[i] = false;
+                return;
+            }
+        }
+    });
+    if (std::find(ranges_in_bounds.begin(), ranges_in_bounds.end(), false) !=
+        ranges_in_bounds.end()) {
+        error_ = "Faces refer to vertices, texture coordinates or normals that don't exist.";
+        return false;
+    }
+
+    attrib_.vertices.resize(vertex_bases.back() * 3);
+    attrib_.texcoords.resize(texcoord_bases.back() * 2);
+    attrib_.normals.resize(normal_bases.back() * 3);
+    for_each_range(num_ranges, [&](uint32_t i) {
+        const ParsedRange &range = ranges[i];
+        std::copy(range.vertices.begin(), range.vertices.end(),
+                  attrib_.vertices.begin() + vertex_bases[i] * 3);
+        std::copy(range.texcoords.begin(), range.texcoords.end(),
+                  attrib_.texcoords.begin() + texcoord_bases[i] * 2);
+        std::copy(range.normals.begin(), range.normals.end(),
+                  attrib_.normals.begin() + normal_bases[i] * 3);
+    });
+    if (!triangle_bases.back()) {
+        return true;
+    }
+
+    // Triangulate the faces once every vertex is in place, since quads are
+    // split along their shorter diagonal, as tinyobjloader does.
+    tinyobj::shape_t shape;
+    shape.mesh.indices.resize(triangle_bases.back() * 3);
+    shape.mesh.num_face_vertices.resize(triangle_bases.back(), 3);
+    shape.mesh.material_ids.resize(triangle_bases.back());
+    for_each_range(num_ranges, [&](uint32_t i) {
+        const ParsedRange &range = ranges[i];
+        const float *v = attrib_.vertices.data();
+        uint64_t triangle = triangle_bases[i];
+        auto resolve = [&](const FaceVertex &face_vertex) {
+            tinyobj::index_t index;
+            index.vertex_index = face_vertex.vertex.resolve(vertex_bases[i]);
+            index.texcoord_index = face_vertex.texcoord.resolve(texcoord_bases[i]);
+            index.normal_index = face_vertex.normal.resolve(normal_bases[i]);
+            return index;
+        };
+        auto add_triangle = [&](tinyobj::index_t a, tinyobj::index_t b,
+                                tinyobj::index_t c, int material) {
+            shape.mesh.indices[triangle * 3] = a;
+            shape.mesh.indices[triangle * 3 + 1] = b;
+            shape.mesh.indices[triangle * 3 + 2] = c;
+            shape.mesh.material_ids[triangle] = material;
+            ++triangle;
+        };
+
+        uint64_t face_vertex = 0;
+        for (uint64_t face = 0; face < range.face_sizes.size(); ++face) {
+            uint32_t face_size = range.face_sizes[face];
+            int32_t material_index = range.face_materials[face];
+            int material = material_index < 0 ? first_materials[i]
+                                              : material_ids[i][material_index];
+            const FaceVertex *vertices = range.face_vertices.data() + face_vertex;
+            face_vertex += face_size;
+            if (face_size == 3) {
+                add_triangle(resolve(vertices[0]), resolve(vertices[1]),
+                             resolve(vertices[2]), material);
+            } else if (face_size == 4) {
+                tinyobj::index_t i0 = resolve(vertices[0]), i1 = resolve(vertices[1]),
+                                 i2 = resolve(vertices[2]), i3 = resolve(vertices[3]);
+                auto squared_distance = [&](tinyobj::index_t a, tinyobj::index_t b) {
+                    float dx = v[b.vertex_index * 3] - v[a.vertex_index * 3];
+                    float dy = v[b.vertex_index * 3 + 1] - v[a.vertex_index * 3 + 1];
+                    float dz = v[b.vertex_index * 3 + 2] - v[a.vertex_index * 3 + 2];
+                    return dx * dx + dy * dy + dz * dz;
+                };
+                if (squared_distance(i0, i2) < squared_distance(i1, i3)) {
+                    add_triangle(i0, i1, i2, material);
+                    add_triangle(i0, i2, i3, material);
+                } else {
+                    add_triangle(i0, i1, i3, material);
+                    add_triangle(i1, i2, i3, material);
+                }
+            }
+        }
+    });
+    shapes_.push_back(std::move(shape));
+    return true;
+}
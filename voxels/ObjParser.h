@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <external/tinyobjloader/tiny_obj_loader.h>
+
+// Parses an OBJ into the same attributes, shapes and materials that
+// tinyobj::ObjReader produces with triangulation on, but memory-maps the file
+// and parses line-aligned ranges of it in parallel. Every face ends up in one
+// shape, in file order, so iterating the shapes yields the same triangles.
+//
+// Only vertices, texture coordinates, normals, faces, usemtl and mtllib are
+// read - everything else is skipped. Materials are still loaded with
+// tinyobj::LoadMtl. parse() fails on faces with more than 4 vertices, since
+// tinyobjloader ear-clips those, and on faces referring to elements the file
+// doesn't have, so callers can fall back to it.
+class ObjParser {
+  public:
+    bool parse(std::string_view filepath, uint32_t num_threads);
+
+    const tinyobj::attrib_t &get_attrib() const {return attrib_;}
+    const std::vector<tinyobj::shape_t> &get_shapes() const {return shapes_;}
+    const std::vector<tinyobj::material_t> &get_materials() const {return materials_;}
+    const std::string &get_error() const {return error_;}
+    const std::string &get_warning() const {return warning_;}
+
+  private:
+    tinyobj::attrib_t attrib_;
+    std::vector<tinyobj::shape_t> shapes_;
+    std::vector<tinyobj::material_t> materials_;
+    std::string error_;
+    std::string warning_;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <external/glm/glm/glm.hpp>
+
+// Unit normals are stored as one uint32_t, in the octahedral encoding: the
+// normal is projected onto the octahedron |x| + |y| + |z| = 1, the lower half
+// is folded over the upper one, and the resulting x and y are stored as two
+// snorm16s, x in the low half. unpack_normal in shaders/common.glsl decodes
+// the same bits, and unpack_normal below is its CPU reference.
+
+inline uint32_t pack_normal(glm::vec3 normal) {
+    normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    glm::vec2 octahedral(normal.x, normal.y);
+    if (normal.z < 0.0f) {
+        octahedral = glm::vec2(
+            (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
+    }
+
+    auto to_snorm16 = [](float value) {
+        int16_t snorm = static_cast<int16_t>(
+            std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        return static_cast<uint32_t>(static_cast<uint16_t>(snorm));
+    };
+    return to_snorm16(octahedral.x) | (to_snorm16(octahedral.y) << 16);
+}
+
+inline glm::vec3 unpack_normal(uint32_t packed) {
+    auto from_snorm16 = [](uint32_t bits) {
+        float value = static_cast<float>(static_cast<int16_t>(bits & 0xFFFF)) / 32767.0f;
+        return std::clamp(value, -1.0f, 1.0f);
+    };
+    glm::vec3 normal(from_snorm16(packed), from_snorm16(packed >> 16), 0.0f);
+    normal.z = 1.0f - std::abs(normal.x) - std::abs(normal.y);
+    if (normal.z < 0.0f) {
+        normal = glm::vec3(
+            (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f),
+            normal.z);
+    }
+    return glm::normalize(normal);
+}
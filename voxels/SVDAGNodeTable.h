@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+struct SVDAGNode {
+    uint32_t child_offsets_[8];
+
+    bool operator==(const SVDAGNode &other) const {
+        return child_offsets_[0] == other.child_offsets_[0] &&
+               child_offsets_[1] == other.child_offsets_[1] &&
+               child_offsets_[2] == other.child_offsets_[2] &&
+               child_offsets_[3] == other.child_offsets_[3] &&
+               child_offsets_[4] == other.child_offsets_[4] &&
+               child_offsets_[5] == other.child_offsets_[5] &&
+               child_offsets_[6] == other.child_offsets_[6] &&
+               child_offsets_[7] == other.child_offsets_[7];
+    }
+};
+
+// Maps SVDAG nodes to where they were written, for deduplicating them as an
+// SVDAG is built. It's an open addressing table, probed a cache line sized
+// bucket at a time: a bucket holds the tags (the top half of the hash) and
+// offsets of BUCKET_SIZE nodes, so a lookup almost always reads one bucket and
+// compares one key. Keys are stored inline in a parallel array rather than in
+// a node per entry, so inserting never allocates, except to grow.
+class SVDAGNodeTable {
+  public:
+    static constexpr uint32_t BUCKET_SIZE = 8;
+
+    SVDAGNodeTable() { rehash(MIN_BUCKETS); }
+
+    // The offset of the node identical to node, or nullptr if there's none.
+    const uint32_t *find(const SVDAGNode &node) const {
+        const uint64_t hash = hash_node(node);
+        const uint32_t tag = tag_of(hash);
+        for (uint64_t b = hash & bucket_mask_;; b = (b + 1) & bucket_mask_) {
+            const Bucket &bucket = buckets_[b];
+            for (uint32_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+                if (bucket.tags[slot] == tag &&
+                    memcmp(&keys_[b * BUCKET_SIZE + slot], &node, sizeof(SVDAGNode)) == 0) {
+                    return &bucket.offsets[slot];
+                }
+                if (bucket.tags[slot] == EMPTY_TAG) {
+                    return nullptr;
+                }
+            }
+        }
+    }
+
+    uint32_t *find(const SVDAGNode &node) {
+        return const_cast<uint32_t *>(std::as_const(*this).find(node));
+    }
+
+    // Maps node to offset, unless it's already mapped. Returns the offset node
+    // maps to, and whether it was inserted.
+    std::pair<uint32_t, bool> try_emplace(const SVDAGNode &node, uint32_t offset) {
+        if ((size_ + 1) * MAX_LOAD_DENOMINATOR > capacity() * MAX_LOAD_NUMERATOR) {
+            rehash(2 * (bucket_mask_ + 1));
+        }
+        const uint64_t hash = hash_node(node);
+        const uint32_t tag = tag_of(hash);
+        for (uint64_t b = hash & bucket_mask_;; b = (b + 1) & bucket_mask_) {
+            Bucket &bucket = buckets_[b];
+            for (uint32_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+                if (bucket.tags[slot] == EMPTY_TAG) {
+                    bucket.tags[slot] = tag;
+                    bucket.offsets[slot] = offset;
+                    keys_[b * BUCKET_SIZE + slot] = node;
+                    ++size_;
+                    return {offset, true};
+                }
+                if (bucket.tags[slot] == tag &&
+                    memcmp(&keys_[b * BUCKET_SIZE + slot], &node, sizeof(SVDAGNode)) == 0) {
+                    return {bucket.offsets[slot], false};
+                }
+            }
+        }
+    }
+
+    uint64_t size() const { return size_; }
+
+    uint64_t memory_usage() const {
+        return buckets_.size() * sizeof(Bucket) + keys_.size() * sizeof(SVDAGNode);
+    }
+
+    // Mixes each of the node's four 8 byte words in with a multiply and a
+    // shift, then finishes with the MurmurHash3 finalizer, so every bit of
+    // every offset reaches both the bucket index and the tag.
+    static uint64_t hash_node(const SVDAGNode &node) {
+        uint64_t words[4];
+        memcpy(words, &node, sizeof(words));
+        uint64_t hash = 0x9e3779b97f4a7c15ULL;
+        for (uint64_t word : words) {
+            hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+            hash ^= hash >> 29;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+  private:
+    static constexpr uint32_t EMPTY_TAG = 0;
+    static constexpr uint64_t MIN_BUCKETS = 64;
+    // Grows past 7/8 full. Buckets only fill up in order, so a probe ends at
+    // the first empty slot.
+    static constexpr uint64_t MAX_LOAD_NUMERATOR = 7, MAX_LOAD_DENOMINATOR = 8;
+
+    struct alignas(64) Bucket {
+        uint32_t tags[BUCKET_SIZE];
+        uint32_t offsets[BUCKET_SIZE];
+    };
+    static_assert(sizeof(Bucket) == 64);
+
+    // The top half of the hash, while the bucket index comes from the bottom
+    // half, with 0 reserved for empty slots.
+    static uint32_t tag_of(uint64_t hash) {
+        const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        return tag == EMPTY_TAG ? 1 : tag;
+    }
+
+    uint64_t capacity() const { return buckets_.size() * BUCKET_SIZE; }
+
+    void rehash(uint64_t num_buckets) {
+        std::vector<Bucket> old_buckets(num_buckets);
+        std::vector<SVDAGNode> old_keys(num_buckets * BUCKET_SIZE);
+        old_buckets.swap(buckets_);
+        old_keys.swap(keys_);
+        bucket_mask_ = num_buckets - 1;
+        size_ = 0;
+        for (uint64_t b = 0; b < old_buckets.size(); ++b) {
+            for (uint32_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+                if (old_buckets[b].tags[slot] != EMPTY_TAG) {
+                    try_emplace(old_keys[b * BUCKET_SIZE + slot], old_buckets[b].offsets[slot]);
+                }
+            }
+        }
+    }
+
+    std::vector<Bucket> buckets_;
+    std::vector<SVDAGNode> keys_;
+    uint64_t bucket_mask_ = 0;
+    uint64_t size_ = 0;
+};
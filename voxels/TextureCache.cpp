@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <unordered_set>
+
+#include <external/CTPL/ctpl_stl.h>
+
+#include "TextureCache.h"
+#include "utils/Assert.h"
+
+TextureCache::~TextureCache() {
+    for (auto [_, texture] : textures_) {
+        stbi_image_free(std::get<0>(texture));
+    }
+}
+
+void TextureCache::load(const std::vector<std::string> &paths,
+                        uint32_t num_threads) {
+    std::vector<std::string> new_paths;
+    std::unordered_set<std::string> seen;
+    for (const auto &path : paths) {
+        if (!textures_.contains(path) && seen.insert(path).second) {
+            new_paths.push_back(path);
+        }
+    }
+    if (new_paths.empty()) {
+        return;
+    }
+
+    struct Decoded {
+        stbi_uc *pixels;
+        int width, height;
+        double milliseconds;
+    };
+    std::vector<Decoded> decoded(new_paths.size());
+    auto decode = [&](uint64_t i) {
+        auto start = std::chrono::steady_clock::now();
+        int width = 0, height = 0, channels;
+        stbi_uc *pixels = stbi_load(new_paths[i].c_str(), &width, &height,
+                                    &channels, STBI_rgb_alpha);
+        auto end = std::chrono::steady_clock::now();
+        decoded[i] = {pixels, width, height,
+                      std::chrono::duration<double, std::milli>(end - start).count()};
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    num_threads = std::min<uint64_t>(std::max(num_threads, 1U), new_paths.size());
+    if (num_threads == 1) {
+        for (uint64_t i = 0; i < new_paths.size(); ++i) {
+            decode(i);
+        }
+    } else {
+        ctpl::thread_pool pool(num_threads);
+        std::vector<std::future<void>> futures;
+        futures.reserve(new_paths.size());
+        for (uint64_t i = 0; i < new_paths.size(); ++i) {
+            futures.push_back(pool.push([&decode, i](int) { decode(i); }));
+        }
+        for (auto &future : futures) {
+            future.get();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // Every texture is recorded before checking for failures, so the ones
+    // that did decode are still freed.
+    for (uint64_t i = 0; i < new_paths.size(); ++i) {
+        if (decoded[i].pixels) {
+            textures_[new_paths[i]] = {decoded[i].pixels, decoded[i].width,
+                                       decoded[i].height};
+        }
+    }
+    for (uint64_t i = 0; i < new_paths.size(); ++i) {
+        if (!decoded[i].pixels) {
+            std::stringstream ss;
+            ss << "Couldn't load texture from the following path: ";
+            ss << new_paths[i];
+            ss << "\n";
+            ASSERT(false, ss.str());
+        }
+        std::cout << "INFO: Decoded " << new_paths[i] << " ("
+                  << decoded[i].width << " x " << decoded[i].height << ") in "
+                  << decoded[i].milliseconds << " ms.\n";
+    }
+    std::cout << "INFO: Decoded " << new_paths.size() << " textures in "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms on " << num_threads << " threads.\n";
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <external/stb_image.h>
+
+// Decoded textures, keyed by path. Several materials often share an image,
+// so each path is only decoded once, and load() decodes all of the new ones
+// concurrently rather than one at a time as materials are first seen.
+class TextureCache {
+  public:
+    TextureCache() = default;
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+    ~TextureCache();
+
+    // Decodes every path that isn't cached yet as RGBA8 on up to num_threads
+    // threads, and reports how long each one took.
+    void load(const std::vector<std::string> &paths, uint32_t num_threads);
+
+    // Returns the pixels, width and height of a loaded texture.
+    std::tuple<stbi_uc *, int, int> get(const std::string &path) const {
+        return textures_.at(path);
+    }
+
+  private:
+    std::unordered_map<std::string, std::tuple<stbi_uc *, int, int>> textures_;
+};
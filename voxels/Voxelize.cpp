@@ -1,283 +1,993 @@
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstddef>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <unordered_set>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <external/libmorton/include/libmorton/morton.h>
 #include <external/tinyobjloader/tiny_obj_loader.h>
 
 #include "Conversion.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "PackedNormal.h"
 #include "Voxelize.h"
 #include "utils/Assert.h"
 
-std::vector<std::byte> raw_voxelize_obj(std::string_view filepath,
-                                        float voxel_size,
-                                        uint32_t &out_chunk_width,
-                                        uint32_t &out_chunk_height,
-                                        uint32_t &out_chunk_depth) {
-    std::cout << filepath << " " << voxel_size << "\n";
+// Splits the voxel range [min_z, max_z] into slabs of slab_depth voxels and
+// calls voxelize_slab(slab, slab_min_z, slab_max_z) for each of them (the
+// bounds are inclusive). Every voxel belongs to exactly one slab, so slabs can
+// be voxelized concurrently without two threads ever writing the same voxel.
+template <typename F>
+static void for_each_slab(ctpl::thread_pool *pool, uint32_t min_z,
+                          uint32_t max_z, uint32_t slab_depth,
+                          F &&voxelize_slab) {
+    const uint32_t num_slabs = (max_z - min_z) / slab_depth + 1;
+    if (!pool || num_slabs == 1) {
+        for (uint32_t slab = 0; slab < num_slabs; ++slab) {
+            uint32_t slab_min_z = min_z + slab * slab_depth;
+            voxelize_slab(slab, slab_min_z,
+                          std::min(slab_min_z + slab_depth - 1, max_z));
+        }
+        return;
+    }
 
-    std::string inputfile(filepath);
-    tinyobj::ObjReaderConfig reader_config;
-    tinyobj::ObjReader reader;
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_slabs);
+    for (uint32_t slab = 0; slab < num_slabs; ++slab) {
+        uint32_t slab_min_z = min_z + slab * slab_depth;
+        uint32_t slab_max_z = std::min(slab_min_z + slab_depth - 1, max_z);
+        futures.emplace_back(pool->push([&, slab, slab_min_z, slab_max_z](int _id) {
+            voxelize_slab(slab, slab_min_z, slab_max_z);
+        }));
+    }
+    for (auto &future : futures) {
+        future.get();
+    }
+}
 
-    ASSERT(reader.ParseFromFile(inputfile, reader_config), reader.Error());
+// Picks a slab depth that gives each thread a handful of slabs, so that slabs
+// crossing dense parts of the model don't leave the other threads idle.
+static uint32_t choose_slab_depth(uint32_t depth, uint32_t num_threads) {
+    const uint32_t slabs_per_thread = 4;
+    uint32_t num_slabs = num_threads * slabs_per_thread;
+    return std::max((depth + num_slabs - 1) / num_slabs, 1U);
+}
 
-    auto &attrib = reader.GetAttrib();
-    auto &shapes = reader.GetShapes();
-    auto &materials = reader.GetMaterials();
+// Narrows the voxel ranges of a triangle's bounding box down to the voxels
+// whose centers lie in its plane's band (see TriangleBoxTest::plane_min), one
+// row at a time: first the y range of an x row, then the z range of an (x, y)
+// column. Voxel i along each axis is centered at grid_min + i * grid_step.
+// Every voxel this skips fails the plane's separating axis, so sweeping the
+// narrowed ranges finds exactly the voxels sweeping the bounding box would,
+// while testing only about as many voxels as the band holds.
+class PlaneBand {
+  public:
+    PlaneBand(const TriangleBoxTest &box_test, glm::vec3 grid_min,
+              glm::vec3 grid_step)
+        : normal_(box_test.plane_normal()), min_(box_test.plane_min()),
+          max_(box_test.plane_max()), grid_min_(grid_min),
+          grid_step_(grid_step) {}
+
+    // Narrows [min_y, max_y] to the y range of row x that can reach the band
+    // anywhere in [min_z, max_z]. Returns false if none of the row can.
+    bool narrow_y(uint32_t x, uint32_t min_z, uint32_t max_z, uint32_t &min_y,
+                  uint32_t &max_y) const {
+        double x_d = project(0, x);
+        double min_z_d = std::min(project(2, min_z), project(2, max_z));
+        double max_z_d = std::max(project(2, min_z), project(2, max_z));
+        return narrow(1, min_ - x_d - max_z_d, max_ - x_d - min_z_d, min_y,
+                      max_y);
+    }
 
-    std::string directory(filepath);
-    const auto last_slash = directory.find_last_of("/");
-    if (last_slash == std::string::npos) {
-        directory = "";
-    } else {
-        directory = directory.substr(0, last_slash + 1);
+    // Narrows [min_z, max_z] to the part of column (x, y) inside the band.
+    // Returns false if the column misses the band.
+    bool narrow_z(uint32_t x, uint32_t y, uint32_t &min_z,
+                  uint32_t &max_z) const {
+        double xy_d = project(0, x) + project(1, y);
+        return narrow(2, min_ - xy_d, max_ - xy_d, min_z, max_z);
     }
 
-    glm::vec3 min(0.0f, 0.0f, 0.0f), max(0.0f, 0.0f, 0.0f);
-    for (int64_t i = 0; i < attrib.vertices.size(); i += 3) {
-        min.x = fmin(min.x, attrib.vertices[i]);
-        min.y = fmin(min.y, attrib.vertices[i + 1]);
-        min.z = fmin(min.z, attrib.vertices[i + 2]);
-        max.x = fmax(max.x, attrib.vertices[i]);
-        max.y = fmax(max.y, attrib.vertices[i + 1]);
-        max.z = fmax(max.z, attrib.vertices[i + 2]);
+  private:
+    glm::vec3 normal_;
+    double min_, max_;
+    glm::vec3 grid_min_, grid_step_;
+
+    // The normal's component along axis, times the voxel center's coordinate.
+    double project(uint32_t axis, uint32_t voxel) const {
+        return static_cast<double>(normal_[axis]) *
+               (static_cast<double>(grid_min_[axis]) +
+                static_cast<double>(voxel) * grid_step_[axis]);
     }
-    std::cout << "Bottom corner: (" << min.x << ", " << min.y << ", " << min.z
-              << ")\n";
-    std::cout << "Top corner: (" << max.x << ", " << max.y << ", " << max.z
-              << ")\n";
 
-    uint32_t chunk_width =
-        static_cast<uint32_t>(ceil((max.x - min.x) / voxel_size));
-    uint32_t chunk_height =
-        static_cast<uint32_t>(ceil((max.y - min.y) / voxel_size));
-    uint32_t chunk_depth =
-        static_cast<uint32_t>(ceil((max.z - min.z) / voxel_size));
-    std::cout << "Chunk size: (" << chunk_width << ", " << chunk_height << ", "
-              << chunk_depth << ")\n";
+    // Narrows [min_voxel, max_voxel] to the voxels along axis whose center
+    // coordinate c satisfies lo <= normal[axis] * c <= hi.
+    bool narrow(uint32_t axis, double lo, double hi, uint32_t &min_voxel,
+                uint32_t &max_voxel) const {
+        if (min_voxel > max_voxel) {
+            return false;
+        }
+        double coefficient = normal_[axis];
+        if (coefficient == 0.0) {
+            return lo <= 0.0 && 0.0 <= hi;
+        }
+        double min_c = lo / coefficient, max_c = hi / coefficient;
+        if (coefficient < 0.0) {
+            std::swap(min_c, max_c);
+        }
+        double min_i = std::max(ceil((min_c - grid_min_[axis]) / grid_step_[axis]),
+                                static_cast<double>(min_voxel));
+        double max_i = std::min(floor((max_c - grid_min_[axis]) / grid_step_[axis]),
+                                static_cast<double>(max_voxel));
+        if (min_i > max_i) {
+            return false;
+        }
+        min_voxel = static_cast<uint32_t>(min_i);
+        max_voxel = static_cast<uint32_t>(max_i);
+        return true;
+    }
+};
+
+// Where a model's voxels are. Voxel i along each axis is centered at
+// min + i * step, and is a box voxel_size wide.
+struct VoxelGrid {
+    glm::vec3 min;
+    glm::vec3 step;
+    float voxel_size;
+
+    // The first and last voxel along axis that a triangle's bounding box can
+    // overlap. Neither is clamped to the grid.
+    uint32_t min_voxel(uint32_t axis, float coordinate) const {
+        return static_cast<uint32_t>(floor((coordinate - min[axis]) / step[axis]));
+    }
+    uint32_t max_voxel(uint32_t axis, float coordinate) const {
+        return static_cast<uint32_t>(ceil((coordinate - min[axis]) / step[axis]));
+    }
 
-    std::unordered_map<int, std::tuple<stbi_uc *, int, int>> loaded_textures;
-    std::vector<std::byte> data(static_cast<size_t>(chunk_width) *
-                                    static_cast<size_t>(chunk_height) *
-                                    static_cast<size_t>(chunk_depth) * 4,
-                                static_cast<std::byte>(0));
+    float center(uint32_t axis, uint32_t voxel) const {
+        return static_cast<float>(voxel) * step[axis] + min[axis];
+    }
+};
+
+// What voxelizing a set of triangles tested.
+struct VoxelizeStatistics {
+    uint64_t num_triangles_accepted = 0;
+    uint64_t num_voxels_tested = 0;
+    uint64_t num_voxels_in_bounds = 0;
+};
+
+// A voxel a triangle covers, as VoxelizationCore passes it to its sink.
+struct VoxelHit {
+    // The RGBA color, as the bytes of a uint32_t, or 0 for transparent texels.
+    uint32_t voxel;
+    // The triangle's unit normal, following its winding.
+    glm::vec3 normal;
+    // How far the voxel's center is from the triangle's plane.
+    float distance;
+};
+
+// The voxelization both the dense and the chunked voxelizers are built on.
+// It finds the voxels each triangle overlaps and their colors, and hands them
+// to a sink, which decides where they're stored: sink(x, y, z, hit) is called
+// with every covered voxel's grid coordinates and a VoxelHit. A voxel covered
+// by several triangles is passed to the sink once per triangle, in triangle
+// order, so storing every voxel passed in makes the last one win.
+class VoxelizationCore {
+  public:
+    using TextureMap = std::unordered_map<int, std::tuple<stbi_uc *, int, int>>;
+
+    VoxelizationCore(const std::vector<Triangle> &triangles,
+                     const TextureMap &textures, const VoxelGrid &grid)
+        : triangles_(triangles), textures_(textures), grid_(grid) {}
+
+    // Voxelizes triangles_[i] for every i in triangle_indices, in that order,
+    // into the voxels between region_min and region_max (inclusive). The
+    // region is split into z-slabs slab_depth voxels deep, which are
+    // voxelized concurrently on pool (if there is one), so the sink may be
+    // called concurrently, but never for two voxels in the same slab. Prints
+    // its progress if report_progress is set.
+    template <typename Sink>
+    VoxelizeStatistics voxelize(std::span<const uint32_t> triangle_indices,
+                                glm::uvec3 region_min, glm::uvec3 region_max,
+                                uint32_t slab_depth, ctpl::thread_pool *pool,
+                                Sink &&sink,
+                                bool report_progress = false) const {
+        // Bin the triangles into the z-slabs they overlap. Each slab visits its
+        // triangles in their original order, so the last triangle to cover a
+        // voxel still determines its color, exactly as in a serial sweep.
+        const uint32_t num_slabs = (region_max.z - region_min.z) / slab_depth + 1;
+        std::vector<std::vector<uint32_t>> slab_triangles(num_slabs);
+        for (uint32_t i = 0; i < triangle_indices.size(); ++i) {
+            const Triangle &tri = triangles_[triangle_indices[i]];
+            uint32_t min_voxel_z = std::max(grid_.min_voxel(2, tri.min_z()), region_min.z);
+            uint32_t max_voxel_z = std::min(grid_.max_voxel(2, tri.max_z()), region_max.z);
+            if (min_voxel_z > max_voxel_z) {
+                continue;
+            }
+            for (uint32_t slab = (min_voxel_z - region_min.z) / slab_depth;
+                 slab <= (max_voxel_z - region_min.z) / slab_depth; ++slab) {
+                slab_triangles.at(slab).push_back(i);
+            }
+        }
 
-    for (const auto &shape : shapes) {
-        std::cout << shape.mesh.indices.size() / 3 << " triangles\n";
-        uint32_t num_printed = 0;
-        for (int64_t i = 0; i < shape.mesh.indices.size(); i += 3) {
-            const auto &vert_a = shape.mesh.indices[i];
-            const auto &vert_b = shape.mesh.indices[i + 1];
-            const auto &vert_c = shape.mesh.indices[i + 2];
+        std::vector<std::atomic_bool> triangle_covers_voxel(triangle_indices.size());
+        std::atomic_uint32_t num_slabs_finished = 0;
+        std::atomic_uint64_t num_voxels_tested = 0, num_voxels_in_bounds = 0;
+        for_each_slab(pool, region_min.z, region_max.z, slab_depth,
+                      [&](uint32_t slab, uint32_t slab_min_z, uint32_t slab_max_z) {
+            uint64_t slab_voxels_tested = 0, slab_voxels_in_bounds = 0;
+            for (uint32_t i : slab_triangles.at(slab)) {
+                glm::uvec3 min_voxel(region_min.x, region_min.y, slab_min_z);
+                glm::uvec3 max_voxel(region_max.x, region_max.y, slab_max_z);
+                bool covers_voxel = voxelize_triangle(
+                    triangles_[triangle_indices[i]], min_voxel, max_voxel,
+                    slab_voxels_tested, slab_voxels_in_bounds, sink);
+                if (covers_voxel) {
+                    triangle_covers_voxel[i].store(true, std::memory_order_relaxed);
+                }
+            }
 
-            auto index_a = vert_a.vertex_index;
-            auto index_b = vert_b.vertex_index;
-            auto index_c = vert_c.vertex_index;
+            num_voxels_tested += slab_voxels_tested;
+            num_voxels_in_bounds += slab_voxels_in_bounds;
+            uint32_t finished = ++num_slabs_finished;
+            if (report_progress &&
+                finished * 10 / num_slabs != (finished - 1) * 10 / num_slabs) {
+                std::cout << finished * 100 / num_slabs << "% finished.\n";
+            }
+        });
+
+        VoxelizeStatistics statistics;
+        statistics.num_triangles_accepted = std::count(
+            triangle_covers_voxel.begin(), triangle_covers_voxel.end(), true);
+        statistics.num_voxels_tested = num_voxels_tested;
+        statistics.num_voxels_in_bounds = num_voxels_in_bounds;
+        return statistics;
+    }
 
-            auto tex_index_a = vert_a.texcoord_index;
-            auto tex_index_b = vert_b.texcoord_index;
-            auto tex_index_c = vert_c.texcoord_index;
+    // Voxelizes the same voxels as voxelize, but splits triangle_indices into
+    // num_batches runs of consecutive triangles and voxelizes those
+    // concurrently on pool (if there is one), each over the whole region. The
+    // sink can be called concurrently for the same voxel, so it has to resolve
+    // conflicting writes itself, in a way that doesn't depend on their order.
+    template <typename Sink>
+    VoxelizeStatistics voxelize_batches(std::span<const uint32_t> triangle_indices,
+                                        glm::uvec3 region_min, glm::uvec3 region_max,
+                                        uint32_t num_batches, ctpl::thread_pool *pool,
+                                        Sink &&sink) const {
+        num_batches = std::clamp(num_batches, 1U,
+                                 std::max(static_cast<uint32_t>(triangle_indices.size()), 1U));
+        const uint32_t region_depth = region_max.z - region_min.z + 1;
+        std::vector<VoxelizeStatistics> batch_statistics(num_batches);
+        auto voxelize_batch = [&](uint32_t batch) {
+            uint64_t begin = triangle_indices.size() * batch / num_batches;
+            uint64_t end = triangle_indices.size() * (batch + 1) / num_batches;
+            batch_statistics[batch] =
+                voxelize(triangle_indices.subspan(begin, end - begin), region_min,
+                         region_max, region_depth, nullptr, sink);
+        };
+        if (!pool) {
+            for (uint32_t batch = 0; batch < num_batches; ++batch) {
+                voxelize_batch(batch);
+            }
+        } else {
+            std::vector<std::future<void>> futures;
+            futures.reserve(num_batches);
+            for (uint32_t batch = 0; batch < num_batches; ++batch) {
+                futures.emplace_back(pool->push([&, batch](int _id) {
+                    voxelize_batch(batch);
+                }));
+            }
+            for (auto &future : futures) {
+                future.get();
+            }
+        }
 
-            bool has_materials =
-                (tex_index_a >= 0 && tex_index_b >= 0 && tex_index_c >= 0);
+        VoxelizeStatistics statistics;
+        for (const VoxelizeStatistics &batch : batch_statistics) {
+            statistics.num_triangles_accepted += batch.num_triangles_accepted;
+            statistics.num_voxels_tested += batch.num_voxels_tested;
+            statistics.num_voxels_in_bounds += batch.num_voxels_in_bounds;
+        }
+        return statistics;
+    }
 
-            const Triangle tri(
-                glm::vec3(attrib.vertices.at(3 * index_a),
-                          attrib.vertices.at(3 * index_a + 1),
-                          attrib.vertices.at(3 * index_a + 2)),
-                glm::vec3(attrib.vertices.at(3 * index_b),
-                          attrib.vertices.at(3 * index_b + 1),
-                          attrib.vertices.at(3 * index_b + 2)),
-                glm::vec3(attrib.vertices.at(3 * index_c),
-                          attrib.vertices.at(3 * index_c + 1),
-                          attrib.vertices.at(3 * index_c + 2)),
-                has_materials
-                    ? glm::vec2(attrib.texcoords.at(2 * tex_index_a),
-                                attrib.texcoords.at(2 * tex_index_a + 1))
-                    : glm::vec2(0.0f),
-                has_materials
-                    ? glm::vec2(attrib.texcoords.at(2 * tex_index_b),
-                                attrib.texcoords.at(2 * tex_index_b + 1))
-                    : glm::vec2(0.0f),
-                has_materials
-                    ? glm::vec2(attrib.texcoords.at(2 * tex_index_c),
-                                attrib.texcoords.at(2 * tex_index_c + 1))
-                    : glm::vec2(0.0f),
-                has_materials ? shape.mesh.material_ids[i / 3] : -1);
-
-            glm::mat3 tri_matrix(tri.a, tri.b, tri.c);
-            glm::mat3 inverse_tri_matrix = glm::inverse(tri_matrix);
-            glm::vec3 unit_plane =
-                glm::normalize(glm::cross(tri.a - tri.c, tri.b - tri.c));
-            if (!std::isfinite(inverse_tri_matrix[0][0]) ||
-                !std::isfinite(inverse_tri_matrix[0][1]) ||
-                !std::isfinite(inverse_tri_matrix[0][2]) ||
-                !std::isfinite(inverse_tri_matrix[1][0]) ||
-                !std::isfinite(inverse_tri_matrix[1][1]) ||
-                !std::isfinite(inverse_tri_matrix[1][2]) ||
-                !std::isfinite(inverse_tri_matrix[2][0]) ||
-                !std::isfinite(inverse_tri_matrix[2][1]) ||
-                !std::isfinite(inverse_tri_matrix[2][2])) {
+  private:
+    const std::vector<Triangle> &triangles_;
+    const TextureMap &textures_;
+    VoxelGrid grid_;
+
+    // Passes every voxel between min_voxel and max_voxel (inclusive) that tri
+    // overlaps to the sink. Returns whether there were any.
+    template <typename Sink>
+    bool voxelize_triangle(const Triangle &tri, glm::uvec3 min_voxel,
+                           glm::uvec3 max_voxel, uint64_t &num_voxels_tested,
+                           uint64_t &num_voxels_in_bounds, Sink &sink) const {
+        glm::mat3 tri_matrix(tri.a, tri.b, tri.c);
+        glm::mat3 inverse_tri_matrix = glm::inverse(tri_matrix);
+        glm::vec3 unit_plane =
+            glm::normalize(glm::cross(tri.a - tri.c, tri.b - tri.c));
+        if (!std::isfinite(inverse_tri_matrix[0][0]) ||
+            !std::isfinite(inverse_tri_matrix[0][1]) ||
+            !std::isfinite(inverse_tri_matrix[0][2]) ||
+            !std::isfinite(inverse_tri_matrix[1][0]) ||
+            !std::isfinite(inverse_tri_matrix[1][1]) ||
+            !std::isfinite(inverse_tri_matrix[1][2]) ||
+            !std::isfinite(inverse_tri_matrix[2][0]) ||
+            !std::isfinite(inverse_tri_matrix[2][1]) ||
+            !std::isfinite(inverse_tri_matrix[2][2])) {
+            return false;
+        }
+
+        int texture_width = 0, texture_height = 0;
+        stbi_uc *texture_pixels = nullptr;
+        if (tri.has_texture) {
+            const auto &texture = textures_.at(tri.face_mat_id);
+            texture_pixels = std::get<0>(texture);
+            texture_width = std::get<1>(texture);
+            texture_height = std::get<2>(texture);
+        }
+
+        min_voxel = glm::max(min_voxel, glm::uvec3(grid_.min_voxel(0, tri.min_x()),
+                                                   grid_.min_voxel(1, tri.min_y()),
+                                                   grid_.min_voxel(2, tri.min_z())));
+        max_voxel = glm::min(max_voxel, glm::uvec3(grid_.max_voxel(0, tri.max_x()),
+                                                   grid_.max_voxel(1, tri.max_y()),
+                                                   grid_.max_voxel(2, tri.max_z())));
+        if (min_voxel.x > max_voxel.x || min_voxel.y > max_voxel.y ||
+            min_voxel.z > max_voxel.z) {
+            return false;
+        }
+        num_voxels_in_bounds +=
+            static_cast<uint64_t>(max_voxel.x - min_voxel.x + 1) *
+            (max_voxel.y - min_voxel.y + 1) * (max_voxel.z - min_voxel.z + 1);
+
+        bool covers_voxel = false;
+        TriangleBoxTest box_test(tri, glm::vec3(grid_.voxel_size));
+        PlaneBand band(box_test, grid_.min, grid_.step);
+        for (uint32_t x = min_voxel.x; x <= max_voxel.x; ++x) {
+            uint32_t row_min_y = min_voxel.y, row_max_y = max_voxel.y;
+            if (!band.narrow_y(x, min_voxel.z, max_voxel.z, row_min_y, row_max_y)) {
                 continue;
             }
+            for (uint32_t y = row_min_y; y <= row_max_y; ++y) {
+                uint32_t column_min_z = min_voxel.z, column_max_z = max_voxel.z;
+                if (!band.narrow_z(x, y, column_min_z, column_max_z)) {
+                    continue;
+                }
+                float tri_voxel_x = grid_.center(0, x);
+                float tri_voxel_y = grid_.center(1, y);
+                for (uint32_t row_z = column_min_z; row_z <= column_max_z;
+                     row_z += TriangleBoxTest::MAX_ROW_LENGTH) {
+                    uint32_t row_length = std::min(column_max_z - row_z + 1,
+                                                   TriangleBoxTest::MAX_ROW_LENGTH);
+                    num_voxels_tested += row_length;
+                    float row_voxel_z[TriangleBoxTest::MAX_ROW_LENGTH];
+                    for (uint32_t i = 0; i < row_length; ++i) {
+                        row_voxel_z[i] = grid_.center(2, row_z + i);
+                    }
+                    uint32_t row_overlaps = box_test.overlaps_row(
+                        tri_voxel_x, tri_voxel_y, row_voxel_z, row_length);
+                    covers_voxel = covers_voxel || row_overlaps;
+                    while (row_overlaps) {
+                        uint32_t z = row_z + std::countr_zero(row_overlaps);
+                        float tri_voxel_z = row_voxel_z[z - row_z];
+                        row_overlaps &= row_overlaps - 1;
+                        std::byte r = static_cast<std::byte>(255),
+                                  g = static_cast<std::byte>(255),
+                                  b = static_cast<std::byte>(255),
+                                  a = static_cast<std::byte>(255);
+                        glm::vec3 plane_point =
+                            glm::vec3(tri_voxel_x, tri_voxel_y, tri_voxel_z);
+                        float plane_distance =
+                            glm::dot(unit_plane, plane_point - tri.a);
+                        plane_point -= unit_plane * plane_distance;
+                        glm::vec3 barycentric_coords = inverse_tri_matrix * plane_point;
 
-            int texture_width, texture_height;
-            stbi_uc *texture_pixels;
-            if (has_materials) {
-                if (loaded_textures.contains(tri.face_mat_id)) {
-                    auto texture = loaded_textures[tri.face_mat_id];
-                    texture_pixels = std::get<0>(texture);
-                    texture_width = std::get<1>(texture);
-                    texture_height = std::get<2>(texture);
-                } else {
-                    const tinyobj::material_t &mat = materials[tri.face_mat_id];
-                    const std::string &diffuse_texname = mat.diffuse_texname;
-                    if (diffuse_texname.empty()) {
-                        has_materials = false;
-                    } else {
-                        int channels;
-                        texture_pixels =
-                            stbi_load((directory + diffuse_texname).c_str(),
-                                      &texture_width, &texture_height,
-                                      &channels, STBI_rgb_alpha);
-                        if (!texture_pixels) {
-                            std::stringstream ss;
-                            ss << "Couldn't load texture from the following "
-                                  "path: ";
-                            ss << (directory + diffuse_texname);
-                            ss << "\n";
-                            ASSERT(false, ss.str());
+                        if (tri.has_texture) {
+                            glm::vec2 uv = tri.t_a * barycentric_coords.x +
+                                           tri.t_b * barycentric_coords.y +
+                                           tri.t_c * barycentric_coords.z;
+                            int tex_x = static_cast<int>(uv.x * texture_width);
+                            int tex_y = static_cast<int>(uv.y * texture_height);
+                            while (tex_x < 0) {
+                                tex_x += texture_width;
+                            }
+                            while (tex_x >= texture_width) {
+                                tex_x -= texture_width;
+                            }
+                            while (tex_y < 0) {
+                                tex_y += texture_height;
+                            }
+                            while (tex_y >= texture_height) {
+                                tex_y -= texture_height;
+                            }
+                            int linear_coord = tex_x + tex_y * texture_width;
+
+                            if (texture_pixels[linear_coord * 4 + 3]) {
+                                r = static_cast<std::byte>(texture_pixels[linear_coord * 4]);
+                                g = static_cast<std::byte>(texture_pixels[linear_coord * 4 + 1]);
+                                b = static_cast<std::byte>(texture_pixels[linear_coord * 4 + 2]);
+                                a = static_cast<std::byte>(255);
+                            } else {
+                                r = static_cast<std::byte>(0);
+                                g = static_cast<std::byte>(0);
+                                b = static_cast<std::byte>(0);
+                                a = static_cast<std::byte>(0);
+                            }
                         }
-                        loaded_textures[tri.face_mat_id] = {
-                            texture_pixels, texture_width, texture_height};
+
+                        std::byte rgba[4] = {r, g, b, a};
+                        uint32_t voxel;
+                        memcpy(&voxel, rgba, sizeof(uint32_t));
+                        sink(x, y, z, VoxelHit{voxel, unit_plane, std::abs(plane_distance)});
                     }
                 }
             }
+        }
+        return covers_voxel;
+    }
+};
 
-            uint32_t min_voxel_x = static_cast<uint32_t>(
-                floor(((tri.min_x() - min.x) / (max.x - min.x)) *
-                      static_cast<float>(chunk_width)));
-            uint32_t min_voxel_y = static_cast<uint32_t>(
-                floor(((tri.min_y() - min.y) / (max.y - min.y)) *
-                      static_cast<float>(chunk_height)));
-            uint32_t min_voxel_z = static_cast<uint32_t>(
-                floor(((tri.min_z() - min.z) / (max.z - min.z)) *
-                      static_cast<float>(chunk_depth)));
-            uint32_t max_voxel_x = static_cast<uint32_t>(
-                ceil(((tri.max_x() - min.x) / (max.x - min.x)) *
-                     static_cast<float>(chunk_width)));
-            uint32_t max_voxel_y = static_cast<uint32_t>(
-                ceil(((tri.max_y() - min.y) / (max.y - min.y)) *
-                     static_cast<float>(chunk_height)));
-            uint32_t max_voxel_z = static_cast<uint32_t>(
-                ceil(((tri.max_z() - min.z) / (max.z - min.z)) *
-                     static_cast<float>(chunk_depth)));
-            if (max_voxel_x >= chunk_width) {
-                max_voxel_x = chunk_width - 1;
-            }
-            if (max_voxel_y >= chunk_height) {
-                max_voxel_y = chunk_height - 1;
+// A voxel with VoxelResolve::NearestTriangle is a VoxelHit packed into 64
+// bits, so that packed hits order like their distances, with ties going to
+// the smaller color. Distances are never negative, so their bits already
+// order like they do. Voxels no triangle covers are all ones.
+static constexpr uint64_t NO_NEAREST_HIT = ~static_cast<uint64_t>(0);
+
+static uint64_t pack_nearest_hit(const VoxelHit &hit) {
+    return (static_cast<uint64_t>(std::bit_cast<uint32_t>(hit.distance)) << 32) |
+           hit.voxel;
+}
+
+// Keeps whichever of the voxel and hit is nearer, without locking, so the
+// voxel ends up with the nearest hit whatever order hits are stored in.
+static void store_nearest_hit(std::atomic_uint64_t &voxel, const VoxelHit &hit) {
+    const uint64_t packed = pack_nearest_hit(hit);
+    uint64_t current = voxel.load(std::memory_order_relaxed);
+    while (packed < current &&
+           !voxel.compare_exchange_weak(current, packed, std::memory_order_relaxed)) {
+    }
+}
+
+// The words of a voxel with attribute_set, each a uint32_t: its RGBA color,
+// followed by its normal, packed by pack_normal, for ColorNormal.
+static uint32_t words_per_voxel(VoxelChunk::AttributeSet attribute_set) {
+    ASSERT(attribute_set == VoxelChunk::AttributeSet::Color ||
+               attribute_set == VoxelChunk::AttributeSet::ColorNormal,
+           "Models can only be voxelized with the Color or ColorNormal "
+           "attribute sets.");
+    return attribute_set == VoxelChunk::AttributeSet::ColorNormal ? 2 : 1;
+}
+
+// The grid voxel_size wide voxels are stretched to exactly fit a model with
+// the given bounds in (along with the origin), and sets size to its size.
+static VoxelGrid fit_voxel_grid(glm::vec3 model_min, glm::vec3 model_max,
+                                float voxel_size, glm::uvec3 &size) {
+    glm::vec3 min = glm::min(model_min, glm::vec3(0.0f));
+    glm::vec3 max = glm::max(model_max, glm::vec3(0.0f));
+    size = glm::uvec3(static_cast<uint32_t>(ceil((max.x - min.x) / voxel_size)),
+                      static_cast<uint32_t>(ceil((max.y - min.y) / voxel_size)),
+                      static_cast<uint32_t>(ceil((max.z - min.z) / voxel_size)));
+    // The grid is stretched to exactly fit the model, so its voxels are a
+    // little closer together than they are wide.
+    return {min,
+            glm::vec3((max.x - min.x) / size.x, (max.y - min.y) / size.y,
+                      (max.z - min.z) / size.z),
+            voxel_size};
+}
+
+// Voxelizes the triangles into the region of a grid of the given size with
+// VoxelResolve::LastTriangle, and passes the covered voxels to the sink the
+// way voxelize_dense_grid does, with rows numbered top down.
+template <typename Sink>
+static VoxelizeStatistics voxelize_last_triangle(
+    const VoxelizationCore &core, std::span<const uint32_t> triangle_indices,
+    glm::uvec3 region_min, glm::uvec3 region_max, glm::uvec3 size,
+    uint32_t slab_depth, ctpl::thread_pool *pool, bool accumulate_normals,
+    Sink &&sink, bool report_progress = false) {
+    // Normals are summed per layer of voxels along z, keyed by x + y * width,
+    // so slabs never share a layer. The last normal is kept for voxels whose
+    // triangles' normals cancel out.
+    struct NormalSum {
+        uint32_t color = 0;
+        glm::vec3 sum = glm::vec3(0.0f);
+        glm::vec3 last = glm::vec3(0.0f);
+    };
+    std::vector<std::unordered_map<uint64_t, NormalSum>> normal_layers(
+        accumulate_normals ? region_max.z - region_min.z + 1 : 0);
+
+    VoxelizeStatistics statistics = core.voxelize(
+        triangle_indices, region_min, region_max, slab_depth, pool,
+        [&](uint32_t x, uint32_t y, uint32_t z, const VoxelHit &hit) {
+            if (!accumulate_normals) {
+                sink(x, size.y - y - 1, z, std::span<const uint32_t>(&hit.voxel, 1));
+                return;
             }
-            if (max_voxel_z >= chunk_depth) {
-                max_voxel_z = chunk_depth - 1;
+            NormalSum &normal_sum =
+                normal_layers[z - region_min.z][x + static_cast<uint64_t>(y) * size.x];
+            normal_sum.color = hit.voxel;
+            normal_sum.sum += hit.normal;
+            normal_sum.last = hit.normal;
+        },
+        report_progress);
+
+    for (uint32_t layer = 0; layer < normal_layers.size(); ++layer) {
+        for (const auto &[key, normal_sum] : normal_layers[layer]) {
+            if (!normal_sum.color) {
+                continue;
             }
+            glm::vec3 normal = glm::dot(normal_sum.sum, normal_sum.sum) > 1e-12f
+                                   ? normal_sum.sum
+                                   : normal_sum.last;
+            // Rows are flipped, so normals are too.
+            normal.y = -normal.y;
+            const uint32_t voxel[2] = {normal_sum.color,
+                                       pack_normal(glm::normalize(normal))};
+            uint32_t x = static_cast<uint32_t>(key % size.x);
+            uint32_t y = static_cast<uint32_t>(key / size.x);
+            sink(x, size.y - y - 1, region_min.z + layer,
+                 std::span<const uint32_t>(voxel, 2));
+        }
+    }
+    return statistics;
+}
 
-            for (uint32_t x = min_voxel_x; x <= max_voxel_x; ++x) {
-                for (uint32_t y = min_voxel_y; y <= max_voxel_y; ++y) {
-                    for (uint32_t z = min_voxel_z; z <= max_voxel_z; ++z) {
-                        float tri_voxel_x = static_cast<float>(x) /
-                                                chunk_width * (max.x - min.x) +
-                                            min.x;
-                        float tri_voxel_y = static_cast<float>(y) /
-                                                chunk_height * (max.y - min.y) +
-                                            min.y;
-                        float tri_voxel_z = static_cast<float>(z) /
-                                                chunk_depth * (max.z - min.z) +
-                                            min.z;
-                        if (tri.tri_aabb(
-                                     glm::vec3(tri_voxel_x, tri_voxel_y,
-                                               tri_voxel_z),
-                                     glm::vec3(voxel_size))) {
-                            std::byte r = static_cast<std::byte>(255),
-                                      g = static_cast<std::byte>(255),
-                                      b = static_cast<std::byte>(255),
-                                      a = static_cast<std::byte>(255);
-                            glm::vec3 plane_point = glm::vec3(
-                                tri_voxel_x, tri_voxel_y, tri_voxel_z);
-                            plane_point -=
-                                unit_plane *
-                                (glm::dot(unit_plane, plane_point - tri.a));
-                            glm::vec3 barycentric_coords =
-                                inverse_tri_matrix * plane_point;
-
-                            if (has_materials) {
-                                glm::vec2 uv = tri.t_a * barycentric_coords.x +
-                                               tri.t_b * barycentric_coords.y +
-                                               tri.t_c * barycentric_coords.z;
-                                int tex_x =
-                                    static_cast<int>(uv.x * texture_width);
-                                int tex_y =
-                                    static_cast<int>(uv.y * texture_height);
-                                while (tex_x < 0) {
-                                    tex_x += texture_width;
-                                }
-                                while (tex_x >= texture_width) {
-                                    tex_x -= texture_width;
-                                }
-                                while (tex_y < 0) {
-                                    tex_y += texture_height;
-                                }
-                                while (tex_y >= texture_height) {
-                                    tex_y -= texture_height;
-                                }
-                                int linear_coord =
-                                    tex_x + tex_y * texture_width;
-                                if (texture_pixels[linear_coord * 4 + 3]) {
-                                    r = static_cast<std::byte>(
-                                        texture_pixels[linear_coord * 4]);
-                                    g = static_cast<std::byte>(
-                                        texture_pixels[linear_coord * 4 + 1]);
-                                    b = static_cast<std::byte>(
-                                        texture_pixels[linear_coord * 4 + 2]);
-                                    a = static_cast<std::byte>(255);
-                                } else {
-                                    r = static_cast<std::byte>(0);
-                                    g = static_cast<std::byte>(0);
-                                    b = static_cast<std::byte>(0);
-                                    a = static_cast<std::byte>(0);
-                                }
-                            }
+// Voxelizes every triangle of the model at filepath into voxel_size wide
+// voxels, stretched to exactly fit the model's bounds (which always span the
+// origin too). Calls allocate(size) with the grid's size once it's known,
+// then sink(x, y, z, voxel) for covered voxels, with rows numbered top down,
+// which is how both raw_voxelize_obj and brick_voxelize_obj store them. voxel
+// is a span of words_per_voxel(attribute_set) words. For Color, the sink sees
+// every voxel VoxelizationCore does, so the last one passed in wins. For
+// ColorNormal, each voxel is passed in once, after voxelizing, with the last
+// color and the sum of the normals of every triangle covering it. With
+// VoxelResolve::NearestTriangle (only for Color), each voxel is passed in
+// once too, with its nearest triangle's color. Slabs are a multiple of
+// slab_alignment voxels deep.
+template <typename Allocate, typename Sink>
+static void voxelize_dense_grid(std::string_view filepath, float voxel_size,
+                                uint32_t num_threads, uint32_t slab_alignment,
+                                VoxelChunk::AttributeSet attribute_set,
+                                VoxelResolve resolve, Allocate &&allocate,
+                                Sink &&sink) {
+    std::cout << filepath << " " << voxel_size << "\n";
+
+    const bool accumulate_normals = words_per_voxel(attribute_set) == 2;
+    ASSERT(resolve == VoxelResolve::LastTriangle || !accumulate_normals,
+           "Only the Color attribute set can be voxelized with the nearest "
+           "triangle's color.");
+    num_threads = std::max(num_threads, 1U);
+    Model model(filepath, num_threads);
+
+    glm::uvec3 size;
+    VoxelGrid grid = fit_voxel_grid(model.get_min(), model.get_max(), voxel_size, size);
+    glm::vec3 max = glm::max(model.get_max(), glm::vec3(0.0f));
+    std::cout << "Bottom corner: (" << grid.min.x << ", " << grid.min.y << ", "
+              << grid.min.z << ")\n";
+    std::cout << "Top corner: (" << max.x << ", " << max.y << ", " << max.z
+              << ")\n";
+    const uint32_t chunk_width = size.x, chunk_height = size.y, chunk_depth = size.z;
+    std::cout << "Chunk size: (" << chunk_width << ", " << chunk_height << ", "
+              << chunk_depth << ")\n";
+    allocate(size);
 
-                            size_t voxel_idx =
-                                x + (chunk_height - y - 1) * chunk_width +
-                                z * chunk_width * chunk_height;
-                            data.at(voxel_idx * 4) = r;
-                            data.at(voxel_idx * 4 + 1) = g;
-                            data.at(voxel_idx * 4 + 2) = b;
-                            data.at(voxel_idx * 4 + 3) = a;
+    std::unique_ptr<ctpl::thread_pool> pool;
+    if (num_threads > 1) {
+        pool = std::make_unique<ctpl::thread_pool>(num_threads);
+    }
+    VoxelizationCore core(model.get_triangles(), model.get_textures(), grid);
+    std::vector<uint32_t> triangle_indices(model.get_triangles().size());
+    std::iota(triangle_indices.begin(), triangle_indices.end(), 0);
+    const uint32_t slab_depth =
+        (choose_slab_depth(chunk_depth, num_threads) + slab_alignment - 1) /
+        slab_alignment * slab_alignment;
+
+    const glm::uvec3 grid_max(chunk_width - 1, chunk_height - 1, chunk_depth - 1);
+    VoxelizeStatistics statistics;
+    if (resolve == VoxelResolve::NearestTriangle) {
+        // Triangles are split between threads, which all write into one grid
+        // of packed hits.
+        const uint64_t num_voxels =
+            static_cast<uint64_t>(chunk_width) * chunk_height * chunk_depth;
+        std::vector<std::atomic_uint64_t> nearest(num_voxels);
+        for (std::atomic_uint64_t &voxel : nearest) {
+            voxel.store(NO_NEAREST_HIT, std::memory_order_relaxed);
+        }
+        const uint32_t batches_per_thread = 4;
+        statistics = core.voxelize_batches(
+            triangle_indices, glm::uvec3(0), grid_max,
+            num_threads * batches_per_thread, pool.get(),
+            [&](uint32_t x, uint32_t y, uint32_t z, const VoxelHit &hit) {
+                store_nearest_hit(
+                    nearest[x + static_cast<uint64_t>(y) * chunk_width +
+                            static_cast<uint64_t>(z) * chunk_width * chunk_height],
+                    hit);
+            });
+
+        for_each_slab(pool.get(), 0, grid_max.z, slab_depth,
+                      [&](uint32_t, uint32_t slab_min_z, uint32_t slab_max_z) {
+            for (uint32_t z = slab_min_z; z <= slab_max_z; ++z) {
+                for (uint32_t y = 0; y < chunk_height; ++y) {
+                    for (uint32_t x = 0; x < chunk_width; ++x) {
+                        uint64_t packed = nearest[x + static_cast<uint64_t>(y) * chunk_width +
+                                                  static_cast<uint64_t>(z) * chunk_width * chunk_height]
+                                              .load(std::memory_order_relaxed);
+                        uint32_t voxel = static_cast<uint32_t>(packed);
+                        if (packed != NO_NEAREST_HIT && voxel) {
+                            sink(x, chunk_height - y - 1, z,
+                                 std::span<const uint32_t>(&voxel, 1));
                         }
                     }
                 }
             }
+        });
+    } else {
+        statistics = voxelize_last_triangle(core, triangle_indices, glm::uvec3(0),
+                                            grid_max, size, slab_depth, pool.get(),
+                                            accumulate_normals, sink, true);
+    }
+    std::cout << "INFO: Tested " << statistics.num_voxels_tested
+              << " voxels against triangles (sweeping their bounding boxes "
+                 "would have tested "
+              << statistics.num_voxels_in_bounds << ").\n";
+}
 
-            if (i * 100 / shape.mesh.indices.size() - num_printed >= 10) {
-                num_printed = i * 100 / shape.mesh.indices.size();
-                std::cout << num_printed << "% finished.\n";
+std::vector<std::byte> raw_voxelize_obj(std::string_view filepath,
+                                        float voxel_size,
+                                        uint32_t &out_chunk_width,
+                                        uint32_t &out_chunk_height,
+                                        uint32_t &out_chunk_depth,
+                                        uint32_t num_threads,
+                                        VoxelChunk::AttributeSet attribute_set,
+                                        VoxelResolve resolve) {
+    const uint32_t bytes_per_voxel =
+        words_per_voxel(attribute_set) * sizeof(uint32_t);
+    std::vector<std::byte> data;
+    glm::uvec3 size;
+    voxelize_dense_grid(
+        filepath, voxel_size, num_threads, 1, attribute_set, resolve,
+        [&](glm::uvec3 grid_size) {
+            size = grid_size;
+            data.resize(static_cast<size_t>(size.x) * size.y * size.z *
+                            bytes_per_voxel,
+                        static_cast<std::byte>(0));
+        },
+        [&](uint32_t x, uint32_t y, uint32_t z, std::span<const uint32_t> voxel) {
+            size_t voxel_idx = x + static_cast<size_t>(y) * size.x +
+                               static_cast<size_t>(z) * size.x * size.y;
+            memcpy(data.data() + voxel_idx * bytes_per_voxel, voxel.data(),
+                   bytes_per_voxel);
+        });
+
+    out_chunk_width = size.x;
+    out_chunk_height = size.y;
+    out_chunk_depth = size.z;
+    return data;
+}
+
+// Gathers the voxels voxelize_dense_grid passes its sink into bricks. They're
+// kept per layer of bricks along z, and slabs are whole layers deep, so no two
+// threads ever touch the same layer.
+class BrickCollector {
+  public:
+    static constexpr uint32_t BRICK_EDGE = MortonBrickStream::BRICK_EDGE;
+    static constexpr uint32_t BRICK_VOLUME = MortonBrickStream::BRICK_VOLUME;
+
+    BrickCollector(VoxelChunk::AttributeSet attribute_set, glm::uvec3 size)
+        : words_(words_per_voxel(attribute_set)), size_(size),
+          layers_((size.z + BRICK_EDGE - 1) / BRICK_EDGE) {}
+
+    void store(uint32_t x, uint32_t y, uint32_t z, std::span<const uint32_t> voxel) {
+        uint64_t key = libmorton::morton3D_64_encode(
+            x / BRICK_EDGE, y / BRICK_EDGE, z / BRICK_EDGE);
+        std::unique_ptr<uint32_t[]> &brick = layers_[z / BRICK_EDGE][key];
+        if (!brick) {
+            if (!voxel[0]) {
+                return;
             }
+            brick = std::make_unique<uint32_t[]>(BRICK_VOLUME * words_);
         }
+        uint32_t in_brick = libmorton::morton3D_32_encode(
+            x % BRICK_EDGE, y % BRICK_EDGE, z % BRICK_EDGE);
+        std::copy(voxel.begin(), voxel.end(), &brick[in_brick * words_]);
     }
-    std::cout << "100% finished.\n";
 
-    for (auto [_, tex] : loaded_textures) {
-        stbi_image_free(std::get<0>(tex));
+    // The bricks stored so far, sorted.
+    MortonBrickStream finish() const {
+        const uint32_t bytes_per_brick = BRICK_VOLUME * words_ * sizeof(uint32_t);
+
+        // A brick can end up empty if transparent texels overwrote all of it.
+        std::vector<std::pair<uint64_t, const uint32_t *>> bricks;
+        for (const auto &layer : layers_) {
+            for (const auto &[key, brick] : layer) {
+                if (std::any_of(brick.get(), brick.get() + BRICK_VOLUME * words_,
+                                [](uint32_t word) { return word != 0; })) {
+                    bricks.emplace_back(key, brick.get());
+                }
+            }
+        }
+        std::sort(bricks.begin(), bricks.end());
+
+        MortonBrickStream stream;
+        stream.width = size_.x;
+        stream.height = size_.y;
+        stream.depth = size_.z;
+        stream.bytes_per_voxel = words_ * sizeof(uint32_t);
+        stream.keys.reserve(bricks.size());
+        stream.voxels.resize(bricks.size() * bytes_per_brick);
+        for (uint64_t i = 0; i < bricks.size(); ++i) {
+            stream.keys.push_back(bricks[i].first);
+            memcpy(&stream.voxels[i * bytes_per_brick], bricks[i].second,
+                   bytes_per_brick);
+        }
+        return stream;
     }
 
-    out_chunk_width = chunk_width;
-    out_chunk_height = chunk_height;
-    out_chunk_depth = chunk_depth;
-    return data;
+  private:
+    uint32_t words_;
+    glm::uvec3 size_;
+    std::vector<std::unordered_map<uint64_t, std::unique_ptr<uint32_t[]>>> layers_;
+};
+
+MortonBrickStream brick_voxelize_obj(std::string_view filepath,
+                                     float voxel_size, uint32_t num_threads,
+                                     VoxelChunk::AttributeSet attribute_set) {
+    std::unique_ptr<BrickCollector> collector;
+    voxelize_dense_grid(
+        filepath, voxel_size, num_threads, BrickCollector::BRICK_EDGE,
+        attribute_set, VoxelResolve::LastTriangle,
+        [&](glm::uvec3 grid_size) {
+            collector = std::make_unique<BrickCollector>(attribute_set, grid_size);
+        },
+        [&](uint32_t x, uint32_t y, uint32_t z, std::span<const uint32_t> voxel) {
+            collector->store(x, y, z, voxel);
+        });
+
+    MortonBrickStream stream = collector->finish();
+    std::cout << "INFO: Voxelized " << stream.size() << " non-empty bricks ("
+              << stream.memory_usage() << " bytes), where a raw grid would take "
+              << static_cast<uint64_t>(stream.width) * stream.height * stream.depth *
+                     stream.bytes_per_voxel
+              << " bytes.\n";
+    return stream;
+}
+
+// Triangles are compared and hashed field by field, since whatever padding
+// follows has_texture needn't match.
+static bool same_triangle(const Triangle &a, const Triangle &b) {
+    return !memcmp(&a, &b, offsetof(Triangle, has_texture)) &&
+           a.has_texture == b.has_texture;
+}
+
+static uint64_t hash_triangle(const Triangle &tri) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint64_t i = 0; i < offsetof(Triangle, has_texture); i += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, reinterpret_cast<const std::byte *>(&tri) + i, sizeof(uint32_t));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    return (hash ^ tri.has_texture) * 0x100000001b3ULL;
+}
+
+static bool same_textures(const VoxelizationCore::TextureMap &a,
+                          const VoxelizationCore::TextureMap &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (const auto &[material_id, texture] : a) {
+        auto other = b.find(material_id);
+        if (other == b.end()) {
+            return false;
+        }
+        auto [pixels, width, height] = texture;
+        auto [other_pixels, other_width, other_height] = other->second;
+        if (width != other_width || height != other_height ||
+            (pixels != other_pixels &&
+             memcmp(pixels, other_pixels, static_cast<uint64_t>(width) * height * 4))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<MortonBrickStream> brick_revoxelize_obj(
+    std::string_view filepath, const MeshCache &previous, float voxel_size,
+    uint32_t num_threads, VoxelChunk::AttributeSet attribute_set,
+    std::vector<std::pair<uint64_t, uint64_t>> &out_dirty_ranges) {
+    // Tiles are 8^3 bricks, so a tile's key is its bricks' keys over 512, and
+    // it holds the voxels whose Morton codes share all but the lowest 18 bits.
+    constexpr uint32_t TILE_EDGE = 64;
+    constexpr uint32_t TILE_BITS = 18;
+
+    num_threads = std::max(num_threads, 1U);
+    Model model(filepath, num_threads);
+
+    glm::uvec3 size, previous_size;
+    VoxelGrid grid = fit_voxel_grid(model.get_min(), model.get_max(), voxel_size, size);
+    VoxelGrid previous_grid = fit_voxel_grid(previous.get_min(), previous.get_max(),
+                                             voxel_size, previous_size);
+    if (size != previous_size || grid.min != previous_grid.min ||
+        grid.step != previous_grid.step) {
+        std::cout << "INFO: The model's bounds changed, so every voxel moved.\n";
+        return std::nullopt;
+    }
+    if (!same_textures(model.get_textures(), previous.get_textures())) {
+        std::cout << "INFO: The model's textures changed.\n";
+        return std::nullopt;
+    }
+
+    // Calls visit(key) for every tile tri's bounding box overlaps, in the
+    // stored grid, whose rows are numbered top down.
+    auto for_each_tile = [&](const Triangle &tri, auto &&visit) {
+        glm::uvec3 min_voxel(grid.min_voxel(0, tri.min_x()), grid.min_voxel(1, tri.min_y()),
+                             grid.min_voxel(2, tri.min_z()));
+        glm::uvec3 max_voxel = glm::min(
+            glm::uvec3(grid.max_voxel(0, tri.max_x()), grid.max_voxel(1, tri.max_y()),
+                       grid.max_voxel(2, tri.max_z())),
+            size - 1U);
+        if (min_voxel.x > max_voxel.x || min_voxel.y > max_voxel.y ||
+            min_voxel.z > max_voxel.z) {
+            return;
+        }
+        std::tie(min_voxel.y, max_voxel.y) =
+            std::make_pair(size.y - max_voxel.y - 1, size.y - min_voxel.y - 1);
+        for (uint32_t z = min_voxel.z / TILE_EDGE; z <= max_voxel.z / TILE_EDGE; ++z) {
+            for (uint32_t y = min_voxel.y / TILE_EDGE; y <= max_voxel.y / TILE_EDGE; ++y) {
+                for (uint32_t x = min_voxel.x / TILE_EDGE; x <= max_voxel.x / TILE_EDGE; ++x) {
+                    visit(libmorton::morton3D_64_encode(x, y, z));
+                }
+            }
+        }
+    };
+
+    // A voxel keeps its color as long as the same triangles cover it, in the
+    // same order. So the triangles are matched up with the previous ones,
+    // and every tile a triangle without a match overlaps is dirty. Unchanged
+    // runs at either end are matched up as they are, and the rest by
+    // content, each to the first identical triangle not matched yet.
+    const std::vector<Triangle> &triangles = model.get_triangles();
+    std::span<const Triangle> previous_triangles = previous.get_triangles();
+    std::unordered_set<uint64_t> dirty_tiles;
+    auto mark_dirty = [&](const Triangle &tri) {
+        for_each_tile(tri, [&](uint64_t key) { dirty_tiles.insert(key); });
+    };
+    const uint64_t num_common = std::min<uint64_t>(triangles.size(), previous_triangles.size());
+    uint64_t prefix = 0, suffix = 0;
+    while (prefix < num_common && same_triangle(triangles[prefix], previous_triangles[prefix])) {
+        ++prefix;
+    }
+    while (suffix < num_common - prefix &&
+           same_triangle(triangles[triangles.size() - suffix - 1],
+                         previous_triangles[previous_triangles.size() - suffix - 1])) {
+        ++suffix;
+    }
+
+    // Each bucket lists its previous triangles last to first.
+    std::unordered_map<uint64_t, std::vector<uint32_t>> unmatched;
+    for (uint64_t i = previous_triangles.size() - suffix; i-- > prefix;) {
+        unmatched[hash_triangle(previous_triangles[i])].push_back(i);
+    }
+    std::vector<uint32_t> matches;
+    uint64_t num_changed = 0;
+    for (uint64_t i = prefix; i < triangles.size() - suffix; ++i) {
+        bool matched = false;
+        auto bucket = unmatched.find(hash_triangle(triangles[i]));
+        if (bucket != unmatched.end()) {
+            std::vector<uint32_t> &candidates = bucket->second;
+            for (uint64_t j = candidates.size(); j-- > 0 && !matched;) {
+                if (same_triangle(triangles[i], previous_triangles[candidates[j]])) {
+                    matches.push_back(candidates[j]);
+                    candidates.erase(candidates.begin() + j);
+                    matched = true;
+                }
+            }
+        }
+        if (!matched) {
+            mark_dirty(triangles[i]);
+            ++num_changed;
+        }
+    }
+    for (const auto &[hash, bucket] : unmatched) {
+        for (uint32_t j : bucket) {
+            mark_dirty(previous_triangles[j]);
+            ++num_changed;
+        }
+    }
+
+    // Matched triangles that moved relative to each other changed too. The
+    // longest run of matches still in their previous order stays put, and
+    // the rest count as moved.
+    std::vector<uint32_t> run_ends, predecessors(matches.size());
+    for (uint32_t i = 0; i < matches.size(); ++i) {
+        auto end = std::lower_bound(run_ends.begin(), run_ends.end(), i,
+                                    [&](uint32_t a, uint32_t b) { return matches[a] < matches[b]; });
+        predecessors[i] = end == run_ends.begin() ? UINT32_MAX : *std::prev(end);
+        if (end == run_ends.end()) {
+            run_ends.push_back(i);
+        } else {
+            *end = i;
+        }
+    }
+    std::vector<bool> in_order(matches.size());
+    for (uint32_t i = run_ends.empty() ? UINT32_MAX : run_ends.back(); i != UINT32_MAX;
+         i = predecessors[i]) {
+        in_order[i] = true;
+    }
+    for (uint32_t i = 0; i < matches.size(); ++i) {
+        if (!in_order[i]) {
+            mark_dirty(previous_triangles[matches[i]]);
+            ++num_changed;
+        }
+    }
+
+    std::vector<uint64_t> tiles(dirty_tiles.begin(), dirty_tiles.end());
+    std::sort(tiles.begin(), tiles.end());
+    std::unordered_map<uint64_t, uint32_t> tile_indices;
+    for (uint32_t i = 0; i < tiles.size(); ++i) {
+        tile_indices.emplace(tiles[i], i);
+    }
+    std::vector<std::vector<uint32_t>> tile_triangles(tiles.size());
+    for (uint32_t i = 0; i < triangles.size() && !tiles.empty(); ++i) {
+        for_each_tile(triangles[i], [&](uint64_t key) {
+            auto tile = tile_indices.find(key);
+            if (tile != tile_indices.end()) {
+                tile_triangles[tile->second].push_back(i);
+            }
+        });
+    }
+
+    // Each dirty tile is voxelized again from scratch, with every triangle
+    // overlapping it, in order.
+    std::unique_ptr<ctpl::thread_pool> pool;
+    if (num_threads > 1) {
+        pool = std::make_unique<ctpl::thread_pool>(num_threads);
+    }
+    VoxelizationCore core(triangles, model.get_textures(), grid);
+    BrickCollector collector(attribute_set, size);
+    const bool accumulate_normals = words_per_voxel(attribute_set) == 2;
+    uint64_t num_voxels_tested = 0;
+    out_dirty_ranges.clear();
+    for (uint32_t i = 0; i < tiles.size(); ++i) {
+        uint_fast32_t x, y, z;
+        libmorton::morton3D_64_decode(tiles[i], x, y, z);
+        glm::uvec3 region_min = glm::uvec3(x, y, z) * TILE_EDGE;
+        glm::uvec3 region_max = glm::min(region_min + (TILE_EDGE - 1), size - 1U);
+        std::tie(region_min.y, region_max.y) =
+            std::make_pair(size.y - region_max.y - 1, size.y - region_min.y - 1);
+        num_voxels_tested +=
+            voxelize_last_triangle(core, tile_triangles[i], region_min, region_max, size,
+                                   BrickCollector::BRICK_EDGE, pool.get(), accumulate_normals,
+                                   [&](uint32_t x, uint32_t y, uint32_t z,
+                                       std::span<const uint32_t> voxel) {
+                                       collector.store(x, y, z, voxel);
+                                   })
+                .num_voxels_tested;
+
+        uint64_t begin = tiles[i] << TILE_BITS, end = (tiles[i] + 1) << TILE_BITS;
+        if (!out_dirty_ranges.empty() && out_dirty_ranges.back().second == begin) {
+            out_dirty_ranges.back().second = end;
+        } else {
+            out_dirty_ranges.emplace_back(begin, end);
+        }
+    }
+
+    MortonBrickStream stream = collector.finish();
+    std::cout << "INFO: " << num_changed << " triangles changed, so " << tiles.size()
+              << " tiles of " << TILE_EDGE << "^3 voxels were voxelized again, into "
+              << stream.size() << " non-empty bricks (testing " << num_voxels_tested
+              << " voxels).\n";
+    return stream;
 }
 
 bool Triangle::tri_aabb_sat(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 aabb,
@@ -349,19 +1059,225 @@ bool Triangle::tri_aabb(glm::vec3 aabb_center, glm::vec3 aabb_extents) const {
     return true;
 }
 
-Model::Model(std::string_view filepath) {
+TriangleBoxTest::TriangleBoxTest(const Triangle &tri, glm::vec3 aabb_extents) {
+    vertices_[0] = tri.a;
+    vertices_[1] = tri.b;
+    vertices_[2] = tri.c;
+
+    glm::vec3 ab = glm::normalize(tri.b - tri.a);
+    glm::vec3 bc = glm::normalize(tri.c - tri.b);
+    glm::vec3 ca = glm::normalize(tri.a - tri.c);
+
+    axes_[0] = glm::vec3(0.0, -ab.z, ab.y);
+    axes_[1] = glm::vec3(0.0, -bc.z, bc.y);
+    axes_[2] = glm::vec3(0.0, -ca.z, ca.y);
+    axes_[3] = glm::vec3(ab.z, 0.0, -ab.x);
+    axes_[4] = glm::vec3(bc.z, 0.0, -bc.x);
+    axes_[5] = glm::vec3(ca.z, 0.0, -ca.x);
+    axes_[6] = glm::vec3(-ab.y, ab.x, 0.0);
+    axes_[7] = glm::vec3(-bc.y, bc.x, 0.0);
+    axes_[8] = glm::vec3(-ca.y, ca.x, 0.0);
+    axes_[9] = glm::vec3(1, 0, 0);
+    axes_[10] = glm::vec3(0, 1, 0);
+    axes_[11] = glm::vec3(0, 0, 1);
+    axes_[PLANE_AXIS] = glm::cross(ab, bc);
+
+    for (uint32_t i = 0; i < NUM_AXES; ++i) {
+        radii_[i] = aabb_extents.x * glm::abs(axes_[i].x) +
+                    aabb_extents.y * glm::abs(axes_[i].y) +
+                    aabb_extents.z * glm::abs(axes_[i].z);
+    }
+
+    // The plane's separating axis rejects a box centered at c when every
+    // vertex projects more than the radius away from c. Projections are
+    // computed in floats relative to c, so pad the range by a few ulps of the
+    // largest coordinate that can appear in them.
+    const glm::vec3 &normal = axes_[PLANE_AXIS];
+    double min_d = std::numeric_limits<double>::max();
+    double max_d = std::numeric_limits<double>::lowest();
+    double magnitude = 0.0;
+    for (const glm::vec3 &v : vertices_) {
+        double d = static_cast<double>(normal.x) * v.x +
+                   static_cast<double>(normal.y) * v.y +
+                   static_cast<double>(normal.z) * v.z;
+        min_d = std::min(min_d, d);
+        max_d = std::max(max_d, d);
+        magnitude = std::max({magnitude, std::abs(static_cast<double>(v.x)),
+                              std::abs(static_cast<double>(v.y)),
+                              std::abs(static_cast<double>(v.z))});
+    }
+    magnitude += 2.0 * std::max({aabb_extents.x, aabb_extents.y, aabb_extents.z});
+    double padding =
+        radii_[PLANE_AXIS] +
+        16.0 * std::numeric_limits<float>::epsilon() * magnitude *
+            (glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z));
+    plane_min_ = min_d - padding;
+    plane_max_ = max_d + padding;
+}
+
+// Both the scalar and the SIMD paths project a vertex v onto an axis n as
+// ((v.x - c.x) * n.x + (v.y - c.y) * n.y) + (v.z - c.z) * n.z, so that they
+// round identically.
+bool TriangleBoxTest::overlaps(glm::vec3 aabb_center) const {
+    for (uint32_t i = 0; i < NUM_AXES; ++i) {
+        const glm::vec3 &axis = axes_[i];
+        float p[3];
+        for (uint32_t j = 0; j < 3; ++j) {
+            float xy = (vertices_[j].x - aabb_center.x) * axis.x +
+                       (vertices_[j].y - aabb_center.y) * axis.y;
+            p[j] = xy + (vertices_[j].z - aabb_center.z) * axis.z;
+        }
+
+        float max_p = glm::max(p[0], glm::max(p[1], p[2]));
+        float min_p = glm::min(p[0], glm::min(p[1], p[2]));
+        if (glm::max(-max_p, min_p) > radii_[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t TriangleBoxTest::overlaps_row(float x, float y, const float *z,
+                                       uint32_t count) const {
+    ASSERT(count <= MAX_ROW_LENGTH, "Tried to test too many boxes at once.");
+    float xy[NUM_AXES][3];
+    for (uint32_t i = 0; i < NUM_AXES; ++i) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            xy[i][j] = (vertices_[j].x - x) * axes_[i].x +
+                       (vertices_[j].y - y) * axes_[i].y;
+        }
+    }
+
+    float padded_z[MAX_ROW_LENGTH];
+    for (uint32_t lane = 0; lane < MAX_ROW_LENGTH; ++lane) {
+        padded_z[lane] = z[lane < count ? lane : 0];
+    }
+
+#if defined(__AVX2__)
+    __m256 center_z = _mm256_loadu_ps(padded_z);
+    __m256 separated = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    for (uint32_t i = 0; i < NUM_AXES; ++i) {
+        __m256 p[3];
+        for (uint32_t j = 0; j < 3; ++j) {
+            __m256 dz = _mm256_sub_ps(_mm256_set1_ps(vertices_[j].z), center_z);
+            p[j] = _mm256_add_ps(_mm256_set1_ps(xy[i][j]),
+                                 _mm256_mul_ps(dz, _mm256_set1_ps(axes_[i].z)));
+        }
+        __m256 max_p = _mm256_max_ps(p[0], _mm256_max_ps(p[1], p[2]));
+        __m256 min_p = _mm256_min_ps(p[0], _mm256_min_ps(p[1], p[2]));
+        __m256 dist = _mm256_max_ps(_mm256_xor_ps(max_p, sign), min_p);
+        separated = _mm256_or_ps(
+            separated,
+            _mm256_cmp_ps(dist, _mm256_set1_ps(radii_[i]), _CMP_GT_OQ));
+        if (_mm256_movemask_ps(separated) == 0xFF) {
+            break;
+        }
+    }
+    uint32_t mask = ~_mm256_movemask_ps(separated) & 0xFF;
+#elif defined(__SSE2__)
+    uint32_t mask = 0;
+    for (uint32_t half = 0; half < MAX_ROW_LENGTH; half += 4) {
+        if (half >= count) {
+            break;
+        }
+        __m128 center_z = _mm_loadu_ps(padded_z + half);
+        __m128 separated = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        for (uint32_t i = 0; i < NUM_AXES; ++i) {
+            __m128 p[3];
+            for (uint32_t j = 0; j < 3; ++j) {
+                __m128 dz = _mm_sub_ps(_mm_set1_ps(vertices_[j].z), center_z);
+                p[j] = _mm_add_ps(_mm_set1_ps(xy[i][j]),
+                                  _mm_mul_ps(dz, _mm_set1_ps(axes_[i].z)));
+            }
+            __m128 max_p = _mm_max_ps(p[0], _mm_max_ps(p[1], p[2]));
+            __m128 min_p = _mm_min_ps(p[0], _mm_min_ps(p[1], p[2]));
+            __m128 dist = _mm_max_ps(_mm_xor_ps(max_p, sign), min_p);
+            separated = _mm_or_ps(
+                separated, _mm_cmpgt_ps(dist, _mm_set1_ps(radii_[i])));
+            if (_mm_movemask_ps(separated) == 0xF) {
+                break;
+            }
+        }
+        mask |= (~_mm_movemask_ps(separated) & 0xF) << half;
+    }
+#else
+    uint32_t mask = 0;
+    for (uint32_t lane = 0; lane < count; ++lane) {
+        bool separated = false;
+        for (uint32_t i = 0; i < NUM_AXES && !separated; ++i) {
+            float p[3];
+            for (uint32_t j = 0; j < 3; ++j) {
+                p[j] = xy[i][j] + (vertices_[j].z - padded_z[lane]) * axes_[i].z;
+            }
+            float max_p = glm::max(p[0], glm::max(p[1], p[2]));
+            float min_p = glm::min(p[0], glm::min(p[1], p[2]));
+            separated = glm::max(-max_p, min_p) > radii_[i];
+        }
+        mask |= static_cast<uint32_t>(!separated) << lane;
+    }
+#endif
+
+    return mask & ((1U << count) - 1);
+}
+
+// The MTL files an OBJ pulls in, which tinyobjloader doesn't report.
+static std::vector<std::filesystem::path>
+find_mtl_files(std::string_view filepath, const std::string &directory) {
+    std::vector<std::filesystem::path> mtl_files;
+    std::ifstream stream{std::string(filepath)};
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.starts_with("mtllib")) {
+            continue;
+        }
+        std::stringstream names(line.substr(6));
+        std::string name;
+        while (names >> name) {
+            if (std::filesystem::exists(directory + name)) {
+                mtl_files.emplace_back(directory + name);
+            }
+        }
+    }
+    return mtl_files;
+}
+
+Model::Model(std::string_view filepath, uint32_t num_threads) {
     std::cout << "Loading model: " << filepath << std::endl;
 
+    mesh_cache_ = MeshCache::open(filepath);
+    if (mesh_cache_) {
+        min_ = mesh_cache_->get_min();
+        max_ = mesh_cache_->get_max();
+        has_materials_ = mesh_cache_->has_materials();
+        auto triangles = mesh_cache_->get_triangles();
+        triangles_.assign(triangles.begin(), triangles.end());
+        loaded_textures_ = mesh_cache_->get_textures();
+        std::cout << "INFO: Loaded " << triangles_.size() << " triangles and "
+                  << loaded_textures_.size()
+                  << " textures from the mesh cache.\n";
+        return;
+    }
+
     std::string inputfile(filepath);
     tinyobj::ObjReaderConfig reader_config;
     tinyobj::ObjReader reader;
 
-    auto parse_obj_res = reader.ParseFromFile(inputfile, reader_config);
-    ASSERT(parse_obj_res, reader.Error() + "   " + reader.Warning());
+    // The parallel parser produces the same triangles as tinyobjloader, but
+    // doesn't handle every polygon, in which case tinyobjloader takes over.
+    ObjParser parser;
+    bool parsed_in_parallel = parser.parse(filepath, num_threads);
+    if (!parsed_in_parallel) {
+        std::cout << "INFO: Falling back to tinyobjloader: " << parser.get_error() << "\n";
+        auto parse_obj_res = reader.ParseFromFile(inputfile, reader_config);
+        ASSERT(parse_obj_res, reader.Error() + "   " + reader.Warning());
+    }
 
-    auto &attrib = reader.GetAttrib();
-    auto &shapes = reader.GetShapes();
-    auto &materials = reader.GetMaterials();
+    auto &attrib = parsed_in_parallel ? parser.get_attrib() : reader.GetAttrib();
+    auto &shapes = parsed_in_parallel ? parser.get_shapes() : reader.GetShapes();
+    auto &materials = parsed_in_parallel ? parser.get_materials() : reader.GetMaterials();
 
     std::string directory(filepath);
     const auto last_slash = directory.find_last_of("/");
@@ -391,6 +1307,46 @@ Model::Model(std::string_view filepath) {
               << max_.x << ", " << max_.y << ", " << max_.z
               << ")\n";
 
+    // Everything the loaded model depends on, for the mesh cache.
+    std::vector<std::filesystem::path> dependencies = {inputfile};
+    for (auto &mtl_file : find_mtl_files(filepath, directory)) {
+        dependencies.push_back(std::move(mtl_file));
+    }
+
+    // Every texture a textured face uses is decoded up front, so that they
+    // can be decoded concurrently and materials sharing an image share it.
+    std::unordered_map<int, std::string> texture_paths;
+    for (const auto &shape : shapes) {
+        for (uint64_t i = 0; i < shape.mesh.indices.size(); i += 3) {
+            int face_mat_id = shape.mesh.material_ids[i / 3];
+            if (shape.mesh.indices[i].texcoord_index < 0 ||
+                shape.mesh.indices[i + 1].texcoord_index < 0 ||
+                shape.mesh.indices[i + 2].texcoord_index < 0 ||
+                face_mat_id < 0 || face_mat_id >= static_cast<int>(materials.size()) ||
+                texture_paths.contains(face_mat_id)) {
+                continue;
+            }
+            const std::string &diffuse_texname = materials[face_mat_id].diffuse_texname;
+            if (!diffuse_texname.empty()) {
+                texture_paths[face_mat_id] = directory + diffuse_texname;
+            }
+        }
+    }
+    std::vector<std::string> unique_texture_paths;
+    for (const auto &[_, path] : texture_paths) {
+        unique_texture_paths.push_back(path);
+    }
+    std::sort(unique_texture_paths.begin(), unique_texture_paths.end());
+    unique_texture_paths.erase(std::unique(unique_texture_paths.begin(), unique_texture_paths.end()),
+                               unique_texture_paths.end());
+    texture_cache_.load(unique_texture_paths, num_threads);
+    for (const auto &[face_mat_id, path] : texture_paths) {
+        loaded_textures_[face_mat_id] = texture_cache_.get(path);
+    }
+    for (const auto &path : unique_texture_paths) {
+        dependencies.emplace_back(path);
+    }
+
     for (const auto &shape : shapes) {
         std::cout << shape.mesh.indices.size() / 3 << " triangles\n";
         for (uint64_t i = 0; i < shape.mesh.indices.size(); i += 3) {
@@ -408,41 +1364,8 @@ Model::Model(std::string_view filepath) {
 
             has_materials_ =
                 (tex_index_a >= 0 && tex_index_b >= 0 && tex_index_c >= 0);
-
-            bool has_texture = has_materials_;
-            int texture_width, texture_height;
-            stbi_uc *texture_pixels;
-            if (has_materials_) {
-                int face_mat_id = shape.mesh.material_ids[i / 3];
-                if (loaded_textures_.contains(face_mat_id)) {
-                    auto texture = loaded_textures_[face_mat_id];
-                    texture_pixels = std::get<0>(texture);
-                    texture_width = std::get<1>(texture);
-                    texture_height = std::get<2>(texture);
-                } else {
-                    const tinyobj::material_t &mat = materials[face_mat_id];
-                    const std::string &diffuse_texname = mat.diffuse_texname;
-                    if (diffuse_texname.empty()) {
-                        has_texture = false;
-                    } else {
-                        int channels;
-                        texture_pixels =
-                            stbi_load((directory + diffuse_texname).c_str(),
-                                      &texture_width, &texture_height,
-                                      &channels, STBI_rgb_alpha);
-                        if (!texture_pixels) {
-                            std::stringstream ss;
-                            ss << "Couldn't load texture from the following "
-                                  "path: ";
-                            ss << (directory + diffuse_texname);
-                            ss << "\n";
-                            ASSERT(false, ss.str());
-                        }
-                        loaded_textures_[face_mat_id] = {
-                            texture_pixels, texture_width, texture_height};
-                    }
-                }
-            }
+            bool has_texture = has_materials_ &&
+                loaded_textures_.contains(shape.mesh.material_ids[i / 3]);
 
             triangles_.emplace_back(
                 glm::vec3(attrib.vertices.at(3 * index_a),
@@ -470,19 +1393,27 @@ Model::Model(std::string_view filepath) {
                 has_texture);
         }
     }
-}
 
-Model::~Model() {
-    for (auto [_, tex] : loaded_textures_) {
-        stbi_image_free(std::get<0>(tex));
-    }
+    MeshCache::write(filepath, dependencies, *this);
 }
 
+// The textures are owned by the texture cache (or the mesh cache).
+Model::~Model() = default;
+
 Voxelizer::Voxelizer(std::string_view filepath,
-                     std::tuple<uint32_t, uint32_t, uint32_t> total_size)
+                     std::tuple<uint32_t, uint32_t, uint32_t> total_size,
+                     uint32_t num_threads, uint64_t max_memory_usage,
+                     VoxelLayout layout)
     : 
-    model_{filepath}
+    num_threads_{std::max(num_threads, 1U)},
+    max_memory_usage_{max_memory_usage},
+    layout_{layout},
+    model_{filepath, num_threads_}
 {
+    if (num_threads_ > 1) {
+        pool_ = std::make_unique<ctpl::thread_pool>(num_threads_);
+    }
+
     glm::vec3 max = model_.get_max();
     glm::vec3 min = model_.get_min();
     width_ = std::get<0>(total_size);
@@ -506,42 +1437,117 @@ Voxelizer::Voxelizer(std::string_view filepath,
     chunks_depth_ = static_cast<uint32_t>(ceil((float)depth_ / voxel_chunk_size_));
 
     voxel_chunks_.resize(chunks_width_ * chunks_height_ * chunks_depth_);
+    lru_positions_.resize(voxel_chunks_.size(), lru_chunks_.end());
+
+    // Construction visits chunks along a Morton curve. Chunks store y flipped,
+    // so the curve runs through their rows from the top down.
+    auto construction_order = [&](uint32_t index) {
+        return libmorton::morton3D_64_encode(
+            index % chunks_width_,
+            chunks_height_ - 1 - index / chunks_width_ % chunks_height_,
+            index / chunks_width_ / chunks_height_);
+    };
+    chunk_order_.resize(voxel_chunks_.size());
+    std::iota(chunk_order_.begin(), chunk_order_.end(), 0);
+    std::sort(chunk_order_.begin(), chunk_order_.end(),
+              [&](uint32_t a, uint32_t b) {
+                  return construction_order(a) < construction_order(b);
+              });
+    chunk_order_positions_.resize(chunk_order_.size());
+    for (uint32_t i = 0; i < chunk_order_.size(); ++i) {
+        chunk_order_positions_[chunk_order_[i]] = i;
+    }
 
     std::cout << "Voxelizer Size: (" 
               << chunks_width_ << ", " << chunks_height_ << ", " << chunks_depth_ 
               << ")\n";
 
+    // Every voxelizer spills into a directory of its own, so conversions
+    // running at once (even of the same model at the same size) never touch
+    // each other's spill files, and files from a previous run are never read
+    // back.
+    // create_directory only returns true if it made the directory, so a
+    // name another voxelizer already took is skipped.
     std::filesystem::path filename = std::filesystem::path(filepath).filename();
-    std::stringstream string_pointer;
-    string_pointer << filename.string() << "_" << width_ << "_" << height_
-                   << "_" << depth_ << "_" << voxel_chunk_size_;
-    voxels_directory_ = "disk_voxels_" + string_pointer.str();
-    std::filesystem::create_directory(voxels_directory_);
+    std::random_device device;
+    bool created = false;
+    for (uint32_t attempt = 0; attempt < 100 && !created; ++attempt) {
+        std::ostringstream name;
+        name << "ivs_voxels_" << filename.string() << "_" << std::hex << device() << device();
+        voxels_directory_ = std::filesystem::temp_directory_path() / name.str();
+        std::error_code error;
+        created = std::filesystem::create_directory(voxels_directory_, error);
+    }
+    ASSERT(created, "Failed to create a directory to spill voxel chunks into.");
+    spilled_chunks_.resize(voxel_chunks_.size(), false);
+
+    build_chunk_triangle_index();
 }
 
-Voxelizer::~Voxelizer() {
-    // std::filesystem::remove_all(voxels_directory_);
-    for (uint32_t chunk_x = 0; chunk_x < chunks_width_; chunk_x++) {
-        for (uint32_t chunk_y = 0; chunk_y < chunks_height_; chunk_y++) {
-            for (uint32_t chunk_z = 0; chunk_z < chunks_width_; chunk_z++) {
-                uint32_t voxel_chunk_index =
-                    linearize_chunk_index(chunk_x, chunk_y, chunk_z);
-                VoxelizedChunk &voxel_chunk =
-                    voxel_chunks_.at(voxel_chunk_index);
-                
-                std::filesystem::path chunk_path =
-                    voxels_directory_ / std::to_string(voxel_chunk_index);
-
-                if (std::filesystem::exists(chunk_path)) {
-                    continue;
-                }
+void Voxelizer::build_chunk_triangle_index() {
+    const std::vector<Triangle> &triangles = model_.get_triangles();
+    glm::vec3 min = model_.get_min();
+
+    chunk_triangles_.resize(voxel_chunks_.size());
+    uint64_t num_entries = 0;
+    for (uint32_t i = 0; i < triangles.size(); ++i) {
+        const Triangle &tri = triangles[i];
+        uint32_t min_voxel_x = static_cast<uint32_t>(
+            floor((tri.min_x() - min.x) / voxel_size_));
+        uint32_t min_voxel_y = static_cast<uint32_t>(
+            floor((tri.min_y() - min.y) / voxel_size_));
+        uint32_t min_voxel_z = static_cast<uint32_t>(
+            floor((tri.min_z() - min.z) / voxel_size_));
+        uint32_t max_voxel_x = static_cast<uint32_t>(
+            ceil((tri.max_x() - min.x) / voxel_size_));
+        uint32_t max_voxel_y = static_cast<uint32_t>(
+            ceil((tri.max_y() - min.y) / voxel_size_));
+        uint32_t max_voxel_z = static_cast<uint32_t>(
+            ceil((tri.max_z() - min.z) / voxel_size_));
 
-                if (!voxel_chunk.empty()) {
-                    write_voxels_to_disk(voxel_chunk_index);
+        uint32_t min_chunk_x = min_voxel_x / voxel_chunk_size_;
+        uint32_t min_chunk_y = min_voxel_y / voxel_chunk_size_;
+        uint32_t min_chunk_z = min_voxel_z / voxel_chunk_size_;
+        uint32_t max_chunk_x = std::min(static_cast<uint32_t>(max_voxel_x / voxel_chunk_size_), chunks_width_ - 1);
+        uint32_t max_chunk_y = std::min(static_cast<uint32_t>(max_voxel_y / voxel_chunk_size_), chunks_height_ - 1);
+        uint32_t max_chunk_z = std::min(static_cast<uint32_t>(max_voxel_z / voxel_chunk_size_), chunks_depth_ - 1);
+
+        for (uint32_t chunk_z = min_chunk_z; chunk_z <= max_chunk_z; ++chunk_z) {
+            for (uint32_t chunk_y = min_chunk_y; chunk_y <= max_chunk_y; ++chunk_y) {
+                for (uint32_t chunk_x = min_chunk_x; chunk_x <= max_chunk_x; ++chunk_x) {
+                    chunk_triangles_.at(linearize_chunk_index(chunk_x, chunk_y, chunk_z)).push_back(i);
+                    ++num_entries;
                 }
             }
         }
     }
+
+    std::cout << "INFO: Binned " << triangles.size() << " triangles into "
+              << chunk_triangles_.size() << " chunks (" << num_entries
+              << " entries).\n";
+}
+
+Voxelizer::~Voxelizer() {
+    if (prefetch_.valid()) {
+        prefetch_.wait();
+    }
+    std::cout << "INFO: Tested " << num_triangles_tested_
+              << " triangles while voxelizing chunks (a full scan would have "
+                 "tested "
+              << num_triangles_scanned_ << "), " << num_triangles_accepted_
+              << " of which covered at least one voxel.\n";
+    std::cout << "INFO: Tested " << num_voxels_tested_
+              << " voxels against triangles (sweeping their bounding boxes "
+                 "would have tested "
+              << num_voxels_in_bounds_ << ").\n";
+    std::cout << "INFO: Voxelized " << num_voxelizations_
+              << " chunks, evicted " << num_evictions_ << " chunks, wrote "
+              << num_spills_ << " spill files and read back " << num_reloads_
+              << ".\n";
+    std::cout << "INFO: Prefetched " << num_prefetches_ << " chunks, "
+              << num_prefetch_hits_ << " of which were the next chunk "
+                 "construction asked for.\n";
+    std::filesystem::remove_all(voxels_directory_);
 }
 
 inline uint32_t Voxelizer::linearize_chunk_index(uint32_t x, uint32_t y, uint32_t z) const {
@@ -549,7 +1555,6 @@ inline uint32_t Voxelizer::linearize_chunk_index(uint32_t x, uint32_t y, uint32_
 }
 
 void Voxelizer::voxelize_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z) {
-    std::cout << "INFO: (" << (++num_chunks_voxelized_) << " / " << (chunks_width_ * chunks_height_ * chunks_depth_) << ") Voxelizing Chunk (" << chunk_x << ", " << chunk_y << ", " << chunk_z << ")\n";
     // If this function is being called, we can assume that the chunk isn't already in memory.
     // We first check if the chunk instead exists on the disk.
     uint32_t voxel_chunk_index =
@@ -559,196 +1564,240 @@ void Voxelizer::voxelize_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chun
     std::filesystem::path chunk_path =
         voxels_directory_ / std::to_string(voxel_chunk_index);
 
-    uint64_t added_memory =
-        voxel_chunk_size_ * voxel_chunk_size_ * voxel_chunk_size_ * 4;
-     
-    // If the chunk doesn't exist on the disk, then we have to voxelize the chunk from scratch.
-    // We should first check that we aren't exceeding the maximum memory size,
-    // otherwise we should first write another less-used chunk to the disk.
-    
-    // todo: right now, this is just going to write the lowest voxel index out to disk.
-    // A better solution would be to maintain some LRU of some sort.
-    while (current_memory_usage_ + added_memory > max_memory_usage_) {
-        // Note: each voxel chunk should take the same amount of memory,
-        // so a while loop here shouldn't be necessary (need to double check)
-        std::optional<uint32_t> old_chunk = find_old_voxel_chunk(voxel_chunk_index);
-        if (old_chunk.has_value()) {
-            write_voxels_to_disk(old_chunk.value());
-        } else {
-            ASSERT(false, "Out of available memory but there are no old chunks to write?!");
-        }
+    // Nothing else may change the memory usage while a chunk is being
+    // prefetched, so it's always finished first. It may well be this chunk.
+    finish_prefetch();
+    if (!voxel_chunk.empty()) {
+        ++num_prefetch_hits_;
+        prefetch_after(voxel_chunk_index);
+        return;
     }
 
-    if (std::filesystem::exists(chunk_path)) {
+    // If the chunk was spilled, we know how big it is, so we can make room for
+    // it before reading it back.
+    if (spilled_chunks_.at(voxel_chunk_index)) {
+        make_room(voxel_chunk_index,
+                  std::filesystem::file_size(chunk_path) +
+                      get_brick_table_size() * sizeof(voxel_chunk.bricks[0]));
         read_voxels_from_disk(voxel_chunk_index);
         return;
     }
 
-    // At this point we have enough available memory to voxelize the chunk
-    uint32_t min_chunk_x = voxel_chunk_size_ * chunk_x;
-    uint32_t min_chunk_y = voxel_chunk_size_ * chunk_y;
-    uint32_t min_chunk_z = voxel_chunk_size_ * chunk_z;
-    uint32_t max_chunk_x = min_chunk_x + voxel_chunk_size_;
-    uint32_t max_chunk_y = min_chunk_y + voxel_chunk_size_;
-    uint32_t max_chunk_z = min_chunk_z + voxel_chunk_size_;
+    std::cout << "INFO: (" << (num_voxelizations_ + 1) << " / " << (chunks_width_ * chunks_height_ * chunks_depth_) << ") Voxelizing Chunk (" << chunk_x << ", " << chunk_y << ", " << chunk_z << ")\n";
+    ChunkStatistics statistics;
+    fill_chunk(chunk_x, chunk_y, chunk_z, voxel_chunk, statistics);
+    add_voxelized_chunk(voxel_chunk_index, statistics);
+    prefetch_after(voxel_chunk_index);
+}
 
-    const std::vector<Triangle>& triangles = model_.get_triangles();
-    bool has_materials = model_.has_materials();
-    const auto& textures = model_.get_textures();
-    glm::vec3 min = model_.get_min();
-    glm::vec3 max = model_.get_max();
+void Voxelizer::fill_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z,
+                           VoxelizedChunk &voxel_chunk,
+                           ChunkStatistics &statistics) const {
+    uint32_t voxel_chunk_index =
+        linearize_chunk_index(chunk_x, chunk_y, chunk_z);
+    glm::uvec3 min_chunk(voxel_chunk_size_ * chunk_x,
+                         voxel_chunk_size_ * chunk_y,
+                         voxel_chunk_size_ * chunk_z);
+    glm::uvec3 max_chunk = min_chunk + glm::uvec3(voxel_chunk_size_ - 1);
+
+    const uint64_t brick_volume =
+        voxel_brick_size_ * voxel_brick_size_ * voxel_brick_size_;
+    voxel_chunk.bricks.resize(get_brick_table_size());
+
+    // Slabs are whole bricks deep, so no two slabs ever allocate one brick.
+    const uint32_t slab_depth =
+        (choose_slab_depth(voxel_chunk_size_, num_threads_) +
+         voxel_brick_size_ - 1) /
+        voxel_brick_size_ * voxel_brick_size_;
+    VoxelGrid grid = {model_.get_min(), glm::vec3(voxel_size_), voxel_size_};
+    VoxelizationCore core(model_.get_triangles(), model_.get_textures(), grid);
+    const std::vector<uint32_t> &chunk_triangles =
+        chunk_triangles_.at(voxel_chunk_index);
+    VoxelizeStatistics core_statistics = core.voxelize(
+        chunk_triangles, min_chunk, max_chunk, slab_depth, pool_.get(),
+        [&](uint32_t x, uint32_t y, uint32_t z, const VoxelHit &hit) {
+            uint32_t voxel = hit.voxel;
+            auto [brick_idx, in_brick_idx] = locate_in_chunk(
+                x - min_chunk.x, y - min_chunk.y, z - min_chunk.z);
+            std::unique_ptr<uint32_t[]> &brick = voxel_chunk.bricks[brick_idx];
+            if (!brick) {
+                if (!voxel) {
+                    return;
+                }
+                brick = std::make_unique<uint32_t[]>(brick_volume);
+            }
+            brick[in_brick_idx] = voxel;
+        });
+
+    statistics.num_triangles_scanned = model_.get_triangles().size();
+    statistics.num_triangles_tested = chunk_triangles.size();
+    statistics.num_triangles_accepted = core_statistics.num_triangles_accepted;
+    statistics.num_voxels_tested = core_statistics.num_voxels_tested;
+    statistics.num_voxels_in_bounds = core_statistics.num_voxels_in_bounds;
+
+    uint64_t num_bricks = std::count_if(
+        voxel_chunk.bricks.begin(), voxel_chunk.bricks.end(),
+        [](const auto &brick) { return brick != nullptr; });
+    voxel_chunk.memory_usage =
+        num_bricks * brick_volume * sizeof(uint32_t) +
+        voxel_chunk.bricks.size() * sizeof(voxel_chunk.bricks[0]);
+}
 
-    voxel_chunk.resize(static_cast<size_t>(voxel_chunk_size_) *
-                       static_cast<size_t>(voxel_chunk_size_) *
-                       static_cast<size_t>(voxel_chunk_size_) * 4,
-                       static_cast<std::byte>(0));
-    
-    for (const auto &tri : triangles) {
-        uint32_t min_voxel_x = static_cast<uint32_t>(
-            floor((tri.min_x() - min.x) / voxel_size_));
-        uint32_t min_voxel_y = static_cast<uint32_t>(
-            floor((tri.min_y() - min.y) / voxel_size_));
-        uint32_t min_voxel_z = static_cast<uint32_t>(
-            floor((tri.min_z() - min.z) / voxel_size_));
-        uint32_t max_voxel_x = static_cast<uint32_t>(
-            ceil((tri.max_x() - min.x) / voxel_size_));
-        uint32_t max_voxel_y = static_cast<uint32_t>(
-            ceil((tri.max_y() - min.y) / voxel_size_));
-        uint32_t max_voxel_z = static_cast<uint32_t>(
-            ceil((tri.max_z() - min.z) / voxel_size_));
+void Voxelizer::add_voxelized_chunk(uint32_t chunk_index,
+                                    const ChunkStatistics &statistics) {
+    ++num_voxelizations_;
+    num_triangles_scanned_ += statistics.num_triangles_scanned;
+    num_triangles_tested_ += statistics.num_triangles_tested;
+    num_triangles_accepted_ += statistics.num_triangles_accepted;
+    num_voxels_tested_ += statistics.num_voxels_tested;
+    num_voxels_in_bounds_ += statistics.num_voxels_in_bounds;
+
+    // Only now do we know how many bricks the chunk needed, so other chunks
+    // are spilled to make room for it after the fact.
+    const VoxelizedChunk &voxel_chunk = voxel_chunks_.at(chunk_index);
+    largest_chunk_memory_usage_ =
+        std::max(largest_chunk_memory_usage_, voxel_chunk.memory_usage);
+    current_memory_usage_ += voxel_chunk.memory_usage;
+    lru_positions_.at(chunk_index) =
+        lru_chunks_.insert(lru_chunks_.begin(), chunk_index);
+    make_room(chunk_index, 0);
+    std::cout << "INFO: After voxelizing chunk " << chunk_index << ", " << voxel_chunk.memory_usage << " bytes were allocated, so the total is now " << current_memory_usage_ << " bytes.\n";
+    std::cout << "INFO: Tested " << statistics.num_triangles_tested << " of " << statistics.num_triangles_scanned << " triangles against the chunk.\n";
+    std::cout << "INFO: Tested " << statistics.num_voxels_tested << " voxels against them (sweeping their bounding boxes would have tested " << statistics.num_voxels_in_bounds << ").\n";
+}
 
-        // If the voxel lies outside of the chunk, we can skip trying to voxelize it
-        if (min_voxel_x > max_chunk_x || min_voxel_y > max_chunk_y || min_voxel_z > max_chunk_z || 
-            max_voxel_x < min_chunk_x || max_voxel_y < min_chunk_y || max_voxel_z < min_chunk_z) {
-            continue;
+void Voxelizer::prefetch_after(uint32_t chunk_index) {
+    // With a single thread, there's nothing to overlap voxelization with.
+    if (!pool_) {
+        return;
+    }
+
+    // Construction walks the model in Morton order, so the next chunk it'll
+    // need is most likely the next one along the curve that isn't resident.
+    std::optional<uint32_t> next_chunk;
+    for (uint32_t i = chunk_order_positions_.at(chunk_index) + 1;
+         i < chunk_order_.size(); ++i) {
+        uint32_t candidate = chunk_order_[i];
+        if (!chunk_triangles_.at(candidate).empty() &&
+            voxel_chunks_.at(candidate).empty()) {
+            next_chunk = candidate;
+            break;
         }
+    }
+    // Spilled chunks are cheap to read back, so they aren't worth prefetching.
+    if (!next_chunk.has_value() || spilled_chunks_.at(next_chunk.value())) {
+        return;
+    }
 
-        min_voxel_x = std::max(min_voxel_x, min_chunk_x);
-        min_voxel_y = std::max(min_voxel_y, min_chunk_y);
-        min_voxel_z = std::max(min_voxel_z, min_chunk_z);
-        max_voxel_x = std::min(max_voxel_x, max_chunk_x - 1);
-        max_voxel_y = std::min(max_voxel_y, max_chunk_y - 1);
-        max_voxel_z = std::min(max_voxel_z, max_chunk_z - 1);
+    // Make room for the prefetched chunk up front, assuming it's as big as the
+    // biggest chunk so far, so it can't push the voxelizer over its budget.
+    make_room(chunk_index, largest_chunk_memory_usage_);
+    if (current_memory_usage_ + largest_chunk_memory_usage_ > max_memory_usage_) {
+        return;
+    }
 
-        glm::mat3 tri_matrix(tri.a, tri.b, tri.c);
-        glm::mat3 inverse_tri_matrix = glm::inverse(tri_matrix);
-        glm::vec3 unit_plane =
-            glm::normalize(glm::cross(tri.a - tri.c, tri.b - tri.c));
-        if (!std::isfinite(inverse_tri_matrix[0][0]) ||
-            !std::isfinite(inverse_tri_matrix[0][1]) ||
-            !std::isfinite(inverse_tri_matrix[0][2]) ||
-            !std::isfinite(inverse_tri_matrix[1][0]) ||
-            !std::isfinite(inverse_tri_matrix[1][1]) ||
-            !std::isfinite(inverse_tri_matrix[1][2]) ||
-            !std::isfinite(inverse_tri_matrix[2][0]) ||
-            !std::isfinite(inverse_tri_matrix[2][1]) ||
-            !std::isfinite(inverse_tri_matrix[2][2])) {
-            continue;
-        }
+    uint32_t next_x = next_chunk.value() % chunks_width_;
+    uint32_t next_y = next_chunk.value() / chunks_width_ % chunks_height_;
+    uint32_t next_z = next_chunk.value() / chunks_width_ / chunks_height_;
+    prefetch_chunk_index_ = next_chunk.value();
+    prefetched_chunk_ = VoxelizedChunk();
+    prefetched_statistics_ = ChunkStatistics();
+    prefetch_ = std::async(std::launch::async, [this, next_x, next_y, next_z] {
+        fill_chunk(next_x, next_y, next_z, prefetched_chunk_,
+                   prefetched_statistics_);
+    });
+    ++num_prefetches_;
+}
 
-        int texture_width, texture_height;
-        stbi_uc *texture_pixels;
-        if (has_materials) {
-            if (textures.contains(tri.face_mat_id)) {
-                const auto texture = textures.at(tri.face_mat_id);
-                texture_pixels = std::get<0>(texture);
-                texture_width = std::get<1>(texture);
-                texture_height = std::get<2>(texture);
-            }
+void Voxelizer::finish_prefetch() {
+    if (!prefetch_.valid()) {
+        return;
+    }
+    prefetch_.get();
+    voxel_chunks_.at(prefetch_chunk_index_) = std::move(prefetched_chunk_);
+    add_voxelized_chunk(prefetch_chunk_index_, prefetched_statistics_);
+}
+
+void Voxelizer::make_room(uint32_t chunk_index, uint64_t added_memory) {
+    while (current_memory_usage_ + added_memory > max_memory_usage_) {
+        std::optional<uint32_t> old_chunk = least_recently_used_chunk(chunk_index);
+        if (!old_chunk.has_value()) {
+            std::cout << "INFO: Chunk at index " << chunk_index
+                      << " doesn't fit in the memory budget on its own.\n";
+            return;
         }
+        write_voxels_to_disk(old_chunk.value());
+        ++num_evictions_;
+    }
+}
 
-        for (uint32_t x = min_voxel_x; x <= max_voxel_x; ++x) {
-            for (uint32_t y = min_voxel_y; y <= max_voxel_y; ++y) {
-                for (uint32_t z = min_voxel_z; z <= max_voxel_z; ++z) {
-                    float tri_voxel_x =
-                        static_cast<float>(x) * voxel_size_ + min.x;
-                    float tri_voxel_y =
-                        static_cast<float>(y) * voxel_size_ + min.y;
-                    float tri_voxel_z =
-                        static_cast<float>(z) * voxel_size_ + min.z;
-                    if (tri.tri_aabb(
-                            glm::vec3(tri_voxel_x, tri_voxel_y, tri_voxel_z),
-                            glm::vec3(voxel_size_))) {
-                        std::byte r = static_cast<std::byte>(255),
-                                  g = static_cast<std::byte>(255),
-                                  b = static_cast<std::byte>(255),
-                                  a = static_cast<std::byte>(255);
-                        glm::vec3 plane_point =
-                            glm::vec3(tri_voxel_x, tri_voxel_y, tri_voxel_z);
-                        plane_point -=
-                            unit_plane *
-                            (glm::dot(unit_plane, plane_point - tri.a));
-                        glm::vec3 barycentric_coords =
-                            inverse_tri_matrix * plane_point;
+inline std::pair<uint64_t, uint64_t>
+Voxelizer::locate_in_chunk(uint32_t x, uint32_t y, uint32_t z) const {
+    if (layout_ == VoxelLayout::Morton) {
+        // Chunks are 2^10 voxels wide, so both codes fit in 32 bits.
+        uint64_t brick_index = libmorton::morton3D_32_encode(
+            x / voxel_brick_size_, y / voxel_brick_size_, z / voxel_brick_size_);
+        uint64_t in_brick_index = libmorton::morton3D_32_encode(
+            x % voxel_brick_size_, y % voxel_brick_size_, z % voxel_brick_size_);
+        return {brick_index, in_brick_index};
+    }
 
-                        if (tri.has_texture) {
-                            glm::vec2 uv = tri.t_a * barycentric_coords.x +
-                                           tri.t_b * barycentric_coords.y +
-                                           tri.t_c * barycentric_coords.z;
-                            int tex_x = static_cast<int>(uv.x * texture_width);
-                            int tex_y = static_cast<int>(uv.y * texture_height);
-                            while (tex_x < 0) {
-                                tex_x += texture_width;
-                            }
-                            while (tex_x >= texture_width) {
-                                tex_x -= texture_width;
-                            }
-                            while (tex_y < 0) {
-                                tex_y += texture_height;
-                            }
-                            while (tex_y >= texture_height) {
-                                tex_y -= texture_height;
-                            }
-                            int linear_coord = tex_x + tex_y * texture_width;
+    const uint64_t bricks_per_side = voxel_chunk_size_ / voxel_brick_size_;
+    uint64_t brick_index = x / voxel_brick_size_ +
+                           bricks_per_side * (y / voxel_brick_size_) +
+                           bricks_per_side * bricks_per_side * (z / voxel_brick_size_);
+    uint64_t in_brick_index = x % voxel_brick_size_ +
+                              voxel_brick_size_ * (y % voxel_brick_size_) +
+                              voxel_brick_size_ * voxel_brick_size_ * (z % voxel_brick_size_);
+    return {brick_index, in_brick_index};
+}
 
-                            if (texture_pixels[linear_coord * 4 + 3]) {
-                                r = static_cast<std::byte>(
-                                    texture_pixels[linear_coord * 4]);
-                                g = static_cast<std::byte>(
-                                    texture_pixels[linear_coord * 4 + 1]);
-                                b = static_cast<std::byte>(
-                                    texture_pixels[linear_coord * 4 + 2]);
-                                a = static_cast<std::byte>(255);
-                            } else {
-                                r = static_cast<std::byte>(0);
-                                g = static_cast<std::byte>(0);
-                                b = static_cast<std::byte>(0);
-                                a = static_cast<std::byte>(0);
-                            }
-                        }
+uint64_t Voxelizer::get_brick_table_size() const {
+    const uint64_t bricks_per_side = voxel_chunk_size_ / voxel_brick_size_;
+    return bricks_per_side * bricks_per_side * bricks_per_side;
+}
 
-                        size_t voxel_idx =
-                            (x - min_chunk_x) + (y - min_chunk_y) * voxel_chunk_size_ +
-                            (z - min_chunk_z) * voxel_chunk_size_ * voxel_chunk_size_;
-                        voxel_chunk.at(voxel_idx * 4) = r;
-                        voxel_chunk.at(voxel_idx * 4 + 1) = g;
-                        voxel_chunk.at(voxel_idx * 4 + 2) = b;
-                        voxel_chunk.at(voxel_idx * 4 + 3) = a;
-                    }
-                }
-            }
-        }
+void Voxelizer::touch_chunk(uint32_t chunk_index) {
+    auto position = lru_positions_.at(chunk_index);
+    if (position != lru_chunks_.end()) {
+        lru_chunks_.splice(lru_chunks_.begin(), lru_chunks_, position);
     }
-
-    current_memory_usage_ += added_memory;
-    std::cout << "INFO: After voxelizing, " << added_memory << " bytes were allocated, so the total is now " << current_memory_usage_ << " bytes.\n";
 }
 
-std::optional<uint32_t> Voxelizer::find_old_voxel_chunk(uint32_t chunk_to_voxelize) const {
-    for (uint32_t x = 0; x < chunks_width_; x++) {
-        for (uint32_t y = 0; y < chunks_height_; y++) {
-            for (uint32_t z = 0; z < chunks_width_; z++) {
-                uint32_t chunk_index = linearize_chunk_index(x, y, z);
-                if (!voxel_chunks_.at(chunk_index).empty() && (chunk_index != chunk_to_voxelize)) {
-                    return std::optional<uint32_t>(chunk_index);
-                }
-            }
+std::optional<uint32_t> Voxelizer::least_recently_used_chunk(uint32_t excluded) const {
+    // Only the last two chunks can ever be looked at.
+    for (auto it = lru_chunks_.rbegin(); it != lru_chunks_.rend(); ++it) {
+        if (*it != excluded) {
+            return std::optional<uint32_t>(*it);
         }
     }
 
     return std::nullopt;
 }
 
+Voxelizer::VoxelizedChunk *Voxelizer::get_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z) {
+    if (chunk_x == last_chunk_x_ && chunk_y == last_chunk_y_ && chunk_z == last_chunk_z_) {
+        return last_chunk_;
+    }
+
+    // No triangle reaches this chunk, so it's empty without voxelizing it.
+    uint32_t chunk_index = linearize_chunk_index(chunk_x, chunk_y, chunk_z);
+    if (chunk_triangles_.at(chunk_index).empty()) {
+        return nullptr;
+    }
+
+    VoxelizedChunk *voxel_chunk = &voxel_chunks_.at(chunk_index);
+    if (voxel_chunk->empty()) {
+        voxelize_chunk(chunk_x, chunk_y, chunk_z);
+    }
+    touch_chunk(chunk_index);
+    last_chunk_x_ = chunk_x;
+    last_chunk_y_ = chunk_y;
+    last_chunk_z_ = chunk_z;
+    last_chunk_ = voxel_chunk;
+    return voxel_chunk;
+}
+
 uint32_t Voxelizer::at(uint32_t x, uint32_t y, uint32_t z) {
     static_assert(4 * sizeof(std::byte) == sizeof(uint32_t));
     if (x >= width_ || y >= height_ || z >= depth_) {
@@ -763,62 +1812,312 @@ uint32_t Voxelizer::at(uint32_t x, uint32_t y, uint32_t z) {
     uint32_t in_chunk_x = x % voxel_chunk_size_;
     uint32_t in_chunk_y = y % voxel_chunk_size_;
     uint32_t in_chunk_z = z % voxel_chunk_size_;
-    uint32_t in_chunk_index = in_chunk_x + voxel_chunk_size_ * in_chunk_y + voxel_chunk_size_ * voxel_chunk_size_ * in_chunk_z;
-    VoxelizedChunk *voxel_chunk = last_chunk_;
-    if (chunk_x != last_chunk_x_ || chunk_x != last_chunk_x_ || chunk_x != last_chunk_x_) {
-	uint32_t chunk_index = linearize_chunk_index(chunk_x, chunk_y, chunk_z);
-	voxel_chunk = &voxel_chunks_.at(chunk_index);
-	if (voxel_chunk->empty()) {
-	    voxelize_chunk(chunk_x, chunk_y, chunk_z);
-	}
-	last_chunk_x_ = chunk_x;
-	last_chunk_y_ = chunk_y;
-	last_chunk_z_ = chunk_z;
-	last_chunk_ = voxel_chunk;
+    VoxelizedChunk *voxel_chunk = get_chunk(chunk_x, chunk_y, chunk_z);
+    if (!voxel_chunk) {
+        return 0;
     }
 
-    uint32_t voxel;
-    memcpy(&voxel, voxel_chunk->data() + 4 * in_chunk_index, sizeof(uint32_t));
-    return voxel;
+    // Bricks that were never written to hold only empty voxels.
+    auto [brick_index, in_brick_index] =
+        locate_in_chunk(in_chunk_x, in_chunk_y, in_chunk_z);
+    const auto &brick = voxel_chunk->bricks[brick_index];
+    return brick ? brick[in_brick_index] : 0;
+}
+
+void Voxelizer::at_block(uint32_t lower_x, uint32_t lower_y, uint32_t lower_z,
+                         uint32_t width, uint32_t height, uint32_t depth,
+                         std::span<uint32_t> out) {
+    ASSERT(out.size() >= static_cast<uint64_t>(width) * height * depth,
+           "Output span is too small for the requested block.");
+    // Copy the block one row at a time, and each row one brick at a time.
+    // Voxels outside of the model are empty.
+    uint32_t row_width = lower_x < width_ ? std::min(width, width_ - lower_x) : 0;
+    for (uint32_t z = 0; z < depth; ++z) {
+        for (uint32_t y = 0; y < height; ++y) {
+            uint32_t *row = out.data() + (static_cast<uint64_t>(z) * height + y) * width;
+            uint32_t voxel_y = lower_y + y, voxel_z = lower_z + z;
+            if (voxel_y >= height_ || voxel_z >= depth_) {
+                std::fill(row, row + width, 0);
+                continue;
+            }
+            voxel_y = height_ - voxel_y - 1;
+
+            uint32_t chunk_y = voxel_y / voxel_chunk_size_;
+            uint32_t chunk_z = voxel_z / voxel_chunk_size_;
+            uint32_t in_chunk_y = voxel_y % voxel_chunk_size_;
+            uint32_t in_chunk_z = voxel_z % voxel_chunk_size_;
+            for (uint32_t x = 0; x < row_width;) {
+                uint32_t voxel_x = lower_x + x;
+                uint32_t in_chunk_x = voxel_x % voxel_chunk_size_;
+                uint32_t run = std::min(row_width - x,
+                                        static_cast<uint32_t>(voxel_brick_size_ - in_chunk_x % voxel_brick_size_));
+                VoxelizedChunk *voxel_chunk =
+                    get_chunk(voxel_x / voxel_chunk_size_, chunk_y, chunk_z);
+                const uint32_t *brick = nullptr;
+                uint64_t in_brick_index = 0;
+                if (voxel_chunk) {
+                    auto [brick_index, index] =
+                        locate_in_chunk(in_chunk_x, in_chunk_y, in_chunk_z);
+                    brick = voxel_chunk->bricks[brick_index].get();
+                    in_brick_index = index;
+                }
+                if (brick && layout_ == VoxelLayout::Tiled) {
+                    memcpy(row + x, brick + in_brick_index, run * sizeof(uint32_t));
+                } else if (brick) {
+                    // Rows aren't contiguous in a Morton ordered brick.
+                    for (uint32_t i = 0; i < run; ++i) {
+                        row[x + i] = brick[locate_in_chunk(in_chunk_x + i, in_chunk_y, in_chunk_z).second];
+                    }
+                } else {
+                    std::fill(row + x, row + x + run, 0);
+                }
+                x += run;
+            }
+            std::fill(row + row_width, row + width, 0);
+        }
+    }
+}
+
+bool Voxelizer::is_empty(uint32_t lower_x, uint32_t lower_y, uint32_t lower_z,
+                         uint32_t width, uint32_t height, uint32_t depth) {
+    if (lower_x >= width_ || lower_y >= height_ || lower_z >= depth_ ||
+        !width || !height || !depth) {
+        return true;
+    }
+    uint32_t max_x = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(lower_x) + width, width_) - 1);
+    uint32_t max_y = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(lower_y) + height, height_) - 1);
+    uint32_t max_z = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(lower_z) + depth, depth_) - 1);
+
+    // Chunks store y flipped.
+    uint32_t min_y = height_ - max_y - 1;
+    max_y = height_ - lower_y - 1;
+
+    for (uint32_t chunk_z = lower_z / voxel_chunk_size_; chunk_z <= max_z / voxel_chunk_size_; ++chunk_z) {
+        for (uint32_t chunk_y = min_y / voxel_chunk_size_; chunk_y <= max_y / voxel_chunk_size_; ++chunk_y) {
+            for (uint32_t chunk_x = lower_x / voxel_chunk_size_; chunk_x <= max_x / voxel_chunk_size_; ++chunk_x) {
+                VoxelizedChunk *voxel_chunk = get_chunk(chunk_x, chunk_y, chunk_z);
+                if (!voxel_chunk) {
+                    continue;
+                }
+
+                // The part of the region inside this chunk, in bricks.
+                uint32_t min_chunk_x = chunk_x * voxel_chunk_size_;
+                uint32_t min_chunk_y = chunk_y * voxel_chunk_size_;
+                uint32_t min_chunk_z = chunk_z * voxel_chunk_size_;
+                uint32_t max_chunk_x = min_chunk_x + voxel_chunk_size_ - 1;
+                uint32_t max_chunk_y = min_chunk_y + voxel_chunk_size_ - 1;
+                uint32_t max_chunk_z = min_chunk_z + voxel_chunk_size_ - 1;
+                uint32_t min_brick_x = (std::max(lower_x, min_chunk_x) - min_chunk_x) / voxel_brick_size_;
+                uint32_t min_brick_y = (std::max(min_y, min_chunk_y) - min_chunk_y) / voxel_brick_size_;
+                uint32_t min_brick_z = (std::max(lower_z, min_chunk_z) - min_chunk_z) / voxel_brick_size_;
+                uint32_t max_brick_x = (std::min(max_x, max_chunk_x) - min_chunk_x) / voxel_brick_size_;
+                uint32_t max_brick_y = (std::min(max_y, max_chunk_y) - min_chunk_y) / voxel_brick_size_;
+                uint32_t max_brick_z = (std::min(max_z, max_chunk_z) - min_chunk_z) / voxel_brick_size_;
+                for (uint32_t brick_z = min_brick_z; brick_z <= max_brick_z; ++brick_z) {
+                    for (uint32_t brick_y = min_brick_y; brick_y <= max_brick_y; ++brick_y) {
+                        for (uint32_t brick_x = min_brick_x; brick_x <= max_brick_x; ++brick_x) {
+                            uint64_t brick_index =
+                                locate_in_chunk(brick_x * voxel_brick_size_,
+                                                brick_y * voxel_brick_size_,
+                                                brick_z * voxel_brick_size_).first;
+                            if (voxel_chunk->bricks[brick_index]) {
+                                return false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+uint32_t Voxelizer::empty_subtree_height(uint64_t morton, uint32_t min_height,
+                                         uint32_t max_height, uint32_t lower_x,
+                                         uint32_t lower_y, uint32_t lower_z,
+                                         uint32_t child_width, uint32_t child_height,
+                                         uint32_t child_depth) {
+    constexpr uint64_t MAX_SCANNED_VOLUME = 64 * 64 * 64;
+    uint32_t height = max_height;
+    if (morton) {
+        height = std::min<uint32_t>(height, std::countr_zero(morton) / 3);
+    }
+    min_height = std::max(min_height, 1U);
+    if (height < min_height) {
+        return 0;
+    }
+
+    uint_fast32_t x = 0, y = 0, z = 0;
+    libmorton::morton3D_64_decode(morton, x, y, z);
+    const uint64_t min_x = lower_x + static_cast<uint64_t>(x) * child_width;
+    const uint64_t min_y = lower_y + static_cast<uint64_t>(y) * child_height;
+    const uint64_t min_z = lower_z + static_cast<uint64_t>(z) * child_depth;
+    if (min_x >= width_ || min_y >= height_ || min_z >= depth_) {
+        return height;
+    }
+
+    for (; height >= min_height; --height) {
+        const uint64_t region_width = static_cast<uint64_t>(child_width) << height;
+        const uint64_t region_height = static_cast<uint64_t>(child_height) << height;
+        const uint64_t region_depth = static_cast<uint64_t>(child_depth) << height;
+        const uint32_t max_x = static_cast<uint32_t>(std::min<uint64_t>(min_x + region_width, width_) - 1);
+        const uint32_t max_y = static_cast<uint32_t>(std::min<uint64_t>(min_y + region_height, height_) - 1);
+        const uint32_t max_z = static_cast<uint32_t>(std::min<uint64_t>(min_z + region_depth, depth_) - 1);
+
+        // Chunks store y flipped.
+        const uint32_t flipped_min_y = height_ - max_y - 1;
+        const uint32_t flipped_max_y = height_ - static_cast<uint32_t>(min_y) - 1;
+        bool reached = false;
+        for (uint32_t chunk_z = static_cast<uint32_t>(min_z / voxel_chunk_size_);
+             !reached && chunk_z <= max_z / voxel_chunk_size_; ++chunk_z) {
+            for (uint32_t chunk_y = flipped_min_y / voxel_chunk_size_;
+                 !reached && chunk_y <= flipped_max_y / voxel_chunk_size_; ++chunk_y) {
+                for (uint32_t chunk_x = static_cast<uint32_t>(min_x / voxel_chunk_size_);
+                     !reached && chunk_x <= max_x / voxel_chunk_size_; ++chunk_x) {
+                    reached = !chunk_triangles_.at(linearize_chunk_index(chunk_x, chunk_y, chunk_z)).empty();
+                }
+            }
+        }
+        if (!reached ||
+            (region_width * region_height * region_depth <= MAX_SCANNED_VOLUME &&
+             is_empty(static_cast<uint32_t>(min_x), static_cast<uint32_t>(min_y),
+                      static_cast<uint32_t>(min_z), static_cast<uint32_t>(region_width),
+                      static_cast<uint32_t>(region_height), static_cast<uint32_t>(region_depth)))) {
+            return height;
+        }
+    }
+    return 0;
+}
+
+bool Voxelizer::write_chunk_file(uint32_t chunk_index) {
+    VoxelizedChunk &voxel_chunk = voxel_chunks_.at(chunk_index);
+
+    // Chunks never change after being voxelized, so a chunk that was read
+    // back from its spill file doesn't need to be written out again. Spill
+    // files hold the number of allocated bricks, their indices, and then
+    // their voxels.
+    if (spilled_chunks_.at(chunk_index)) {
+        return false;
+    }
+    std::filesystem::path chunk_path =
+        voxels_directory_ / std::to_string(chunk_index);
+    const uint64_t brick_volume =
+        voxel_brick_size_ * voxel_brick_size_ * voxel_brick_size_;
+    std::vector<uint32_t> brick_indices;
+    for (uint32_t i = 0; i < voxel_chunk.bricks.size(); ++i) {
+        if (voxel_chunk.bricks[i]) {
+            brick_indices.push_back(i);
+        }
+    }
+    uint32_t num_bricks = brick_indices.size();
+
+    std::ofstream stream(chunk_path, std::ios::out | std::ios::binary);
+    stream.write(reinterpret_cast<char *>(&num_bricks), sizeof(uint32_t));
+    stream.write(reinterpret_cast<char *>(brick_indices.data()),
+                 num_bricks * sizeof(uint32_t));
+    for (uint32_t i : brick_indices) {
+        stream.write(reinterpret_cast<char *>(voxel_chunk.bricks[i].get()),
+                     brick_volume * sizeof(uint32_t));
+    }
+    ASSERT(!stream.fail(), "Failed to write voxel chunk to disk.");
+    spilled_chunks_.at(chunk_index) = true;
+    return true;
 }
 
 void Voxelizer::write_voxels_to_disk(uint32_t chunk_index) {
     VoxelizedChunk &voxel_chunk = voxel_chunks_.at(chunk_index);
-    std::cout << "INfO: Writing chunk at index " << chunk_index << " to disk.\n";
-    if (actually_write_to_disk_) {
-	
-	std::filesystem::path chunk_path =
-	    voxels_directory_ /
-	    std::to_string(chunk_index);
-	
-	if (!std::filesystem::exists(chunk_path)) {
-	    std::ofstream stream(chunk_path, std::ios::out | std::ios::binary);
-	    stream.write(reinterpret_cast<char *>(voxel_chunk.data()),
-			 voxel_chunk.size());
-	}
+    std::cout << "INFO: Writing chunk at index " << chunk_index << " to disk.\n";
+    if (write_chunk_file(chunk_index)) {
+        ++num_spills_;
     }
-    
-    current_memory_usage_ -= voxel_chunk.size();
-    voxel_chunks_.at(chunk_index).clear();
-    voxel_chunks_.at(chunk_index).shrink_to_fit();
-    ASSERT(voxel_chunks_.at(chunk_index).size() == 0, "Voxel chunk should be empty after being written to disk!");
 
-    uint64_t actual_memory_usage = 0;
-    for (const auto &chunk : voxel_chunks_) {
-	actual_memory_usage += chunk.capacity();
+    current_memory_usage_ -= voxel_chunk.memory_usage;
+    voxel_chunk.bricks.clear();
+    voxel_chunk.bricks.shrink_to_fit();
+    voxel_chunk.memory_usage = 0;
+    ASSERT(voxel_chunk.empty(), "Voxel chunk should be empty after being written to disk!");
+
+    lru_chunks_.erase(lru_positions_.at(chunk_index));
+    lru_positions_.at(chunk_index) = lru_chunks_.end();
+    if (last_chunk_ == &voxel_chunk) {
+        last_chunk_ = nullptr;
+        last_chunk_x_ = ~0;
+        last_chunk_y_ = ~0;
+        last_chunk_z_ = ~0;
     }
-    std::cout << "INFO: After writing, the amount of memory used for raw voxel chunks is " << actual_memory_usage << " bytes.\n";
+
+    std::cout << "INFO: After writing, the amount of memory used for voxel chunks is " << current_memory_usage_ << " bytes.\n";
 }
 
 void Voxelizer::read_voxels_from_disk(uint32_t chunk_index) {
     VoxelizedChunk &voxel_chunk = voxel_chunks_.at(chunk_index);
+    const uint64_t brick_volume =
+        voxel_brick_size_ * voxel_brick_size_ * voxel_brick_size_;
 
     std::filesystem::path chunk_path =
         voxels_directory_ / std::to_string(chunk_index);
     std::ifstream stream(chunk_path, std::ios::in | std::ios::binary);
-    const auto size = std::filesystem::file_size(chunk_path);
-    voxel_chunk.resize(size);
-    stream.read(reinterpret_cast<char *>(voxel_chunk.data()), size);
+    uint32_t num_bricks;
+    stream.read(reinterpret_cast<char *>(&num_bricks), sizeof(uint32_t));
+    std::vector<uint32_t> brick_indices(num_bricks);
+    stream.read(reinterpret_cast<char *>(brick_indices.data()),
+                num_bricks * sizeof(uint32_t));
+    voxel_chunk.bricks.resize(get_brick_table_size());
+    for (uint32_t i : brick_indices) {
+        voxel_chunk.bricks.at(i) = std::make_unique<uint32_t[]>(brick_volume);
+        stream.read(reinterpret_cast<char *>(voxel_chunk.bricks[i].get()),
+                    brick_volume * sizeof(uint32_t));
+    }
+    ASSERT(!stream.fail(), "Failed to read voxel chunk back from disk.");
+
+    voxel_chunk.memory_usage =
+        num_bricks * brick_volume * sizeof(uint32_t) +
+        voxel_chunk.bricks.size() * sizeof(voxel_chunk.bricks[0]);
+    current_memory_usage_ += voxel_chunk.memory_usage;
+    lru_positions_.at(chunk_index) =
+        lru_chunks_.insert(lru_chunks_.begin(), chunk_index);
+    ++num_reloads_;
+}
 
-    current_memory_usage_ += voxel_chunk.size();
+void Voxelizer::save_chunks(const std::filesystem::path &directory) {
+    // A chunk still being prefetched isn't saved, and is voxelized again if
+    // it's needed after restoring.
+    std::filesystem::create_directories(directory);
+    for (uint32_t chunk_index : lru_chunks_) {
+        write_chunk_file(chunk_index);
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(voxels_directory_)) {
+        std::filesystem::path saved_path = directory / entry.path().filename();
+        if (std::filesystem::exists(saved_path)) {
+            continue;
+        }
+        std::error_code error;
+        std::filesystem::create_hard_link(entry.path(), saved_path, error);
+        if (error) {
+            std::filesystem::copy_file(entry.path(), saved_path);
+        }
+    }
+}
+
+void Voxelizer::restore_chunks(const std::filesystem::path &directory) {
+    if (!std::filesystem::exists(directory)) {
+        return;
+    }
+    uint32_t num_restored = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        uint32_t chunk_index = std::stoul(entry.path().filename().string());
+        ASSERT(chunk_index < voxel_chunks_.size(),
+               "Saved chunk doesn't belong to this voxelizer.");
+        std::filesystem::path chunk_path = voxels_directory_ / entry.path().filename();
+        std::error_code error;
+        std::filesystem::create_hard_link(entry.path(), chunk_path, error);
+        if (error) {
+            std::filesystem::copy_file(entry.path(), chunk_path,
+                                       std::filesystem::copy_options::overwrite_existing);
+        }
+        spilled_chunks_.at(chunk_index) = true;
+        ++num_restored;
+    }
+    std::cout << "INFO: Restored " << num_restored << " voxelized chunks from " << directory << ".\n";
 }
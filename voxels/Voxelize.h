@@ -1,18 +1,65 @@
 #pragma once
 
 #include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
 #include <optional>
+#include <span>
 
+#include <external/CTPL/ctpl_stl.h>
 #include <external/glm/glm/glm.hpp>
 #include <external/stb_image.h>
 
+#include "BrickStream.h"
+#include "TextureCache.h"
 #include "Voxel.h"
 
-std::vector<std::byte> raw_voxelize_obj(std::string_view filepath,
-                                        float voxel_size,
-                                        uint32_t &out_chunk_width,
-                                        uint32_t &out_chunk_height,
-                                        uint32_t &out_chunk_depth);
+// Which color a voxel covered by several triangles gets. LastTriangle keeps
+// the last triangle's (in model order), so every voxel has to be written by
+// one thread, and threads voxelize separate z-slabs of the grid.
+// NearestTriangle keeps the color of the triangle whose plane passes closest
+// to the voxel's center (ties going to the smaller color), which doesn't
+// depend on the order triangles are voxelized in. Threads voxelize separate
+// runs of triangles instead, and resolve conflicting writes with 64-bit
+// atomics. Either way, the output doesn't depend on the number of threads.
+enum class VoxelResolve {
+    LastTriangle,
+    NearestTriangle,
+};
+
+// Voxels are 4 bytes of RGBA color with the Color attribute set. With
+// ColorNormal, each is followed by 4 bytes of normal, the normalized sum of
+// the normals of the triangles covering the voxel, packed by pack_normal.
+// NearestTriangle needs 8 bytes of scratch per voxel while voxelizing, and
+// only supports the Color attribute set.
+std::vector<std::byte> raw_voxelize_obj(
+    std::string_view filepath, float voxel_size, uint32_t &out_chunk_width,
+    uint32_t &out_chunk_height, uint32_t &out_chunk_depth,
+    uint32_t num_threads = 1,
+    VoxelChunk::AttributeSet attribute_set = VoxelChunk::AttributeSet::Color,
+    VoxelResolve resolve = VoxelResolve::LastTriangle);
+
+// Voxelizes the model into the same grid as raw_voxelize_obj, but only keeps
+// the bricks with voxels in them, so memory scales with the model's surface
+// rather than its bounding box.
+MortonBrickStream brick_voxelize_obj(
+    std::string_view filepath, float voxel_size, uint32_t num_threads = 1,
+    VoxelChunk::AttributeSet attribute_set = VoxelChunk::AttributeSet::Color);
+
+class MeshCache;
+
+// Voxelizes the model again after it was edited, but only where it may have
+// changed since the snapshot previous was taken of it: the 64^3 voxel tiles
+// overlapped by triangles that were added, removed or reordered. Returns the
+// non-empty bricks in those tiles, which hold exactly what
+// brick_voxelize_obj would put there, and sets dirty_ranges to the tiles, as
+// sorted ranges of Morton codes. Returns nothing if the model's bounds (and
+// so the grid) or its textures changed, since every voxel could have too.
+std::optional<MortonBrickStream> brick_revoxelize_obj(
+    std::string_view filepath, const MeshCache &previous, float voxel_size,
+    uint32_t num_threads, VoxelChunk::AttributeSet attribute_set,
+    std::vector<std::pair<uint64_t, uint64_t>> &out_dirty_ranges);
 
 struct Triangle {
     glm::vec3 a, b, c;
@@ -38,17 +85,51 @@ struct Triangle {
                       glm::vec3 axis) const;
 };
 
+// The separating axis test of Triangle::tri_aabb, with the per-triangle axes
+// and box radii computed once up front. Boxes must all have the same extents.
+// overlaps_row tests a row of boxes that only differ in z with SIMD (AVX2 or
+// SSE2, depending on what the compiler targets), and returns exactly what
+// calling overlaps on each of the boxes would.
+class TriangleBoxTest {
+  public:
+    static constexpr uint32_t MAX_ROW_LENGTH = 8;
+
+    TriangleBoxTest(const Triangle &tri, glm::vec3 aabb_extents);
+
+    bool overlaps(glm::vec3 aabb_center) const;
+
+    // Tests the boxes centered at (x, y, z[i]) for i < count, and sets bit i
+    // of the result if box i overlaps the triangle.
+    uint32_t overlaps_row(float x, float y, const float *z, uint32_t count) const;
+
+    // A box centered at c can only overlap the triangle if
+    // plane_min() <= dot(plane_normal(), c) <= plane_max(). The range is a
+    // little wider than the plane's separating axis, to absorb rounding.
+    glm::vec3 plane_normal() const { return axes_[PLANE_AXIS]; }
+    double plane_min() const { return plane_min_; }
+    double plane_max() const { return plane_max_; }
+
+  private:
+    static constexpr uint32_t NUM_AXES = 13;
+    static constexpr uint32_t PLANE_AXIS = 12;
+
+    glm::vec3 vertices_[3];
+    glm::vec3 axes_[NUM_AXES];
+    float radii_[NUM_AXES];
+    double plane_min_, plane_max_;
+};
+
 class Model {
 public: 
     Model() = default;
-    Model(std::string_view filepath);
+    Model(std::string_view filepath, uint32_t num_threads = 1);
     ~Model();
 
     glm::vec3 get_max() const {return max_;}
     glm::vec3 get_min() const {return min_;}
     bool has_materials() const {return has_materials_;}
 
-    const std::vector<Triangle> get_triangles() const {return triangles_;}
+    const std::vector<Triangle> &get_triangles() const {return triangles_;}
     const std::unordered_map<int, std::tuple<stbi_uc *, int, int>> &
     get_textures() const {return loaded_textures_;}
 
@@ -58,6 +139,20 @@ private:
 
     bool has_materials_;
     std::unordered_map<int, std::tuple<stbi_uc *, int, int>> loaded_textures_;
+    TextureCache texture_cache_;
+
+    // Set if the model was loaded from its mesh cache, in which case the
+    // textures point into it rather than into the texture cache.
+    std::unique_ptr<MeshCache> mesh_cache_;
+};
+
+// How voxels are ordered inside a Voxelizer chunk. Chunks are always split
+// into bricks, and Tiled lays each brick (and the brick table) out x-major,
+// while Morton orders both along a Z-order curve, the order the generated
+// construction code walks the model in.
+enum class VoxelLayout {
+    Tiled,
+    Morton,
 };
 
 class Voxelizer {
@@ -65,47 +160,215 @@ class Voxelizer {
     uint32_t width_, height_, depth_;
     uint32_t chunks_width_, chunks_height_, chunks_depth_;
     float voxel_size_;
-    uint32_t num_chunks_voxelized_ = 0;
 
-    const bool actually_write_to_disk_ = false;
+    // Chunks are voxelized as independent z-slabs on this many threads.
+    uint32_t num_threads_;
+    std::unique_ptr<ctpl::thread_pool> pool_;
 
-    // The max size (in bytes) that the voxelizer should store
-    // before it should start storing older chunks on the disk.
-    const uint64_t max_memory_usage_ = ((uint64_t) 1 << 32) + ((uint64_t) 1 << 31);
+    // The max size (in bytes) that the voxelizer should store before it
+    // should start spilling the least recently used chunks to the disk.
+    uint64_t max_memory_usage_;
 
     // The dimension size of each voxel chunk (e.g. N x N x N)
     const uint64_t voxel_chunk_size_ = (uint64_t) 1 << 10;
 
+    // The dimension size of the bricks each chunk is stored as. Bricks are
+    // only allocated once a voxel in them is written, so a chunk's memory
+    // scales with the surface passing through it rather than its volume.
+    const uint64_t voxel_brick_size_ = (uint64_t) 1 << 3;
+
+    VoxelLayout layout_;
+
     // This only keeps track of the memory used by the voxel data itself,
     // and not the rest of the program.
     uint64_t current_memory_usage_ = 0;
 
-    typedef std::vector<std::byte> VoxelizedChunk;
+    struct VoxelizedChunk {
+        // Indexed by brick, and null for bricks without any voxels. Empty if
+        // the chunk isn't in memory.
+        std::vector<std::unique_ptr<uint32_t[]>> bricks;
+
+        // Bytes used by the allocated bricks and the brick table.
+        uint64_t memory_usage = 0;
+
+        bool empty() const { return bricks.empty(); }
+    };
     std::vector<VoxelizedChunk> voxel_chunks_;
 
+    // What voxelizing a chunk tested, added to the totals below once the
+    // chunk is installed.
+    struct ChunkStatistics {
+        uint64_t num_triangles_scanned = 0;
+        uint64_t num_triangles_tested = 0;
+        uint64_t num_triangles_accepted = 0;
+        uint64_t num_voxels_tested = 0;
+        uint64_t num_voxels_in_bounds = 0;
+    };
+
     VoxelizedChunk *last_chunk_ = nullptr;
     uint32_t last_chunk_x_ = ~0;
     uint32_t last_chunk_y_ = ~0;
     uint32_t last_chunk_z_ = ~0;
 
+    // Resident chunks, most recently used first, and where each chunk is in
+    // that list (lru_chunks_.end() if it isn't resident).
+    std::list<uint32_t> lru_chunks_;
+    std::vector<std::list<uint32_t>::iterator> lru_positions_;
+
+    // Chunks evicted to stay within the memory budget, spill files written
+    // and read back, and chunks voxelized from scratch.
+    uint64_t num_evictions_ = 0;
+    uint64_t num_spills_ = 0;
+    uint64_t num_reloads_ = 0;
+    uint64_t num_voxelizations_ = 0;
+
+    // Once a chunk is voxelized, the next chunk construction will probably
+    // need is voxelized in the background (on the same pool), so the two
+    // overlap. Only one chunk is in flight at a time, and it's installed like
+    // any other voxelized chunk before anything else touches the cache.
+    std::future<void> prefetch_;
+    uint32_t prefetch_chunk_index_ = 0;
+    VoxelizedChunk prefetched_chunk_;
+    ChunkStatistics prefetched_statistics_;
+    uint64_t num_prefetches_ = 0;
+    uint64_t num_prefetch_hits_ = 0;
+
+    // The biggest chunk voxelized so far, which is what a prefetched chunk is
+    // assumed to need before it's voxelized.
+    uint64_t largest_chunk_memory_usage_ = 0;
+
+    // Every chunk, in the order construction visits them, and where each chunk
+    // is in that order.
+    std::vector<uint32_t> chunk_order_;
+    std::vector<uint32_t> chunk_order_positions_;
+
     Model model_;
 
+    // For every chunk, the indices (in model order) of the triangles whose
+    // voxel bounding boxes overlap it. Built once, in the constructor.
+    std::vector<std::vector<uint32_t>> chunk_triangles_;
+
+    // Triangles visited while voxelizing chunks, how many of those actually
+    // covered a voxel, and how many a full scan of the model would've visited.
+    uint64_t num_triangles_tested_ = 0;
+    uint64_t num_triangles_accepted_ = 0;
+    uint64_t num_triangles_scanned_ = 0;
+
+    // Voxels tested against triangles while voxelizing chunks, and how many
+    // sweeping every triangle's whole bounding box would've tested.
+    uint64_t num_voxels_tested_ = 0;
+    uint64_t num_voxels_in_bounds_ = 0;
+
+    void build_chunk_triangle_index();
+
     inline uint32_t linearize_chunk_index(uint32_t x, uint32_t y, uint32_t z) const;
 
     inline std::tuple<uint32_t, uint32_t, uint32_t> get_voxel_chunk_index(uint32_t x, uint32_t y, uint32_t z) const;
+
+    // The brick that voxel (x, y, z) of a chunk is in, and its index in it.
+    inline std::pair<uint64_t, uint64_t> locate_in_chunk(uint32_t x, uint32_t y, uint32_t z) const;
+    uint64_t get_brick_table_size() const;
     void voxelize_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z);
 
-    // The chunk to voxelize should not be written out to disk
-    std::optional<uint32_t> find_old_voxel_chunk(uint32_t chunk_to_voxelize) const;
+    // Voxelizes a chunk into voxel_chunk. Only reads the model and the
+    // triangle bins, so it's safe to run while the cache is being used.
+    void fill_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z,
+                    VoxelizedChunk &voxel_chunk,
+                    ChunkStatistics &statistics) const;
+
+    // Accounts for a freshly voxelized, resident chunk and makes it the most
+    // recently used one.
+    void add_voxelized_chunk(uint32_t chunk_index,
+                             const ChunkStatistics &statistics);
+
+    // Starts voxelizing the chunk most likely to be needed after chunk_index,
+    // if there's room for it.
+    void prefetch_after(uint32_t chunk_index);
+
+    // Waits for the chunk in flight, if any, and installs it.
+    void finish_prefetch();
+
+    // Makes the chunk resident, voxelizing it if needed, and caches it as the
+    // last chunk used. Returns null for chunks no triangle reaches, which are
+    // empty and never voxelized.
+    VoxelizedChunk *get_chunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t chunk_z);
+
+    // Spills the least recently used chunks, other than chunk_index, until
+    // added_memory more bytes fit in the memory budget.
+    void make_room(uint32_t chunk_index, uint64_t added_memory);
+
+    // Marks a resident chunk as the most recently used one.
+    void touch_chunk(uint32_t chunk_index);
+
+    // The least recently used resident chunk other than excluded (the one
+    // being made room for), or nullopt if there's none.
+    std::optional<uint32_t> least_recently_used_chunk(uint32_t excluded) const;
+    // Writes a resident chunk's spill file, unless it already has one.
+    // Returns whether it wrote one.
+    bool write_chunk_file(uint32_t chunk_index);
     void write_voxels_to_disk(uint32_t chunk_index);
     void read_voxels_from_disk(uint32_t chunk_index);
     std::filesystem::path voxels_directory_;
+    // Whether each chunk has a spill file in voxels_directory_.
+    std::vector<bool> spilled_chunks_;
 
   public:
+    static constexpr uint64_t DEFAULT_MAX_MEMORY_USAGE =
+        ((uint64_t) 1 << 32) + ((uint64_t) 1 << 31);
 
     Voxelizer(std::string_view filepath,
-              std::tuple<uint32_t, uint32_t, uint32_t> size);
+              std::tuple<uint32_t, uint32_t, uint32_t> size,
+              uint32_t num_threads = 1,
+              uint64_t max_memory_usage = DEFAULT_MAX_MEMORY_USAGE,
+              VoxelLayout layout = VoxelLayout::Tiled);
     ~Voxelizer();
 
     uint32_t at(uint32_t x, uint32_t y, uint32_t z);
+
+    // Fills out with the width x height x depth block of voxels starting at
+    // (lower_x, lower_y, lower_z), x-major, exactly as calling at() on each
+    // voxel would. Copies whole brick rows at a time with the tiled layout.
+    void at_block(uint32_t lower_x, uint32_t lower_y, uint32_t lower_z,
+                  uint32_t width, uint32_t height, uint32_t depth,
+                  std::span<uint32_t> out);
+
+    // Returns true if every voxel in the width x height x depth region starting
+    // at (lower_x, lower_y, lower_z) is empty. Only looks at which bricks are
+    // allocated, so it may return false for an empty region sharing a brick
+    // with voxels.
+    bool is_empty(uint32_t lower_x, uint32_t lower_y, uint32_t lower_z,
+                  uint32_t width, uint32_t height, uint32_t depth);
+
+    // How tall the tallest subtree starting at Morton code morton is, of at
+    // most max_height levels, that has no voxels in it, or 0 if none of at
+    // least min_height levels is. The tree is over children of child_width x
+    // child_height x child_depth voxels, its first child at (lower_x, lower_y,
+    // lower_z). Space outside the model and chunks no triangle reaches are
+    // known to be empty without voxelizing anything, so the padding up to a
+    // power of two is skipped a whole subtree at a time; subtrees of up to
+    // 64^3 voxels are checked brick by brick, like is_empty does.
+    uint32_t empty_subtree_height(uint64_t morton, uint32_t min_height, uint32_t max_height,
+                                  uint32_t lower_x, uint32_t lower_y, uint32_t lower_z,
+                                  uint32_t child_width, uint32_t child_height,
+                                  uint32_t child_depth);
+
+    // Saves every chunk voxelized so far into directory, which later runs
+    // over the same model and bounds can restore_chunks from. Resident chunks
+    // are written out like they would be when spilled, but stay resident,
+    // and spill files are hard linked, so each chunk is only written once no
+    // matter how often it's saved.
+    void save_chunks(const std::filesystem::path &directory);
+
+    // Makes the chunks saved in directory spilled chunks of this voxelizer,
+    // so they're read back instead of being voxelized again.
+    void restore_chunks(const std::filesystem::path &directory);
+
+    uint64_t get_num_triangles_tested() const {return num_triangles_tested_;}
+    uint64_t get_num_triangles_accepted() const {return num_triangles_accepted_;}
+    uint64_t get_num_evictions() const {return num_evictions_;}
+    uint64_t get_num_spills() const {return num_spills_;}
+    uint64_t get_num_reloads() const {return num_reloads_;}
+    uint64_t get_num_voxelizations() const {return num_voxelizations_;}
+    uint64_t get_num_prefetches() const {return num_prefetches_;}
+    uint64_t get_num_prefetch_hits() const {return num_prefetch_hits_;}
 };
@@ -6,6 +6,8 @@
 
 #include <external/libmorton/include/libmorton/morton.h>
 
+#include "Checkpoint.h"
+#include "DistanceTransform.h"
 #include "Voxelize.h"
 
 template<class T> 
@@ -24,6 +26,12 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
     return node;
 }
 
+static uint32_t fetch_voxel(const std::vector<uint32_t> &voxel_block, uint64_t index, bool &is_empty) {
+    uint32_t voxel = voxel_block[index];
+    is_empty = voxel == 0;
+    return voxel;
+}
+
 static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffer, const std::vector<uint32_t> &node) {
     uint32_t offset = buffer.second;
     buffer.first.write(reinterpret_cast<const char *>(node.data()), node.size() * sizeof(uint32_t));
@@ -38,31 +46,31 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
     return offset;
 }
 
-static std::vector<uint32_t> df_16_16_16_6_svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
+static std::vector<uint32_t> df_16_16_16_6_svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, ConstructionCheckpoint &checkpoint);
 
 static std::vector<uint32_t> svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map);
 
-static uint32_t _construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
-
-void df_16_16_16_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer) {
+void df_16_16_16_6_svdag_5_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint) {
     bool is_empty;
     uint32_t size = 0;
     buffer.write(reinterpret_cast<const char *>(&size), sizeof(uint32_t));
     ++size;
-    auto root_node = df_16_16_16_6_svdag_5_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty);
+    auto root_node = df_16_16_16_6_svdag_5_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty, checkpoint);
     uint32_t root = push_node_to_buffer({buffer, size}, root_node);
     buffer.seekp(0, std::ios_base::beg);
     buffer.write(reinterpret_cast<const char *>(&root), sizeof(uint32_t));
     buffer.seekp(0, std::ios_base::end);
 }
 
-static std::vector<uint32_t> df_16_16_16_6_svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
+static std::vector<uint32_t> df_16_16_16_6_svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, ConstructionCheckpoint &checkpoint) {
     std::unordered_map<std::vector<uint32_t>, uint32_t> deduplication_map;
 
     is_empty = true;
     uint64_t num_voxels = 4096;
     std::vector<uint32_t> df_chunk(num_voxels * 1);
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
+    uint64_t first_morton = 0;
+    checkpoint.restore(buffer, first_morton, is_empty, df_chunk, deduplication_map);
+    for (uint64_t morton = first_morton; morton < num_voxels; ++morton) {
         uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
         libmorton::morton3D_64_decode(morton, g_x, g_y, g_z);
         uint64_t linear_idx = g_x + g_y * 16 + g_z * 16 * 16;
@@ -75,37 +83,29 @@ static std::vector<uint32_t> df_16_16_16_6_svdag_5_construct_node(Voxelizer &vox
             df_chunk.at(linear_idx * 1) = push_node_to_buffer(buffer, sub_chunk);
         }
         is_empty = is_empty && sub_is_empty;
-    }
-    uint32_t k = 6;
-    for (uint32_t g_z = 0; g_z < 16; ++g_z) {
-        for (uint32_t g_y = 0; g_y < 16; ++g_y) {
-            for (uint32_t g_x = 0; g_x < 16; ++g_x) {
-                uint32_t g_voxel_offset = (g_x + g_y * 16 + g_z * 16 * 16);
-                uint32_t min_dist = k;
-                for (uint32_t kz = g_z > k ? g_z - k : 0; kz <= g_z + k && kz < 16; ++kz) {
-                    for (uint32_t ky = g_y > k ? g_y - k : 0; ky <= g_y + k && ky < 16; ++ky) {
-                        for (uint32_t kx = g_x > k ? g_x - k : 0; kx <= g_x + k && kx < 16; ++kx) {
-                            size_t k_voxel_offset = kx + ky * 16 + kz * 16 * 16;
-                            if (df_chunk[k_voxel_offset] & 268435455) {
-                                uint32_t dist =
-                                (g_z > kz ? g_z - kz : kz - g_z) +
-                                (g_y > ky ? g_y - ky : ky - g_y) +
-                                (g_x > kx ? g_x - kx : kx - g_x);
-                                if (dist < min_dist && dist) {
-                                    min_dist = dist;
-                                }
-                            }
-                        }
-                    }
-                }
-                df_chunk[g_voxel_offset] |= (min_dist - 1) << (32 - 4);
-            }
+        if (checkpoint.due()) {
+            checkpoint.save(voxelizer, buffer, morton + 1, is_empty, df_chunk, deduplication_map);
         }
     }
+    std::vector<bool> occupied(num_voxels);
+    for (uint64_t index = 0; index < num_voxels; ++index) {
+        occupied[index] = (df_chunk[index] & 268435455) != 0;
+    }
+    std::vector<uint32_t> distances = distance_transform(occupied, 16, 16, 16, 6, DistanceMetric::Manhattan, true);
+    for (uint64_t index = 0; index < num_voxels; ++index) {
+        df_chunk[index] |= (distances[index] - 1) << (32 - 4);
+    }
     return df_chunk;
 }
 
 static std::vector<uint32_t> svdag_5_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, std::unordered_map<std::vector<uint32_t>, uint32_t> &deduplication_map) {
+    if (voxelizer.is_empty(lower_x, lower_y, lower_z, 32, 32, 32)) {
+        is_empty = true;
+        return {};
+    }
+
+    std::vector<uint32_t> voxel_block(512);
+
     uint32_t power_of_two = 5;
     const uint64_t bounded_edge_length = 1 << power_of_two;
     std::vector<std::vector<std::vector<uint32_t>>> queues(power_of_two + 1);
@@ -128,18 +128,25 @@ static std::vector<uint32_t> svdag_5_construct_node(Voxelizer &voxelizer, std::p
     for (uint64_t morton = 0; morton < num_voxels; ++morton) {
         uint_fast32_t x = 0, y = 0, z = 0;
         libmorton::morton3D_64_decode(morton, x, y, z);
-
+        uint32_t d = power_of_two;
         std::vector<uint32_t> node = {0};
-        uint32_t sub_lower_x = x * 1 + lower_x, sub_lower_y = y * 1 + lower_y, sub_lower_z = z * 1 + lower_z;
-        bool sub_is_empty;
-        auto sub_chunk = _construct_node(voxelizer, buffer, sub_lower_x, sub_lower_y, sub_lower_z, sub_is_empty);
-        if (!sub_is_empty) {
-            node[0] = push_node_to_buffer(buffer, sub_chunk);
-            is_empty = false;
+        if (uint32_t height = morton % 512 ? 0 : voxelizer.empty_subtree_height(morton, 3, power_of_two, lower_x, lower_y, lower_z, 1, 1, 1)) {
+            d -= height;
+            morton += (static_cast<uint64_t>(1) << (3 * height)) - 1;
+        } else {
+            if (morton % 512 == 0) {
+                voxelizer.at_block(lower_x + x, lower_y + y, lower_z + z, 8, 8, 8, voxel_block);
+            }
+            uint32_t sub_lower_x = x * 1 + lower_x, sub_lower_y = y * 1 + lower_y, sub_lower_z = z * 1 + lower_z;
+            bool sub_is_empty;
+            auto sub_chunk = fetch_voxel(voxel_block, (x % 8) + (y % 8) * 8 + (z % 8) * 64, sub_is_empty);
+            if (!sub_is_empty) {
+                node[0] = push_node_to_buffer(buffer, sub_chunk);
+                is_empty = false;
+            }
         }
 
-        queues.at(power_of_two).emplace_back(node);
-        uint32_t d = power_of_two;
+        queues.at(d).emplace_back(node);
         while (d > 0 && queues.at(d).size() == 8) {
             std::vector<uint32_t> node = {0};
 
@@ -178,9 +185,3 @@ static std::vector<uint32_t> svdag_5_construct_node(Voxelizer &voxelizer, std::p
 
     return queues.at(0).at(0);
 }
-
-static uint32_t _construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
-    uint32_t voxel = voxelizer.at(lower_x, lower_y, lower_z);
-    is_empty = voxel == 0;
-    return voxel;
-}
@@ -6,6 +6,8 @@
 
 #include <external/libmorton/include/libmorton/morton.h>
 
+#include "Checkpoint.h"
+#include "DistanceTransform.h"
 #include "Voxelize.h"
 
 template<class T> 
@@ -24,6 +26,12 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
     return node;
 }
 
+static uint32_t fetch_voxel(const std::vector<uint32_t> &voxel_block, uint64_t index, bool &is_empty) {
+    uint32_t voxel = voxel_block[index];
+    is_empty = voxel == 0;
+    return voxel;
+}
+
 static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffer, const std::vector<uint32_t> &node) {
     uint32_t offset = buffer.second;
     buffer.first.write(reinterpret_cast<const char *>(node.data()), node.size() * sizeof(uint32_t));
@@ -38,31 +46,31 @@ static uint32_t push_node_to_buffer(std::pair<std::ofstream &, uint32_t &> buffe
     return offset;
 }
 
-static std::vector<uint32_t> raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
+static std::vector<uint32_t> raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, ConstructionCheckpoint &checkpoint);
 
 static std::vector<uint32_t> raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
 
 static std::vector<uint32_t> raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
 
-static uint32_t _construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty);
-
-void raw_16_16_16_raw_16_16_16_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer) {
+void raw_16_16_16_raw_16_16_16_raw_8_8_8_construct(Voxelizer &voxelizer, std::ofstream &buffer, ConstructionCheckpoint &checkpoint) {
     bool is_empty;
     uint32_t size = 0;
     buffer.write(reinterpret_cast<const char *>(&size), sizeof(uint32_t));
     ++size;
-    auto root_node = raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty);
+    auto root_node = raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(voxelizer, {buffer, size}, 0, 0, 0, is_empty, checkpoint);
     uint32_t root = push_node_to_buffer({buffer, size}, root_node);
     buffer.seekp(0, std::ios_base::beg);
     buffer.write(reinterpret_cast<const char *>(&root), sizeof(uint32_t));
     buffer.seekp(0, std::ios_base::end);
 }
 
-static std::vector<uint32_t> raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
+static std::vector<uint32_t> raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty, ConstructionCheckpoint &checkpoint) {
     is_empty = true;
     uint64_t num_voxels = 4096;
     std::vector<uint32_t> raw_chunk(num_voxels);
-    for (uint64_t morton = 0; morton < num_voxels; ++morton) {
+    uint64_t first_morton = 0;
+    checkpoint.restore(buffer, first_morton, is_empty, raw_chunk);
+    for (uint64_t morton = first_morton; morton < num_voxels; ++morton) {
         uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
         libmorton::morton3D_64_decode(morton, g_x, g_y, g_z);
         uint64_t linear_idx = g_x + g_y * 16 + g_z * 16 * 16;
@@ -75,11 +83,19 @@ static std::vector<uint32_t> raw_16_16_16_raw_16_16_16_raw_8_8_8_construct_node(
             raw_chunk.at(linear_idx) = push_node_to_buffer(buffer, sub_chunk);
         }
         is_empty = is_empty && sub_is_empty;
+        if (checkpoint.due()) {
+            checkpoint.save(voxelizer, buffer, morton + 1, is_empty, raw_chunk);
+        }
     }
     return raw_chunk;
 }
 
 static std::vector<uint32_t> raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
+    if (voxelizer.is_empty(lower_x, lower_y, lower_z, 128, 128, 128)) {
+        is_empty = true;
+        return {};
+    }
+
     is_empty = true;
     uint64_t num_voxels = 4096;
     std::vector<uint32_t> raw_chunk(num_voxels);
@@ -101,18 +117,28 @@ static std::vector<uint32_t> raw_16_16_16_raw_8_8_8_construct_node(Voxelizer &vo
 }
 
 static std::vector<uint32_t> raw_8_8_8_construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
+    if (voxelizer.is_empty(lower_x, lower_y, lower_z, 8, 8, 8)) {
+        is_empty = true;
+        return {};
+    }
+
+    std::vector<uint32_t> voxel_block(512);
+
     is_empty = true;
     uint64_t num_voxels = 512;
     std::vector<uint32_t> raw_chunk(num_voxels);
     for (uint64_t morton = 0; morton < num_voxels; ++morton) {
         uint_fast32_t g_x = 0, g_y = 0, g_z = 0;
         libmorton::morton3D_64_decode(morton, g_x, g_y, g_z);
+        if (morton % 512 == 0) {
+            voxelizer.at_block(lower_x + g_x, lower_y + g_y, lower_z + g_z, 8, 8, 8, voxel_block);
+        }
         uint64_t linear_idx = g_x + g_y * 8 + g_z * 8 * 8;
         uint32_t sub_lower_x = lower_x + g_x * 1;
         uint32_t sub_lower_y = lower_y + g_y * 1;
         uint32_t sub_lower_z = lower_z + g_z * 1;
         bool sub_is_empty;
-        auto sub_chunk = _construct_node(voxelizer, buffer, sub_lower_x, sub_lower_y, sub_lower_z, sub_is_empty);
+        auto sub_chunk = fetch_voxel(voxel_block, (g_x % 8) + (g_y % 8) * 8 + (g_z % 8) * 64, sub_is_empty);
         if (!sub_is_empty) {
             raw_chunk.at(linear_idx) = push_node_to_buffer(buffer, sub_chunk);
         }
@@ -120,9 +146,3 @@ static std::vector<uint32_t> raw_8_8_8_construct_node(Voxelizer &voxelizer, std:
     }
     return raw_chunk;
 }
-
-static uint32_t _construct_node(Voxelizer &voxelizer, std::pair<std::ofstream &, uint32_t &> buffer, uint32_t lower_x, uint32_t lower_y, uint32_t lower_z, bool &is_empty) {
-    uint32_t voxel = voxelizer.at(lower_x, lower_y, lower_z);
-    is_empty = voxel == 0;
-    return voxel;
-}